@@ -0,0 +1,1098 @@
+
+
+#include "compiler.h"
+#include "environment.h"
+#include "statement.h"
+#include "error.h"
+#include "alloc.h"
+
+#include <assert.h>
+
+/*
+ * The compiler turns a function body or module chunk into register
+ * bytecode for the vm. Every expression is compiled into a register given
+ * by its caller; temporaries are allocated above the frame's locals and
+ * released at the end of each statement.
+ *
+ * The bytecode keeps the evaluator's semantics: names are still looked up
+ * through the resolver's candidate slots, scopes are cleared on entry and
+ * their upvalues closed on exit, and break/continue close the scopes they
+ * jump out of.
+ */
+
+#define COMPILER_MAX_REGISTERS (0xFFFFU)
+
+typedef struct compiler_s*          compiler_t;
+typedef struct compiler_loop_s*     compiler_loop_t;
+typedef struct compiler_lvalue_s*   compiler_lvalue_t;
+
+struct compiler_loop_s {
+    compiler_loop_t parent;
+    unsigned long   depth;          /* open scopes around the loop body */
+    array_t         breaks;         /* unsigned long, jumps to the loop exit */
+    array_t         continues;      /* unsigned long, jumps to the next pass */
+};
+
+struct compiler_s {
+    code_t          code;
+    bool            function;       /* a function body, not a module chunk */
+    statement_t     toplevel;       /* statement of the body being compiled */
+    unsigned int    top;            /* first free register */
+    array_t         scopes;         /* statement_t, open scopes */
+    compiler_loop_t loop;
+};
+
+/* the registers an lvalue's container and key were evaluated into */
+struct compiler_lvalue_s {
+    expression_t expr;
+    unsigned int dict;
+    unsigned int index;
+};
+
+static void          __compiler_init__(compiler_t compiler, unsigned int frame_size, bool function);
+static code_t        __compiler_finish__(compiler_t compiler);
+static unsigned long __compiler_emit__(compiler_t compiler, long line, long column, opcode_t op, unsigned int a, unsigned int b, unsigned int c, unsigned long x);
+static unsigned long __compiler_here__(compiler_t compiler);
+static void          __compiler_patch__(compiler_t compiler, unsigned long pc, unsigned long target);
+static void          __compiler_patch_all__(compiler_t compiler, array_t jumps, unsigned long target);
+static unsigned int  __compiler_register__(compiler_t compiler);
+static unsigned long __compiler_constant__(compiler_t compiler, value_t value);
+static unsigned long __compiler_operand__(compiler_t compiler, void *operand);
+static void          __compiler_block__(compiler_t compiler, list_t block);
+static void          __compiler_statement__(compiler_t compiler, statement_t stmt);
+static void          __compiler_enter_scope__(compiler_t compiler, statement_t stmt);
+static void          __compiler_leave_scope__(compiler_t compiler, statement_t stmt);
+static void          __compiler_close_scopes__(compiler_t compiler, statement_t stmt, unsigned long depth);
+static void          __compiler_enter_loop__(compiler_t compiler, compiler_loop_t loop);
+static void          __compiler_leave_loop__(compiler_t compiler, unsigned long continue_target, unsigned long break_target);
+static void          __compiler_if_statement__(compiler_t compiler, statement_t stmt);
+static void          __compiler_switch_statement__(compiler_t compiler, statement_t stmt);
+static void          __compiler_while_statement__(compiler_t compiler, statement_t stmt);
+static void          __compiler_for_statement__(compiler_t compiler, statement_t stmt);
+static void          __compiler_foreach_statement__(compiler_t compiler, statement_t stmt);
+static void          __compiler_jump_statement__(compiler_t compiler, statement_t stmt);
+static void          __compiler_return_statement__(compiler_t compiler, statement_t stmt);
+static void          __compiler_expression__(compiler_t compiler, expression_t expr, unsigned int dst);
+static void          __compiler_literal__(compiler_t compiler, expression_t expr, unsigned int dst);
+static void          __compiler_get_identifier__(compiler_t compiler, expression_t expr, unsigned int dst);
+static void          __compiler_set_identifier__(compiler_t compiler, expression_t expr, unsigned int src);
+static void          __compiler_lvalue__(compiler_t compiler, expression_t expr, compiler_lvalue_t lvalue);
+static void          __compiler_lvalue_load__(compiler_t compiler, compiler_lvalue_t lvalue, unsigned int dst);
+static void          __compiler_lvalue_store__(compiler_t compiler, compiler_lvalue_t lvalue, unsigned int src);
+static void          __compiler_assign_expression__(compiler_t compiler, expression_t expr, unsigned int dst);
+static void          __compiler_call_expression__(compiler_t compiler, expression_t expr, unsigned int dst);
+static void          __compiler_binary_expression__(compiler_t compiler, expression_t expr, unsigned int dst);
+static void          __compiler_logic_expression__(compiler_t compiler, expression_t expr, unsigned int dst);
+static void          __compiler_table_generate__(compiler_t compiler, expression_t expr, unsigned int dst);
+static void          __compiler_array_pop__(compiler_t compiler, expression_t expr, unsigned int dst);
+static opcode_t      __compiler_binary_opcode__(expression_type_t type);
+static expression_type_t __compiler_assign_operator__(expression_type_t type);
+
+code_t compiler_compile_function(expression_function_t function_expr)
+{
+    struct compiler_s compiler;
+    list_iter_t iter;
+    unsigned int result;
+
+    __compiler_init__(&compiler, function_expr->frame_size, true);
+
+    list_for_each(function_expr->parameters, iter) {
+        compiler.code->parameters++;
+    }
+
+    list_for_each(function_expr->block, iter) {
+        compiler.toplevel = list_element(iter, statement_t, link);
+        __compiler_statement__(&compiler, compiler.toplevel);
+    }
+
+    /* falling off the end returns null */
+    result = __compiler_register__(&compiler);
+    __compiler_emit__(&compiler, 0, 0, OPCODE_LOADNULL, result, 0, 0, 0);
+    __compiler_emit__(&compiler, 0, 0, OPCODE_RETURN, result, 0, 0, 0);
+
+    return __compiler_finish__(&compiler);
+}
+
+code_t compiler_compile_statements(statements_t stmts)
+{
+    struct compiler_s compiler;
+    list_iter_t iter;
+
+    __compiler_init__(&compiler, stmts->frame_size, false);
+
+    list_for_each(stmts->stmts, iter) {
+        compiler.toplevel = list_element(iter, statement_t, link);
+        __compiler_statement__(&compiler, compiler.toplevel);
+    }
+
+    __compiler_emit__(&compiler, 0, 0, OPCODE_END, 0, 0, 0, 0);
+
+    return __compiler_finish__(&compiler);
+}
+
+void code_free(code_t code)
+{
+    array_free(code->instructions);
+    array_free(code->positions);
+    array_free(code->constants);
+    array_free(code->operands);
+    mem_free(code);
+}
+
+static void __compiler_init__(compiler_t compiler, unsigned int frame_size, bool function)
+{
+    code_t code = (code_t) mem_alloc(sizeof(struct code_s));
+
+    code->instructions = array_new(sizeof(struct instruction_s));
+    code->positions    = array_new(sizeof(struct code_position_s));
+    code->constants    = array_new(sizeof(struct value_s));
+    code->operands     = array_new(sizeof(void*));
+    code->parameters   = 0;
+    code->frame_size   = frame_size;
+
+    compiler->code     = code;
+    compiler->function = function;
+    compiler->toplevel = NULL;
+    compiler->top      = frame_size;
+    compiler->scopes   = array_new(sizeof(statement_t));
+    compiler->loop     = NULL;
+}
+
+static code_t __compiler_finish__(compiler_t compiler)
+{
+    assert(array_is_empty(compiler->scopes));
+    assert(compiler->loop == NULL);
+
+    array_free(compiler->scopes);
+
+    return compiler->code;
+}
+
+static unsigned long __compiler_emit__(compiler_t compiler, long line, long column, opcode_t op, unsigned int a, unsigned int b, unsigned int c, unsigned long x)
+{
+    instruction_t ins;
+    code_position_t position;
+
+    ins = (instruction_t) array_push(compiler->code->instructions);
+
+    ins->op = (unsigned short) op;
+    ins->a  = (unsigned short) a;
+    ins->b  = (unsigned short) b;
+    ins->c  = (unsigned short) c;
+    ins->x  = (unsigned int) x;
+
+    position = (code_position_t) array_push(compiler->code->positions);
+
+    position->line   = line;
+    position->column = column;
+
+    return array_length(compiler->code->instructions) - 1;
+}
+
+static unsigned long __compiler_here__(compiler_t compiler)
+{
+    return array_length(compiler->code->instructions);
+}
+
+static void __compiler_patch__(compiler_t compiler, unsigned long pc, unsigned long target)
+{
+    ((instruction_t) array_index(compiler->code->instructions, pc))->x = (unsigned int) target;
+}
+
+static void __compiler_patch_all__(compiler_t compiler, array_t jumps, unsigned long target)
+{
+    unsigned long *pcs;
+    int index;
+
+    array_for_each(jumps, pcs, index) {
+        __compiler_patch__(compiler, pcs[index], target);
+    }
+}
+
+static unsigned int __compiler_register__(compiler_t compiler)
+{
+    if (compiler->top >= COMPILER_MAX_REGISTERS) {
+        runtime_error("%s", "too many registers in one function");
+    }
+
+    compiler->top++;
+
+    if (compiler->top > compiler->code->frame_size) {
+        compiler->code->frame_size = compiler->top;
+    }
+
+    return compiler->top - 1;
+}
+
+static unsigned long __compiler_constant__(compiler_t compiler, value_t value)
+{
+    *(value_t) array_push(compiler->code->constants) = *value;
+
+    return array_length(compiler->code->constants) - 1;
+}
+
+static unsigned long __compiler_operand__(compiler_t compiler, void *operand)
+{
+    *(void**) array_push(compiler->code->operands) = operand;
+
+    return array_length(compiler->code->operands) - 1;
+}
+
+static void __compiler_block__(compiler_t compiler, list_t block)
+{
+    list_iter_t iter;
+
+    list_for_each(block, iter) {
+        __compiler_statement__(compiler, list_element(iter, statement_t, link));
+    }
+}
+
+static void __compiler_statement__(compiler_t compiler, statement_t stmt)
+{
+    unsigned int top = compiler->top;
+
+    switch (stmt->type) {
+    case STATEMENT_TYPE_REQUIRE:
+        __compiler_emit__(compiler, stmt->line, stmt->column, OPCODE_REQUIRE, 0, 0, 0,
+                          __compiler_operand__(compiler, stmt->u.package_name));
+        break;
+
+    case STATEMENT_TYPE_EXPRESSION:
+        __compiler_expression__(compiler, stmt->u.expr, __compiler_register__(compiler));
+        break;
+
+    case STATEMENT_TYPE_IF:
+        __compiler_enter_scope__(compiler, stmt);
+        __compiler_if_statement__(compiler, stmt);
+        __compiler_leave_scope__(compiler, stmt);
+        break;
+
+    case STATEMENT_TYPE_SWITCH:
+        __compiler_enter_scope__(compiler, stmt);
+        __compiler_switch_statement__(compiler, stmt);
+        __compiler_leave_scope__(compiler, stmt);
+        break;
+
+    case STATEMENT_TYPE_WHILE:
+        __compiler_enter_scope__(compiler, stmt);
+        __compiler_while_statement__(compiler, stmt);
+        __compiler_leave_scope__(compiler, stmt);
+        break;
+
+    case STATEMENT_TYPE_FOR:
+        __compiler_enter_scope__(compiler, stmt);
+        __compiler_for_statement__(compiler, stmt);
+        __compiler_leave_scope__(compiler, stmt);
+        break;
+
+    case STATEMENT_TYPE_FOREACH:
+        __compiler_enter_scope__(compiler, stmt);
+        __compiler_foreach_statement__(compiler, stmt);
+        __compiler_leave_scope__(compiler, stmt);
+        break;
+
+    case STATEMENT_TYPE_CONTINUE:
+    case STATEMENT_TYPE_BREAK:
+        __compiler_jump_statement__(compiler, stmt);
+        break;
+
+    case STATEMENT_TYPE_RETURN:
+        __compiler_return_statement__(compiler, stmt);
+        break;
+
+    default:
+        break;
+    }
+
+    compiler->top = top;
+}
+
+static void __compiler_enter_scope__(compiler_t compiler, statement_t stmt)
+{
+    if (stmt->scope_size > 0) {
+        __compiler_emit__(compiler, stmt->line, stmt->column, OPCODE_CLEAR, stmt->scope_offset, stmt->scope_size, 0, 0);
+    }
+
+    *(statement_t*) array_push(compiler->scopes) = stmt;
+}
+
+static void __compiler_leave_scope__(compiler_t compiler, statement_t stmt)
+{
+    array_pop(compiler->scopes);
+
+    if (stmt->scope_size > 0) {
+        __compiler_emit__(compiler, stmt->line, stmt->column, OPCODE_CLOSE, stmt->scope_offset, 0, 0, 0);
+    }
+}
+
+/*
+ * Jumping out of the scopes opened since depth closes them all at once:
+ * an inner scope's slots always follow the outer one's.
+ */
+static void __compiler_close_scopes__(compiler_t compiler, statement_t stmt, unsigned long depth)
+{
+    statement_t *scopes;
+    unsigned long index;
+
+    scopes = array_base(compiler->scopes, statement_t*);
+
+    for (index = depth; index < array_length(compiler->scopes); index++) {
+        if (scopes[index]->scope_size > 0) {
+            __compiler_emit__(compiler, stmt->line, stmt->column, OPCODE_CLOSE, scopes[index]->scope_offset, 0, 0, 0);
+            return;
+        }
+    }
+}
+
+static void __compiler_enter_loop__(compiler_t compiler, compiler_loop_t loop)
+{
+    loop->parent    = compiler->loop;
+    loop->depth     = array_length(compiler->scopes);
+    loop->breaks    = array_new(sizeof(unsigned long));
+    loop->continues = array_new(sizeof(unsigned long));
+
+    compiler->loop = loop;
+}
+
+static void __compiler_leave_loop__(compiler_t compiler, unsigned long continue_target, unsigned long break_target)
+{
+    compiler_loop_t loop = compiler->loop;
+
+    __compiler_patch_all__(compiler, loop->continues, continue_target);
+    __compiler_patch_all__(compiler, loop->breaks, break_target);
+
+    array_free(loop->breaks);
+    array_free(loop->continues);
+
+    compiler->loop = loop->parent;
+}
+
+static void __compiler_if_statement__(compiler_t compiler, statement_t stmt)
+{
+    statement_if_t stmt_if;
+    statement_elif_t stmt_elif;
+    list_iter_t iter;
+    unsigned int condition;
+    unsigned long next;
+    array_t ends;
+
+    stmt_if = stmt->u.if_stmt;
+    ends    = array_new(sizeof(unsigned long));
+
+    condition = __compiler_register__(compiler);
+
+    __compiler_expression__(compiler, stmt_if->condition, condition);
+    next = __compiler_emit__(compiler, stmt->line, stmt->column, OPCODE_JUMPIFNOT, condition, 0, 0, 0);
+
+    __compiler_block__(compiler, stmt_if->if_block);
+    *(unsigned long*) array_push(ends) = __compiler_emit__(compiler, stmt->line, stmt->column, OPCODE_JUMP, 0, 0, 0, 0);
+
+    list_for_each(stmt_if->elifs, iter) {
+        stmt_elif = list_element(iter, statement_elif_t, link);
+
+        __compiler_patch__(compiler, next, __compiler_here__(compiler));
+
+        __compiler_expression__(compiler, stmt_elif->condition, condition);
+        next = __compiler_emit__(compiler, stmt->line, stmt->column, OPCODE_JUMPIFNOT, condition, 0, 0, 0);
+
+        __compiler_block__(compiler, stmt_elif->block);
+        *(unsigned long*) array_push(ends) = __compiler_emit__(compiler, stmt->line, stmt->column, OPCODE_JUMP, 0, 0, 0, 0);
+    }
+
+    __compiler_patch__(compiler, next, __compiler_here__(compiler));
+
+    __compiler_block__(compiler, stmt_if->else_block);
+
+    __compiler_patch_all__(compiler, ends, __compiler_here__(compiler));
+
+    array_free(ends);
+}
+
+static void __compiler_switch_statement__(compiler_t compiler, statement_t stmt)
+{
+    statement_switch_t stmt_switch;
+    statement_switch_case_t stmt_case;
+    list_iter_t iter;
+    unsigned int value, compare;
+    unsigned long *matches;
+    unsigned long index;
+    array_t jumps, ends;
+
+    stmt_switch = stmt->u.switch_stmt;
+    jumps       = array_new(sizeof(unsigned long));
+    ends        = array_new(sizeof(unsigned long));
+
+    value   = __compiler_register__(compiler);
+    compare = __compiler_register__(compiler);
+
+    __compiler_expression__(compiler, stmt_switch->expr, value);
+
+    /* cases are compared in order until one matches */
+    list_for_each(stmt_switch->cases, iter) {
+        stmt_case = list_element(iter, statement_switch_case_t, link);
+
+        __compiler_expression__(compiler, stmt_case->case_expr, compare);
+        __compiler_emit__(compiler, stmt->line, stmt->column, OPCODE_EQ, compare, value, compare, 0);
+        *(unsigned long*) array_push(jumps) = __compiler_emit__(compiler, stmt->line, stmt->column, OPCODE_JUMPIF, compare, 0, 0, 0);
+    }
+
+    __compiler_block__(compiler, stmt_switch->default_block);
+    *(unsigned long*) array_push(ends) = __compiler_emit__(compiler, stmt->line, stmt->column, OPCODE_JUMP, 0, 0, 0, 0);
+
+    matches = array_base(jumps, unsigned long*);
+    index   = 0;
+
+    list_for_each(stmt_switch->cases, iter) {
+        stmt_case = list_element(iter, statement_switch_case_t, link);
+
+        __compiler_patch__(compiler, matches[index++], __compiler_here__(compiler));
+
+        __compiler_block__(compiler, stmt_case->block);
+        *(unsigned long*) array_push(ends) = __compiler_emit__(compiler, stmt->line, stmt->column, OPCODE_JUMP, 0, 0, 0, 0);
+    }
+
+    __compiler_patch_all__(compiler, ends, __compiler_here__(compiler));
+
+    array_free(jumps);
+    array_free(ends);
+}
+
+static void __compiler_while_statement__(compiler_t compiler, statement_t stmt)
+{
+    struct compiler_loop_s loop;
+    unsigned int condition;
+    unsigned long start, done;
+
+    condition = __compiler_register__(compiler);
+
+    __compiler_enter_loop__(compiler, &loop);
+
+    start = __compiler_here__(compiler);
+
+    __compiler_expression__(compiler, stmt->u.while_stmt->condition, condition);
+    done = __compiler_emit__(compiler, stmt->line, stmt->column, OPCODE_JUMPIFNOT, condition, 0, 0, 0);
+
+    __compiler_block__(compiler, stmt->u.while_stmt->block);
+    __compiler_emit__(compiler, stmt->line, stmt->column, OPCODE_JUMP, 0, 0, 0, start);
+
+    __compiler_patch__(compiler, done, __compiler_here__(compiler));
+
+    __compiler_leave_loop__(compiler, start, __compiler_here__(compiler));
+}
+
+static void __compiler_for_statement__(compiler_t compiler, statement_t stmt)
+{
+    struct compiler_loop_s loop;
+    statement_for_t stmt_for;
+    unsigned int temp;
+    unsigned long start, post, done = 0;
+
+    stmt_for = stmt->u.for_stmt;
+
+    temp = __compiler_register__(compiler);
+
+    if (stmt_for->init) {
+        __compiler_expression__(compiler, stmt_for->init, temp);
+    }
+
+    __compiler_enter_loop__(compiler, &loop);
+
+    start = __compiler_here__(compiler);
+
+    if (stmt_for->condition) {
+        __compiler_expression__(compiler, stmt_for->condition, temp);
+        done = __compiler_emit__(compiler, stmt->line, stmt->column, OPCODE_JUMPIFNOT, temp, 0, 0, 0);
+    }
+
+    __compiler_block__(compiler, stmt_for->block);
+
+    post = __compiler_here__(compiler);
+
+    if (stmt_for->post) {
+        __compiler_expression__(compiler, stmt_for->post, temp);
+    }
+
+    __compiler_emit__(compiler, stmt->line, stmt->column, OPCODE_JUMP, 0, 0, 0, start);
+
+    if (stmt_for->condition) {
+        __compiler_patch__(compiler, done, __compiler_here__(compiler));
+    }
+
+    __compiler_leave_loop__(compiler, post, __compiler_here__(compiler));
+}
+
+static void __compiler_foreach_statement__(compiler_t compiler, statement_t stmt)
+{
+    struct compiler_loop_s loop;
+    struct compiler_lvalue_s key, value;
+    statement_foreach_t stmt_foreach;
+    unsigned int at, pair;
+    unsigned long next, done;
+
+    stmt_foreach = stmt->u.foreach_stmt;
+
+    /* containers of the lvalues are evaluated once, before the collection */
+    __compiler_lvalue__(compiler, stmt_foreach->key, &key);
+    __compiler_lvalue__(compiler, stmt_foreach->value, &value);
+
+    at = __compiler_register__(compiler);
+
+    __compiler_expression__(compiler, stmt_foreach->at, at);
+    __compiler_emit__(compiler, stmt->line, stmt->column, OPCODE_FOREACH, at, 0, 0, 0);
+
+    pair = __compiler_register__(compiler);
+    __compiler_register__(compiler);
+
+    __compiler_enter_loop__(compiler, &loop);
+
+    next = __compiler_emit__(compiler, stmt->line, stmt->column, OPCODE_NEXT, pair, 0, 0, 0);
+
+    __compiler_lvalue_store__(compiler, &key, pair);
+    __compiler_lvalue_store__(compiler, &value, pair + 1);
+
+    __compiler_block__(compiler, stmt_foreach->block);
+    __compiler_emit__(compiler, stmt->line, stmt->column, OPCODE_JUMP, 0, 0, 0, next);
+
+    done = __compiler_here__(compiler);
+
+    __compiler_patch__(compiler, next, done);
+
+    __compiler_emit__(compiler, stmt->line, stmt->column, OPCODE_ENDFOREACH, 0, 0, 0, 0);
+
+    __compiler_leave_loop__(compiler, next, done);
+}
+
+static void __compiler_jump_statement__(compiler_t compiler, statement_t stmt)
+{
+    const char *message;
+    unsigned long pc;
+
+    if (!compiler->loop) {
+        if (stmt->type == STATEMENT_TYPE_CONTINUE && !compiler->function) {
+            message = "continue outside loop";
+        } else {
+            message = "break outside loop";
+        }
+
+        __compiler_emit__(compiler, compiler->toplevel->line, compiler->toplevel->column, OPCODE_RAISE, 0, 0, 0,
+                          __compiler_operand__(compiler, (void*) message));
+        return;
+    }
+
+    __compiler_close_scopes__(compiler, stmt, compiler->loop->depth);
+
+    pc = __compiler_emit__(compiler, stmt->line, stmt->column, OPCODE_JUMP, 0, 0, 0, 0);
+
+    if (stmt->type == STATEMENT_TYPE_BREAK) {
+        *(unsigned long*) array_push(compiler->loop->breaks) = pc;
+    } else {
+        *(unsigned long*) array_push(compiler->loop->continues) = pc;
+    }
+}
+
+static void __compiler_return_statement__(compiler_t compiler, statement_t stmt)
+{
+    unsigned int result;
+
+    result = __compiler_register__(compiler);
+
+    if (stmt->u.return_expr) {
+        __compiler_expression__(compiler, stmt->u.return_expr, result);
+    } else {
+        __compiler_emit__(compiler, stmt->line, stmt->column, OPCODE_LOADNULL, result, 0, 0, 0);
+    }
+
+    if (!compiler->function) {
+        __compiler_emit__(compiler, compiler->toplevel->line, compiler->toplevel->column, OPCODE_RAISE, 0, 0, 0,
+                          __compiler_operand__(compiler, (void*) "return outside function"));
+        return;
+    }
+
+    __compiler_emit__(compiler, stmt->line, stmt->column, OPCODE_RETURN, result, 0, 0, 0);
+}
+
+static void __compiler_expression__(compiler_t compiler, expression_t expr, unsigned int dst)
+{
+    unsigned int top = compiler->top;
+    unsigned int temp;
+    struct compiler_lvalue_s lvalue;
+    list_iter_t iter;
+
+    assert(dst < compiler->top);
+
+    switch (expr->type) {
+    case EXPRESSION_TYPE_CHAR:
+    case EXPRESSION_TYPE_BOOL:
+    case EXPRESSION_TYPE_INT:
+    case EXPRESSION_TYPE_LONG:
+    case EXPRESSION_TYPE_FLOAT:
+    case EXPRESSION_TYPE_DOUBLE:
+        __compiler_literal__(compiler, expr, dst);
+        break;
+
+    case EXPRESSION_TYPE_STRING:
+        __compiler_emit__(compiler, expr->line, expr->column, OPCODE_LOADSTRING, dst, 0, 0,
+                          __compiler_operand__(compiler, expr->u.string_expr));
+        break;
+
+    case EXPRESSION_TYPE_NULL:
+        __compiler_emit__(compiler, expr->line, expr->column, OPCODE_LOADNULL, dst, 0, 0, 0);
+        break;
+
+    case EXPRESSION_TYPE_FUNCTION:
+        __compiler_emit__(compiler, expr->line, expr->column, OPCODE_CLOSURE, dst, 0, 0,
+                          __compiler_operand__(compiler, expr->u.function_expr));
+        break;
+
+    case EXPRESSION_TYPE_IDENTIFIER:
+        __compiler_get_identifier__(compiler, expr, dst);
+        break;
+
+    case EXPRESSION_TYPE_ASSIGN:
+    case EXPRESSION_TYPE_ADD_ASSIGN:
+    case EXPRESSION_TYPE_SUB_ASSIGN:
+    case EXPRESSION_TYPE_MUL_ASSIGN:
+    case EXPRESSION_TYPE_DIV_ASSIGN:
+    case EXPRESSION_TYPE_MOD_ASSIGN:
+    case EXPRESSION_TYPE_BITAND_ASSIGN:
+    case EXPRESSION_TYPE_BITOR_ASSIGN:
+    case EXPRESSION_TYPE_XOR_ASSIGN:
+    case EXPRESSION_TYPE_LEFT_SHIFT_ASSIGN:
+    case EXPRESSION_TYPE_RIGHT_SHIFT_ASSIGN:
+    case EXPRESSION_TYPE_LOGIC_RIGHT_SHIFT_ASSIGN:
+        __compiler_assign_expression__(compiler, expr, dst);
+        break;
+
+    case EXPRESSION_TYPE_CALL:
+        __compiler_call_expression__(compiler, expr, dst);
+        break;
+
+    case EXPRESSION_TYPE_CPL:
+    case EXPRESSION_TYPE_NOT:
+    case EXPRESSION_TYPE_PLUS:
+    case EXPRESSION_TYPE_MINUS:
+        __compiler_expression__(compiler, expr->u.unary_expr, dst);
+        __compiler_emit__(compiler, expr->line, expr->column, OPCODE_UNARY, dst, 0, expr->type, 0);
+        break;
+
+    case EXPRESSION_TYPE_INC:
+    case EXPRESSION_TYPE_DEC:
+        __compiler_lvalue__(compiler, expr->u.unary_expr, &lvalue);
+        __compiler_lvalue_load__(compiler, &lvalue, dst);
+        __compiler_emit__(compiler, expr->line, expr->column, OPCODE_INCDEC, dst, 0, expr->type, 0);
+        __compiler_lvalue_store__(compiler, &lvalue, dst);
+        break;
+
+    case EXPRESSION_TYPE_BITAND:
+    case EXPRESSION_TYPE_BITOR:
+    case EXPRESSION_TYPE_XOR:
+    case EXPRESSION_TYPE_LEFT_SHIFT:
+    case EXPRESSION_TYPE_RIGHT_SHIFT:
+    case EXPRESSION_TYPE_LOGIC_RIGHT_SHIFT:
+    case EXPRESSION_TYPE_MUL:
+    case EXPRESSION_TYPE_DIV:
+    case EXPRESSION_TYPE_MOD:
+    case EXPRESSION_TYPE_ADD:
+    case EXPRESSION_TYPE_SUB:
+    case EXPRESSION_TYPE_GT:
+    case EXPRESSION_TYPE_GEQ:
+    case EXPRESSION_TYPE_LT:
+    case EXPRESSION_TYPE_LEQ:
+    case EXPRESSION_TYPE_EQ:
+    case EXPRESSION_TYPE_NEQ:
+        __compiler_binary_expression__(compiler, expr, dst);
+        break;
+
+    case EXPRESSION_TYPE_AND:
+    case EXPRESSION_TYPE_OR:
+        __compiler_logic_expression__(compiler, expr, dst);
+        break;
+
+    case EXPRESSION_TYPE_ARRAY_GENERATE:
+        __compiler_emit__(compiler, expr->line, expr->column, OPCODE_NEWARRAY, dst, 0, 0, 0);
+
+        temp = __compiler_register__(compiler);
+
+        list_for_each(expr->u.array_generate_expr, iter) {
+            __compiler_expression__(compiler, list_element(iter, expression_t, link), temp);
+            __compiler_emit__(compiler, expr->line, expr->column, OPCODE_APPEND, dst, temp, 0, 0);
+        }
+        break;
+
+    case EXPRESSION_TYPE_TABLE_GENERATE:
+        __compiler_table_generate__(compiler, expr, dst);
+        break;
+
+    case EXPRESSION_TYPE_ARRAY_PUSH:
+        __compiler_expression__(compiler, expr->u.array_push_expr->array_expr, dst);
+
+        temp = __compiler_register__(compiler);
+
+        __compiler_expression__(compiler, expr->u.array_push_expr->elem_expr, temp);
+        __compiler_emit__(compiler, expr->line, expr->column, OPCODE_ARRAYPUSH, dst, temp, 0, 0);
+        break;
+
+    case EXPRESSION_TYPE_ARRAY_POP:
+        __compiler_array_pop__(compiler, expr, dst);
+        break;
+
+    case EXPRESSION_TYPE_TABLE_DOT_MEMBER:
+        __compiler_expression__(compiler, expr->u.table_dot_member_expr->table_expr, dst);
+        __compiler_emit__(compiler, expr->line, expr->column, OPCODE_GETMEMBER, dst, dst, 0,
+                          __compiler_operand__(compiler, expr->u.table_dot_member_expr->member_name));
+        break;
+
+    case EXPRESSION_TYPE_INDEX:
+        __compiler_expression__(compiler, expr->u.index_expr->dict, dst);
+
+        temp = __compiler_register__(compiler);
+
+        __compiler_expression__(compiler, expr->u.index_expr->index, temp);
+        __compiler_emit__(compiler, expr->line, expr->column, OPCODE_GETINDEX, dst, dst, temp, 0);
+        break;
+
+    default:
+        assert(false);
+    }
+
+    compiler->top = top;
+}
+
+static void __compiler_literal__(compiler_t compiler, expression_t expr, unsigned int dst)
+{
+    struct value_s value;
+
+    switch (expr->type) {
+    case EXPRESSION_TYPE_CHAR:
+        value.type         = VALUE_TYPE_CHAR;
+        value.u.char_value = expr->u.char_expr;
+        break;
+
+    case EXPRESSION_TYPE_BOOL:
+        value.type         = VALUE_TYPE_BOOL;
+        value.u.bool_value = expr->u.bool_expr;
+        break;
+
+    case EXPRESSION_TYPE_INT:
+        value.type        = VALUE_TYPE_INT;
+        value.u.int_value = expr->u.int_expr;
+        break;
+
+    case EXPRESSION_TYPE_LONG:
+        value.type         = VALUE_TYPE_LONG;
+        value.u.long_value = expr->u.long_expr;
+        break;
+
+    case EXPRESSION_TYPE_FLOAT:
+        value.type          = VALUE_TYPE_FLOAT;
+        value.u.float_value = expr->u.float_expr;
+        break;
+
+    case EXPRESSION_TYPE_DOUBLE:
+        value.type           = VALUE_TYPE_DOUBLE;
+        value.u.double_value = expr->u.double_expr;
+        break;
+
+    default:
+        assert(false);
+        return;
+    }
+
+    __compiler_emit__(compiler, expr->line, expr->column, OPCODE_LOADK, dst, 0, 0,
+                      __compiler_constant__(compiler, &value));
+}
+
+/*
+ * A name with a single candidate slot in the running frame gets an
+ * instruction that reads the slot directly; anything else goes through
+ * the evaluator's lookup.
+ */
+static void __compiler_get_identifier__(compiler_t compiler, expression_t expr, unsigned int dst)
+{
+    expression_identifier_t identifier = expr->u.identifier_expr;
+    expression_slot_t slots = array_base(identifier->slots, expression_slot_t);
+
+    if (array_length(identifier->slots) == 1 && !slots[0].upvalue) {
+        __compiler_emit__(compiler, expr->line, expr->column, OPCODE_GETLOCAL, dst, slots[0].index, 0,
+                          __compiler_operand__(compiler, identifier));
+    } else {
+        __compiler_emit__(compiler, expr->line, expr->column, OPCODE_GETVAR, dst, 0, 0,
+                          __compiler_operand__(compiler, identifier));
+    }
+}
+
+static void __compiler_set_identifier__(compiler_t compiler, expression_t expr, unsigned int src)
+{
+    expression_identifier_t identifier = expr->u.identifier_expr;
+    expression_slot_t slots = array_base(identifier->slots, expression_slot_t);
+
+    if (array_length(identifier->slots) == 1 && !slots[0].upvalue) {
+        __compiler_emit__(compiler, expr->line, expr->column, OPCODE_SETLOCAL, src, slots[0].index, 0,
+                          __compiler_operand__(compiler, identifier));
+    } else {
+        __compiler_emit__(compiler, expr->line, expr->column, OPCODE_SETVAR, src, 0, 0,
+                          __compiler_operand__(compiler, identifier));
+    }
+}
+
+static void __compiler_lvalue__(compiler_t compiler, expression_t expr, compiler_lvalue_t lvalue)
+{
+    lvalue->expr  = expr;
+    lvalue->dict  = 0;
+    lvalue->index = 0;
+
+    switch (expr->type) {
+    case EXPRESSION_TYPE_IDENTIFIER:
+        break;
+
+    case EXPRESSION_TYPE_INDEX:
+        lvalue->dict  = __compiler_register__(compiler);
+        lvalue->index = __compiler_register__(compiler);
+
+        __compiler_expression__(compiler, expr->u.index_expr->dict, lvalue->dict);
+        __compiler_expression__(compiler, expr->u.index_expr->index, lvalue->index);
+        break;
+
+    case EXPRESSION_TYPE_TABLE_DOT_MEMBER:
+        lvalue->dict = __compiler_register__(compiler);
+
+        __compiler_expression__(compiler, expr->u.table_dot_member_expr->table_expr, lvalue->dict);
+        break;
+
+    default:
+        assert(false);
+    }
+}
+
+static void __compiler_lvalue_load__(compiler_t compiler, compiler_lvalue_t lvalue, unsigned int dst)
+{
+    expression_t expr = lvalue->expr;
+
+    switch (expr->type) {
+    case EXPRESSION_TYPE_IDENTIFIER:
+        __compiler_get_identifier__(compiler, expr, dst);
+        break;
+
+    case EXPRESSION_TYPE_INDEX:
+        __compiler_emit__(compiler, expr->line, expr->column, OPCODE_GETINDEX, dst, lvalue->dict, lvalue->index, 0);
+        break;
+
+    case EXPRESSION_TYPE_TABLE_DOT_MEMBER:
+        __compiler_emit__(compiler, expr->line, expr->column, OPCODE_GETMEMBER, dst, lvalue->dict, 0,
+                          __compiler_operand__(compiler, expr->u.table_dot_member_expr->member_name));
+        break;
+
+    default:
+        assert(false);
+    }
+}
+
+static void __compiler_lvalue_store__(compiler_t compiler, compiler_lvalue_t lvalue, unsigned int src)
+{
+    expression_t expr = lvalue->expr;
+
+    switch (expr->type) {
+    case EXPRESSION_TYPE_IDENTIFIER:
+        __compiler_set_identifier__(compiler, expr, src);
+        break;
+
+    case EXPRESSION_TYPE_INDEX:
+        __compiler_emit__(compiler, expr->line, expr->column, OPCODE_SETINDEX, src, lvalue->dict, lvalue->index, 0);
+        break;
+
+    case EXPRESSION_TYPE_TABLE_DOT_MEMBER:
+        __compiler_emit__(compiler, expr->line, expr->column, OPCODE_SETMEMBER, src, lvalue->dict, 0,
+                          __compiler_operand__(compiler, expr->u.table_dot_member_expr->member_name));
+        break;
+
+    default:
+        assert(false);
+    }
+}
+
+static void __compiler_assign_expression__(compiler_t compiler, expression_t expr, unsigned int dst)
+{
+    struct compiler_lvalue_s lvalue;
+    expression_t lvalue_expr;
+    unsigned int rvalue;
+
+    lvalue_expr = expr->u.assign_expr->lvalue_expr;
+
+    /* the right side is evaluated before the lvalue, as in the evaluator */
+    if (expr->type == EXPRESSION_TYPE_ASSIGN) {
+        __compiler_expression__(compiler, expr->u.assign_expr->rvalue_expr, dst);
+        __compiler_lvalue__(compiler, lvalue_expr, &lvalue);
+        __compiler_lvalue_store__(compiler, &lvalue, dst);
+        return;
+    }
+
+    rvalue = __compiler_register__(compiler);
+
+    __compiler_expression__(compiler, expr->u.assign_expr->rvalue_expr, rvalue);
+    __compiler_lvalue__(compiler, lvalue_expr, &lvalue);
+    __compiler_lvalue_load__(compiler, &lvalue, dst);
+
+    __compiler_emit__(compiler, lvalue_expr->line, lvalue_expr->column, OPCODE_BINARY, dst, dst, rvalue,
+                      __compiler_assign_operator__(expr->type));
+
+    __compiler_lvalue_store__(compiler, &lvalue, dst);
+}
+
+static void __compiler_call_expression__(compiler_t compiler, expression_t expr, unsigned int dst)
+{
+    list_iter_t iter;
+    unsigned int function;
+    unsigned int argc = 0;
+
+    function = __compiler_register__(compiler);
+
+    __compiler_expression__(compiler, expr->u.call_expr->function_expr, function);
+
+    /* arguments go in the registers following the callee */
+    list_for_each(expr->u.call_expr->args, iter) {
+        __compiler_expression__(compiler, list_element(iter, expression_t, link), __compiler_register__(compiler));
+        argc++;
+    }
+
+    __compiler_emit__(compiler, expr->u.call_expr->function_expr->line, expr->u.call_expr->function_expr->column,
+                      OPCODE_CALL, dst, function, argc, 0);
+}
+
+static void __compiler_binary_expression__(compiler_t compiler, expression_t expr, unsigned int dst)
+{
+    expression_t left = expr->u.binary_expr->left;
+    unsigned int right;
+
+    __compiler_expression__(compiler, left, dst);
+
+    right = __compiler_register__(compiler);
+
+    __compiler_expression__(compiler, expr->u.binary_expr->right, right);
+
+    __compiler_emit__(compiler, left->line, left->column, __compiler_binary_opcode__(expr->type), dst, dst, right, expr->type);
+}
+
+static void __compiler_logic_expression__(compiler_t compiler, expression_t expr, unsigned int dst)
+{
+    expression_t left = expr->u.binary_expr->left;
+    unsigned long end;
+
+    __compiler_expression__(compiler, left, dst);
+    __compiler_emit__(compiler, left->line, left->column, OPCODE_TESTLEFT, dst, 0, expr->type, 0);
+
+    /* a decided left side is the result */
+    end = __compiler_emit__(compiler, left->line, left->column,
+                            expr->type == EXPRESSION_TYPE_AND ? OPCODE_JUMPIFNOT : OPCODE_JUMPIF, dst, 0, 0, 0);
+
+    __compiler_expression__(compiler, expr->u.binary_expr->right, dst);
+    __compiler_emit__(compiler, left->line, left->column, OPCODE_TESTRIGHT, dst, 0, expr->type, 0);
+
+    __compiler_patch__(compiler, end, __compiler_here__(compiler));
+}
+
+static void __compiler_table_generate__(compiler_t compiler, expression_t expr, unsigned int dst)
+{
+    expression_table_pair_t pair;
+    list_iter_t iter;
+    unsigned int key, value;
+
+    __compiler_emit__(compiler, expr->line, expr->column, OPCODE_NEWTABLE, dst, 0, 0, 0);
+
+    key   = __compiler_register__(compiler);
+    value = __compiler_register__(compiler);
+
+    list_for_each(expr->u.table_generate_expr, iter) {
+        pair = list_element(iter, expression_table_pair_t, link);
+
+        __compiler_expression__(compiler, pair->member_name, key);
+
+        /* an unbound identifier names its member */
+        if (pair->member_name->type == EXPRESSION_TYPE_IDENTIFIER) {
+            __compiler_emit__(compiler, pair->member_name->line, pair->member_name->column, OPCODE_TABLEKEY, key, 0, 0,
+                              __compiler_operand__(compiler, pair->member_name->u.identifier_expr->symbol));
+        }
+
+        __compiler_expression__(compiler, pair->member_expr, value);
+        __compiler_emit__(compiler, expr->line, expr->column, OPCODE_TABLESET, dst, key, value, 0);
+    }
+}
+
+static void __compiler_array_pop__(compiler_t compiler, expression_t expr, unsigned int dst)
+{
+    struct compiler_lvalue_s lvalue;
+    unsigned int array;
+    unsigned long empty;
+
+    array = __compiler_register__(compiler);
+
+    __compiler_expression__(compiler, expr->u.array_pop_expr->array_expr, array);
+
+    /* popping an empty array yields null and leaves the lvalue alone */
+    empty = __compiler_emit__(compiler, expr->line, expr->column, OPCODE_ARRAYPOP, dst, array, 0, 0);
+
+    __compiler_lvalue__(compiler, expr->u.array_pop_expr->lvalue_expr, &lvalue);
+    __compiler_lvalue_store__(compiler, &lvalue, dst);
+
+    __compiler_patch__(compiler, empty, __compiler_here__(compiler));
+}
+
+static opcode_t __compiler_binary_opcode__(expression_type_t type)
+{
+    switch (type) {
+    case EXPRESSION_TYPE_ADD:
+        return OPCODE_ADD;
+    case EXPRESSION_TYPE_SUB:
+        return OPCODE_SUB;
+    case EXPRESSION_TYPE_MUL:
+        return OPCODE_MUL;
+    case EXPRESSION_TYPE_DIV:
+        return OPCODE_DIV;
+    case EXPRESSION_TYPE_MOD:
+        return OPCODE_MOD;
+    case EXPRESSION_TYPE_LT:
+        return OPCODE_LT;
+    case EXPRESSION_TYPE_LEQ:
+        return OPCODE_LEQ;
+    case EXPRESSION_TYPE_GT:
+        return OPCODE_GT;
+    case EXPRESSION_TYPE_GEQ:
+        return OPCODE_GEQ;
+    case EXPRESSION_TYPE_EQ:
+        return OPCODE_EQ;
+    case EXPRESSION_TYPE_NEQ:
+        return OPCODE_NEQ;
+    default:
+        return OPCODE_BINARY;
+    }
+}
+
+static expression_type_t __compiler_assign_operator__(expression_type_t type)
+{
+    switch (type) {
+    case EXPRESSION_TYPE_ADD_ASSIGN:
+        return EXPRESSION_TYPE_ADD;
+    case EXPRESSION_TYPE_SUB_ASSIGN:
+        return EXPRESSION_TYPE_SUB;
+    case EXPRESSION_TYPE_MUL_ASSIGN:
+        return EXPRESSION_TYPE_MUL;
+    case EXPRESSION_TYPE_DIV_ASSIGN:
+        return EXPRESSION_TYPE_DIV;
+    case EXPRESSION_TYPE_MOD_ASSIGN:
+        return EXPRESSION_TYPE_MOD;
+    case EXPRESSION_TYPE_BITAND_ASSIGN:
+        return EXPRESSION_TYPE_BITAND;
+    case EXPRESSION_TYPE_BITOR_ASSIGN:
+        return EXPRESSION_TYPE_BITOR;
+    case EXPRESSION_TYPE_XOR_ASSIGN:
+        return EXPRESSION_TYPE_XOR;
+    case EXPRESSION_TYPE_LEFT_SHIFT_ASSIGN:
+        return EXPRESSION_TYPE_LEFT_SHIFT;
+    case EXPRESSION_TYPE_RIGHT_SHIFT_ASSIGN:
+    case EXPRESSION_TYPE_LOGIC_RIGHT_SHIFT_ASSIGN:
+        /* same mapping as the evaluator */
+        return EXPRESSION_TYPE_RIGHT_SHIFT;
+    default:
+        assert(false);
+        return EXPRESSION_TYPE_ADD;
+    }
+}
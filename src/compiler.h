@@ -0,0 +1,109 @@
+
+
+#ifndef _ULCER_COMPILER_H_
+#define _ULCER_COMPILER_H_
+
+#include "config.h"
+#include "array.h"
+#include "expression.h"
+#include "module.h"
+
+typedef enum opcode_e               opcode_t;
+typedef struct instruction_s*       instruction_t;
+typedef struct code_position_s*     code_position_t;
+typedef struct code_s*              code_t;
+
+/*
+ * Registers are slots of the running frame. The resolver's locals come
+ * first, the compiler's temporaries follow them. In the comments below
+ * R(a) is register a, K(x) constant x and P(x) the operand x.
+ */
+enum opcode_e {
+    OPCODE_LOADNULL,        /* R(a) = null */
+    OPCODE_LOADK,           /* R(a) = K(x) */
+    OPCODE_LOADSTRING,      /* R(a) = constant string of symbol P(x) */
+    OPCODE_CLOSURE,         /* R(a) = closure of function P(x) */
+    OPCODE_MOVE,            /* R(a) = R(b) */
+
+    OPCODE_GETLOCAL,        /* R(a) = local b, or the global P(x) if unbound */
+    OPCODE_SETLOCAL,        /* local b = R(a), binding identifier P(x) if unbound */
+    OPCODE_GETVAR,          /* R(a) = identifier P(x) */
+    OPCODE_SETVAR,          /* identifier P(x) = R(a) */
+    OPCODE_GETINDEX,        /* R(a) = R(b)[R(c)] */
+    OPCODE_SETINDEX,        /* R(b)[R(c)] = R(a) */
+    OPCODE_GETMEMBER,       /* R(a) = R(b).P(x) */
+    OPCODE_SETMEMBER,       /* R(b).P(x) = R(a) */
+
+    OPCODE_NEWARRAY,        /* R(a) = [] */
+    OPCODE_APPEND,          /* R(a) append R(b) */
+    OPCODE_NEWTABLE,        /* R(a) = {} */
+    OPCODE_TABLEKEY,        /* R(a) = name P(x) if R(a) is null */
+    OPCODE_TABLESET,        /* R(a)[R(b)] = R(c) */
+    OPCODE_ARRAYPUSH,       /* R(a) <- R(b) */
+    OPCODE_ARRAYPOP,        /* R(a) = pop R(b), goto x if empty */
+
+    OPCODE_UNARY,           /* R(a) = op(c) R(a) */
+    OPCODE_INCDEC,          /* R(a) = R(a) inc/dec(c) */
+    OPCODE_ADD,             /* R(a) = R(b) + R(c) */
+    OPCODE_SUB,
+    OPCODE_MUL,
+    OPCODE_DIV,
+    OPCODE_MOD,
+    OPCODE_LT,
+    OPCODE_LEQ,
+    OPCODE_GT,
+    OPCODE_GEQ,
+    OPCODE_EQ,
+    OPCODE_NEQ,
+    OPCODE_BINARY,          /* R(a) = R(b) op(x) R(c) */
+    OPCODE_TESTLEFT,        /* R(a) must be bool, left of op(c) */
+    OPCODE_TESTRIGHT,       /* R(a) must be bool, right of op(c) */
+
+    OPCODE_JUMP,            /* goto x */
+    OPCODE_JUMPIF,          /* if R(a) goto x */
+    OPCODE_JUMPIFNOT,       /* if !R(a) goto x */
+    OPCODE_CALL,            /* R(a) = R(b)(R(b+1) ... R(b+c)) */
+    OPCODE_RETURN,          /* return R(a) */
+    OPCODE_END,             /* end of a module chunk */
+
+    OPCODE_CLEAR,           /* unbind locals a to a+b */
+    OPCODE_CLOSE,           /* close upvalues from local a */
+    OPCODE_FOREACH,         /* start iterating R(a) */
+    OPCODE_NEXT,            /* R(a), R(a+1) = next key, value, goto x when done */
+    OPCODE_ENDFOREACH,      /* stop the innermost iteration */
+
+    OPCODE_REQUIRE,         /* require package P(x) */
+    OPCODE_RAISE,           /* runtime error P(x) */
+};
+
+struct instruction_s {
+    unsigned short op;
+    unsigned short a;
+    unsigned short b;
+    unsigned short c;
+    unsigned int   x;           /* jump target, constant or operand */
+};
+
+struct code_position_s {
+    long line;
+    long column;
+};
+
+/*
+ * The bytecode of a function body or module chunk. Runtime errors report
+ * the position recorded for the failing instruction.
+ */
+struct code_s {
+    array_t      instructions;  /* struct instruction_s */
+    array_t      positions;     /* struct code_position_s, one per instruction */
+    array_t      constants;     /* struct value_s, literals without objects */
+    array_t      operands;      /* void*, names and nodes the code refers to */
+    unsigned int parameters;
+    unsigned int frame_size;    /* locals and temporaries */
+};
+
+code_t compiler_compile_function(expression_function_t function_expr);
+code_t compiler_compile_statements(statements_t stmts);
+void   code_free(code_t code);
+
+#endif
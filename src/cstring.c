@@ -2,13 +2,19 @@
 
 #include "cstring.h"
 #include "alloc.h"
+#include "hashfn.h"
 
 #include <string.h>
 #include <ctype.h>
 
+/*
+ * hash is worked out the first time it is asked for, and 0 until then;
+ * every function that changes the bytes sets it back to 0.
+ */
 struct cstring_hdr_s {
     unsigned int length;
     unsigned int free;
+    unsigned int hash;
     char buffer[1];
 };
 
@@ -38,6 +44,7 @@ cstring_t cstring_newlen(const void *data, unsigned long len)
 
     hdr->length = len;
     hdr->free   = 0;
+    hdr->hash   = 0;
 
     if (data && len) {
         memcpy(hdr->buffer, data, len);
@@ -59,6 +66,7 @@ cstring_t cstring_newempty(unsigned long len)
 
     hdr->length = 0;
     hdr->free = len;
+    hdr->hash = 0;
     hdr->buffer[len] = '\0';
 
     return hdr->buffer;
@@ -104,6 +112,7 @@ void cstring_update_length(cstring_t cstr)
     unsigned long reallen = (unsigned long) strlen(cstr);
     hdr->free += (hdr->length - reallen);
     hdr->length = reallen;
+    hdr->hash = 0;
 }
 
 void cstring_clear(cstring_t cstr)
@@ -111,6 +120,7 @@ void cstring_clear(cstring_t cstr)
     struct cstring_hdr_s *hdr = cstring_of(cstr);
     hdr->free += hdr->length;
     hdr->length = 0;
+    hdr->hash = 0;
     hdr->buffer[0] = '\0';
 }
 
@@ -138,6 +148,7 @@ cstring_t cstring_catlen(cstring_t cstr, const void *s, unsigned long n)
     memcpy(&hdr->buffer[hdr->length], s, n);
     hdr->length += n;
     hdr->free -= n;
+    hdr->hash = 0;
     hdr->buffer[hdr->length] = '\0';
     return cstr;
 }
@@ -175,6 +186,7 @@ cstring_t cstring_cpylen(cstring_t cstr, const void *s, unsigned long n)
     cstr[n] = '\0';
     hdr->length = n;
     hdr->free = total - n;
+    hdr->hash = 0;
 
     return cstr;
 }
@@ -202,6 +214,7 @@ cstring_t cstring_resize(cstring_t cstr, unsigned long n)
     if (total > n) {
         hdr->free = total - n;
         hdr->length = n;
+        hdr->hash = 0;
         hdr->buffer[0] = '\0';
         return cstr;
     }
@@ -217,6 +230,7 @@ cstring_t cstring_resize(cstring_t cstr, unsigned long n)
 
     hdr->length = n;
     hdr->free = 0;
+    hdr->hash = 0;
 
     return cstr;
 }
@@ -250,12 +264,24 @@ int cstring_cmp(const cstring_t lhs, const cstring_t rhs)
     return cmp;
 }
 
+unsigned long cstring_hash(const cstring_t cstr)
+{
+    struct cstring_hdr_s *hdr = cstring_of(cstr);
+
+    if (hdr->hash == 0) {
+        hdr->hash = murmur2_hash((unsigned char*)hdr->buffer, hdr->length);
+    }
+
+    return hdr->hash;
+}
+
 void cstring_tolower(cstring_t cstr)
 {
     unsigned long i, len = cstring_length(cstr);
     for (i = 0; i < len; i++) {
         cstr[i] = (char) tolower(cstr[i]);
     }
+    cstring_of(cstr)->hash = 0;
 }
 
 void cstring_toupper(cstring_t cstr)
@@ -264,6 +290,7 @@ void cstring_toupper(cstring_t cstr)
     for (i = 0; i < len; i++) {
         cstr[i] = (char) toupper(cstr[i]);
     }
+    cstring_of(cstr)->hash = 0;
 }
 
 static cstring_t __cstring_make_some_space__(cstring_t cstr, unsigned long addlen)
@@ -27,6 +27,7 @@ cstring_t     cstring_cpylen(cstring_t cstr, const void *s, unsigned long n);
 cstring_t     cstring_cpystr(cstring_t cstr, const char *s);
 cstring_t     cstring_cpych(cstring_t cstr, char ch);
 int           cstring_cmp(const cstring_t lhs, const cstring_t rhs);
+unsigned long cstring_hash(const cstring_t cstr);
 void          cstring_tolower(cstring_t cstr);
 void          cstring_toupper(cstring_t cstr);
 
@@ -10,241 +10,6 @@
 
 #include <assert.h>
 
-value_t value_new(value_type_t type)
-{
-    value_t value = (value_t) mem_alloc(sizeof(struct value_s));
-    if (!value) {
-        return NULL;
-    }
-
-    value->type = type;
-
-    return value;
-}
-
-value_t value_dup(const value_t src)
-{
-    value_t value;
-    
-    value = value_new(src->type);
-    
-    *value = *src;
-
-    switch (value->type) {
-    case VALUE_TYPE_FUNCTION:
-    case VALUE_TYPE_NATIVE_FUNCTION:
-        break;
-    }
-    
-    return value;
-}
-
-void value_free(value_t value)
-{
-    mem_free(value);
-}
-
-static int __table_key_compare__(const hlist_node_t *lhs, const hlist_node_t *rhs)
-{
-    table_pair_t l = hlist_element(lhs, table_pair_t, link);
-    table_pair_t r = hlist_element(rhs, table_pair_t, link);
-
-    if (l->key->type == r->key->type) {
-        switch (l->key->type) {
-        case VALUE_TYPE_NULL:
-            return 0;
-        case VALUE_TYPE_CHAR:
-            return l->key->u.char_value - r->key->u.char_value;
-        case VALUE_TYPE_BOOL:
-            return l->key->u.bool_value - r->key->u.bool_value;
-        case VALUE_TYPE_INT:
-            return l->key->u.int_value - r->key->u.int_value;
-        case VALUE_TYPE_LONG:
-            return l->key->u.long_value - r->key->u.long_value;
-        case VALUE_TYPE_FLOAT:
-            return (int)(l->key->u.float_value - r->key->u.float_value);
-        case VALUE_TYPE_DOUBLE:
-            return (int)(l->key->u.double_value - r->key->u.double_value);
-        case VALUE_TYPE_NATIVE_FUNCTION:
-            return (int)(l->key->u.object_value->u.function - r->key->u.object_value->u.function);
-        case VALUE_TYPE_FUNCTION:
-            return (int)(l->key->u.object_value->u.function - r->key->u.object_value->u.function);
-        case VALUE_TYPE_STRING:
-            return cstring_cmp(l->key->u.object_value->u.string, r->key->u.object_value->u.string);
-        case VALUE_TYPE_ARRAY:
-            return (int)(l->key->u.object_value->u.array - r->key->u.object_value->u.array);
-        case VALUE_TYPE_TABLE:
-            return (int)(l->key->u.object_value->u.table - r->key->u.object_value->u.table);
-        case VALUE_TYPE_POINTER:
-            return (int)((uintptr_t)l->key->u.pointer_value - (uintptr_t)r->key->u.pointer_value);
-        }
-    }
-
-    return l->key->type - r->key->type;
-}
-
-static unsigned long __table_key_hashfn__(const hlist_node_t *hnode)
-{
-    table_pair_t pair = hlist_element(hnode, table_pair_t, link);
-
-    switch (pair->key->type) {
-    case VALUE_TYPE_NULL:
-        return 2;
-    case VALUE_TYPE_CHAR:
-        return pair->key->u.char_value;
-    case VALUE_TYPE_BOOL:
-        return pair->key->u.bool_value;
-    case VALUE_TYPE_INT:
-        return golden_ratio_prime_hash_32(pair->key->u.int_value, 32);
-    case VALUE_TYPE_LONG:
-        return (unsigned long)golden_ratio_prime_hash_ptr((uintptr_t)pair->key->u.long_value);
-    case VALUE_TYPE_FLOAT:
-        return (unsigned long)golden_ratio_prime_hash_ptr((uintptr_t)pair->key->u.float_value);
-    case VALUE_TYPE_DOUBLE:
-        return (unsigned long)golden_ratio_prime_hash_ptr((uintptr_t)pair->key->u.double_value);
-    case VALUE_TYPE_NATIVE_FUNCTION:
-    case VALUE_TYPE_FUNCTION:
-        return (unsigned long)golden_ratio_prime_hash_ptr((uintptr_t)pair->key->u.object_value->u.function);
-    case VALUE_TYPE_STRING:
-        return (unsigned long)murmur2_hash((unsigned char*)pair->key->u.object_value->u.string, cstring_length(pair->key->u.object_value->u.string));
-    case VALUE_TYPE_ARRAY:
-        return (unsigned long)golden_ratio_prime_hash_ptr((uintptr_t)pair->key->u.object_value->u.array);
-    case VALUE_TYPE_TABLE:
-        return (unsigned long)golden_ratio_prime_hash_ptr((uintptr_t)pair->key->u.object_value->u.table);
-    case VALUE_TYPE_POINTER:
-        return (unsigned long)golden_ratio_prime_hash_ptr((uintptr_t)pair->key->u.pointer_value);
-    }
-
-    return 0ul;
-}
-
-static void __table_node_destructor__(hlist_node_t *node)
-{
-    table_pair_t pair = hlist_element(node, table_pair_t, link);
-
-    value_free(pair->key);
-
-    value_free(pair->value);
-
-    mem_free(pair);
-}
-
-static hlist_node_ops_t __table_hash_operators__ = {
-    NULL,
-    &__table_node_destructor__,
-    &__table_key_hashfn__,
-    &__table_key_compare__,
-    NULL,
-};
-
-table_t table_new(void)
-{
-    table_t table = (table_t) mem_alloc(sizeof(struct table_s));
-    if (!table) {
-        return NULL;
-    }
-
-    table->table = hash_table_new(&__table_hash_operators__);
-
-    return table;
-}
-
-void table_free(table_t table)
-{
-    hash_table_free(table->table);
-    mem_free(table);
-}
-
-void table_clear(table_t table)
-{
-    hash_table_clear(table->table);
-}
-
-void table_push_pair(table_t table, environment_t env)
-{
-    table_pair_t pair;
-    value_t k, v;
-
-    assert(!list_is_empty(env->stack));
-
-    v = list_element(list_rbegin(env->stack), value_t, link);
-
-    list_pop_back(env->stack);
-
-    assert(!list_is_empty(env->stack));
-
-    k = list_element(list_rbegin(env->stack), value_t, link);
-
-    list_pop_back(env->stack);
-
-    pair = (table_pair_t) mem_alloc(sizeof(struct table_pair_s));
-
-    pair->key = k;
-    pair->value = v;
-
-    hash_table_replace(table->table, &pair->link);
-}
-
-void table_add_member(table_t table, value_t key, value_t value)
-{
-    table_pair_t pair = (table_pair_t) mem_alloc(sizeof(struct table_pair_s));
-    
-    pair->key   = key;
-    pair->value = value; 
-
-    hash_table_replace(table->table, &pair->link);
-}
-
-value_t table_search(table_t table, environment_t env)
-{
-    struct table_pair_s pair;
-    hlist_node_t* node;
-
-    pair.key = list_element(list_rbegin(env->stack), value_t, link);
-
-    node = hash_table_search(table->table, &pair.link);
-    if (!node) {
-        return NULL;
-    }
-
-    return hlist_element(node, table_pair_t, link)->value;
-}
-
-value_t table_search_by_value(table_t table, value_t key)
-{
-    struct table_pair_s pair;
-    hlist_node_t* node;
-
-    pair.key = key;
-
-    node = hash_table_search(table->table, &pair.link);
-    if (!node) {
-        return NULL;
-    }
-
-    return hlist_element(node, table_pair_t, link)->value;
-}
-
-value_t table_new_member(table_t table, value_t key)
-{
-    table_pair_t pair;
-    value_t value;
-
-    pair = (table_pair_t) mem_alloc(sizeof(struct table_pair_s));
-    if (!pair) {
-        return NULL;
-    }
-
-    value = value_new(VALUE_TYPE_NULL);
-
-    pair->key   = key;
-    pair->value = value;
-
-    hash_table_replace(table->table, &pair->link);
-
-    return value;
-}
-
 static int __environment_package_key_compare__(const hlist_node_t *lhs, const hlist_node_t *rhs)
 {
     package_t l = hlist_element(lhs, package_t, link);
@@ -255,7 +20,7 @@ static int __environment_package_key_compare__(const hlist_node_t *lhs, const hl
 static unsigned long __environment_package_key_hashfn__(const hlist_node_t *hnode)
 {
     package_t package = hlist_element(hnode, package_t, link);
-    return (unsigned long)murmur2_hash((unsigned char*)package->name, cstring_length(package->name));
+    return cstring_hash(package->name);
 }
 
 static void __environment_package_node_destructor__(hlist_node_t *node)
@@ -275,14 +40,6 @@ static hlist_node_ops_t __environment_package_operators__ = {
     NULL,
 };
 
-static void __environment_free_context_stack__(list_t context_stack) {
-    list_iter_t iter, next_iter;
-    list_safe_for_each(context_stack, iter, next_iter) {
-        list_erase(context_stack, *iter);
-        mem_free(list_element(iter, local_context_t, link));
-    }
-}
-
 environment_t environment_new(void)
 {
     environment_t env = (environment_t) mem_alloc(sizeof(struct environment_s));
@@ -291,10 +48,16 @@ environment_t environment_new(void)
     env->heap         = heap_new();
     env->packages      = hash_table_new(&__environment_package_operators__);
 
-    list_init(env->stack);
+    env->stack = array_newlen(sizeof(struct value_s), ENVIRONMENT_STACK_INIT_SIZE);
+
+    env->frames   = array_newlen(sizeof(struct frame_s), ENVIRONMENT_FRAMES_INIT_SIZE);
+    env->slots    = array_newlen(sizeof(struct value_s), ENVIRONMENT_SLOTS_INIT_SIZE);
+    env->upvalues = array_new(sizeof(object_t));
+
+    env->engine  = ENGINE_VM;
+    env->verbose = false;
+
     list_init(env->modules);
-    list_init(env->local_context_stack);
-    list_init(env->previous_context_frames);
 
     stack_init(env->statement_stack);
 
@@ -306,13 +69,9 @@ void environment_free(environment_t env)
     list_iter_t iter, next_iter;
 
     table_clear(env->global_table);
-    __environment_free_context_stack__(env->local_context_stack);
-
-    list_safe_for_each(env->previous_context_frames, iter, next_iter) {
-        list_erase(env->previous_context_frames, *iter);
-        __environment_free_context_stack__(
-            list_element(iter, local_context_stack_t, link)->context_stack);
-    }
+    array_clear(env->frames);
+    array_clear(env->slots);
+    array_clear(env->upvalues);
 
     heap_gc(env);
 
@@ -327,6 +86,11 @@ void environment_free(environment_t env)
         module_free(list_element(iter, module_t, link));
     }
 
+    array_free(env->stack);
+    array_free(env->frames);
+    array_free(env->slots);
+    array_free(env->upvalues);
+
     mem_free(env);
 }
 
@@ -340,6 +104,9 @@ void environment_add_module(environment_t env, module_t module)
         if (!cstring_is_empty(stmt->u.expr->u.function_expr->name)) {
             environment_push_string(env, stmt->u.expr->u.function_expr->name);
 
+            /* hoisted functions are resolved outside of any frame */
+            assert(array_is_empty(stmt->u.expr->u.function_expr->upvalues));
+
             environment_push_function(env, stmt->u.expr->u.function_expr);
 
             table_push_pair(environment_get_global_table(env), env);
@@ -382,279 +149,293 @@ table_t environment_get_global_table(environment_t env)
     return env->global_table;
 }
 
-void environment_push_local_context(environment_t env)
+frame_t environment_push_frame(environment_t env, object_t closure, unsigned long size)
 {
-    local_context_t context;
+    frame_t frame;
+    value_t slots;
+    unsigned long index;
+
+    frame = (frame_t) array_push(env->frames);
 
-    context = (local_context_t)mem_alloc(sizeof(struct local_context_s));
+    frame->closure = closure;
+    frame->base    = array_length(env->slots);
+    frame->size    = size;
 
-    context->object = heap_alloc_table(env);
+    slots = (value_t) array_push_n(env->slots, size);
+
+    for (index = 0; index < size; index++) {
+        slots[index].type = VALUE_TYPE_UNBOUND;
+    }
 
-    list_push_back(env->local_context_stack, context->link);
+    return frame;
 }
 
-void environment_push_scope_local_context(environment_t env, object_t object)
+void environment_pop_frame(environment_t env)
 {
-    local_context_t context;
+    assert(array_length(env->frames) > 0);
 
-    context = (local_context_t)mem_alloc(sizeof(struct local_context_s));
+    array_pop_n(env->slots, environment_get_frame(env)->size);
 
-    context->object = object;
-
-    list_push_back(env->local_context_stack, context->link);
+    array_pop(env->frames);
 }
 
-void environment_pop_local_context(environment_t env)
+frame_t environment_get_frame(environment_t env)
 {
-    local_context_t context;
+    assert(array_length(env->frames) > 0);
+
+    return array_base(env->frames, frame_t) + array_length(env->frames) - 1;
+}
 
-    context = list_element(list_rbegin(env->local_context_stack), local_context_t, link);
+void environment_clear_slots(environment_t env, unsigned int offset, unsigned int size)
+{
+    value_t slots;
 
-    list_pop_back(env->local_context_stack);
+    slots = environment_frame_slot(env, environment_get_frame(env), offset);
 
-    mem_free(context);
+    while (size--) {
+        slots[size].type = VALUE_TYPE_UNBOUND;
+    }
 }
 
-void environment_push_context_frame(environment_t env)
+static object_t __environment_capture_upvalue__(environment_t env, unsigned int index)
 {
-    local_context_stack_t stack;
+    object_t *upvalues;
+    object_t object;
+    unsigned long base;
+    unsigned long i;
 
-    stack =
-      (local_context_stack_t) mem_alloc(sizeof(struct local_context_stack_s));
+    base = environment_get_frame(env)->base;
 
-    stack->context_stack = env->local_context_stack;
+    /* open upvalues are ordered by frame, the running frame's come last */
+    upvalues = array_base(env->upvalues, object_t*);
 
-    list_init(env->local_context_stack);
+    for (i = array_length(env->upvalues); i > 0 && upvalues[i - 1]->u.upvalue->index >= base; i--) {
+        if (upvalues[i - 1]->u.upvalue->index == base + index) {
+            return upvalues[i - 1];
+        }
+    }
+
+    object = heap_alloc_upvalue(env, base + index);
+
+    *(object_t*) array_push(env->upvalues) = object;
 
-    list_push_back(env->previous_context_frames, stack->link);
+    return object;
 }
 
-void environment_pop_context_frame(environment_t env)
+void environment_close_upvalues(environment_t env, unsigned int offset)
 {
-    local_context_stack_t stack;
+    object_t *upvalues;
+    upvalue_t upvalue;
+    unsigned long base;
+    unsigned long start, index, kept;
 
-    stack = list_element(
-        list_rbegin(env->previous_context_frames),
-        local_context_stack_t, link);
+    base = environment_get_frame(env)->base;
 
-    env->local_context_stack = stack->context_stack;
+    upvalues = array_base(env->upvalues, object_t*);
+
+    start = array_length(env->upvalues);
+    while (start > 0 && upvalues[start - 1]->u.upvalue->index >= base) {
+        start--;
+    }
 
-    list_pop_back(env->previous_context_frames);
+    kept = start;
 
-    mem_free(stack);
+    for (index = start; index < array_length(env->upvalues); index++) {
+        upvalue = upvalues[index]->u.upvalue;
+
+        if (upvalue->index >= base + offset) {
+            heap_barrier_object(env, upvalues[index]);
+            upvalue->closed = *environment_slot_at(env, upvalue->index);
+            upvalue->open   = false;
+        } else {
+            upvalues[kept++] = upvalues[index];
+        }
+    }
+
+    array_pop_n(env->upvalues, array_length(env->upvalues) - kept);
 }
 
 void environment_clear_stack(environment_t env)
 {
-    list_iter_t iter, next_iter;
-    list_safe_for_each(env->stack, iter, next_iter) {
-        list_erase(env->stack, *iter);
-        value_free(list_element(iter, value_t, link));
-    }
+    array_clear(env->stack);
 }
 
 void environment_xchg_stack(environment_t env)
 {
-    value_t v1, v2;
-    
-    assert(!list_is_empty(env->stack));
-
-    v1 = list_element(list_rbegin(env->stack), value_t, link);
-
-    list_pop_back(env->stack);
-
-    assert(!list_is_empty(env->stack));
+    struct value_s v;
+    value_t top;
 
-    v2 = list_element(list_rbegin(env->stack), value_t, link);
+    assert(environment_stack_size(env) >= 2);
 
-    list_pop_back(env->stack);
+    top = environment_stack_top(env);
 
-    list_push_back(env->stack, v1->link);
-    list_push_back(env->stack, v2->link);
+    v      = top[0];
+    top[0] = top[-1];
+    top[-1] = v;
 }
 
 void environment_pop_value(environment_t env)
 {
-    value_t value;
+    assert(environment_stack_size(env) >= 1);
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    array_pop(env->stack);
+}
 
-    list_pop_back(env->stack);
+void environment_pop_values(environment_t env, unsigned long n)
+{
+    assert(environment_stack_size(env) >= n);
 
-    value_free(value);
+    array_pop_n(env->stack, n);
 }
 
-void environment_push_pointer(environment_t env, void *pointer)
+static value_t __environment_push__(environment_t env, value_type_t type)
 {
-    value_t value = value_new(VALUE_TYPE_POINTER);
+    value_t value = (value_t) array_push(env->stack);
 
-    value->u.pointer_value = pointer;
+    value->type = type;
 
-    list_push_back(env->stack, value->link);
+    return value;
 }
 
-void environment_push_value(environment_t env, value_t value)
+void environment_push_pointer(environment_t env, void *pointer)
 {
-    list_push_back(env->stack, value->link);
+    __environment_push__(env, VALUE_TYPE_POINTER)->u.pointer_value = pointer;
 }
 
-void environment_push_char(environment_t env, char char_value)
+void environment_push_value(environment_t env, value_t value)
 {
-    value_t value = value_new(VALUE_TYPE_CHAR);
+    struct value_s v = *value;
 
-    value->u.char_value = char_value;
+    *(value_t) array_push(env->stack) = v;
+}
 
-    list_push_back(env->stack, value->link);
+void environment_push_char(environment_t env, char char_value)
+{
+    __environment_push__(env, VALUE_TYPE_CHAR)->u.char_value = char_value;
 }
 
 void environment_push_bool(environment_t env, bool bool_value)
 {
-    value_t value = value_new(VALUE_TYPE_BOOL);
-
-    value->u.bool_value = bool_value;
-
-    list_push_back(env->stack, value->link);
+    __environment_push__(env, VALUE_TYPE_BOOL)->u.bool_value = bool_value;
 }
 
 void environment_push_int(environment_t env, int int_value)
 {
-    value_t value = value_new(VALUE_TYPE_INT);
-
-    value->u.int_value  = int_value;
-
-    list_push_back(env->stack, value->link);
+    __environment_push__(env, VALUE_TYPE_INT)->u.int_value = int_value;
 }
 
 void environment_push_long(environment_t env, long long_value)
 {
-    value_t value = value_new(VALUE_TYPE_LONG);
-
-    value->u.long_value = long_value;
-
-    list_push_back(env->stack, value->link);
+    __environment_push__(env, VALUE_TYPE_LONG)->u.long_value = long_value;
 }
 
 void environment_push_float(environment_t env, float float_value)
 {
-    value_t value = value_new(VALUE_TYPE_FLOAT);
-
-    value->u.float_value = float_value;
-
-    list_push_back(env->stack, value->link);
+    __environment_push__(env, VALUE_TYPE_FLOAT)->u.float_value = float_value;
 }
 
 void environment_push_double(environment_t env, double double_value)
 {
-    value_t value = value_new(VALUE_TYPE_DOUBLE);
-
-    value->u.double_value = double_value;
-
-    list_push_back(env->stack, value->link);
+    __environment_push__(env, VALUE_TYPE_DOUBLE)->u.double_value = double_value;
 }
 
 void environment_push_string(environment_t env, cstring_t string_value)
 {
-    value_t value = value_new(VALUE_TYPE_STRING);
+    object_t object = heap_alloc_string(env, string_value);
 
-    value->u.object_value = heap_alloc_string(env, string_value);
+    __environment_push__(env, VALUE_TYPE_STRING)->u.object_value = object;
+}
 
-    list_push_back(env->stack, value->link);
+void environment_push_symbol(environment_t env, symbol_t symbol)
+{
+    __environment_push__(env, VALUE_TYPE_STRING)->u.object_value = heap_symbol_string(symbol);
 }
 
 void environment_push_str(environment_t env, const char* str)
 {
-    value_t value = value_new(VALUE_TYPE_STRING);
+    object_t object = heap_alloc_str(env, str);
 
-    value->u.object_value = heap_alloc_str(env, str);
-
-    list_push_back(env->stack, value->link);
+    __environment_push__(env, VALUE_TYPE_STRING)->u.object_value = object;
 }
 
 void environment_push_null(environment_t env)
 {
-    value_t value = value_new(VALUE_TYPE_NULL);
-
-    list_push_back(env->stack, value->link);
+    __environment_push__(env, VALUE_TYPE_NULL);
 }
 
 void environment_push_function(environment_t env, expression_function_t function_expr)
 {
-    value_t value;
-    list_iter_t iter;
-    local_context_t context;
-    
-    value = value_new(VALUE_TYPE_FUNCTION);
+    expression_upvalue_t upvalues;
+    object_t object;
+    frame_t frame;
+    int index;
+
+    object = heap_alloc_function(env, function_expr);
 
-    value->u.object_value = heap_alloc_function(env, function_expr);
+    /* reachable from the stack before capturing, which may collect */
+    __environment_push__(env, VALUE_TYPE_FUNCTION)->u.object_value = object;
 
-    list_for_each(env->local_context_stack, iter) {
-        context = list_element(iter, local_context_t, link);
-        list_push_back(value->u.object_value->u.function->scopes, context->object->link_scope);
+    array_for_each(function_expr->upvalues, upvalues, index) {
+        frame = environment_get_frame(env);
+
+        if (upvalues[index].local) {
+            object->u.function->upvalues[index] =
+                __environment_capture_upvalue__(env, upvalues[index].index);
+        } else {
+            object->u.function->upvalues[index] =
+                frame->closure->u.function->upvalues[upvalues[index].index];
+        }
     }
 
-    list_push_back(env->stack, value->link);
+    /* capturing may have promoted the function past the upvalues it holds */
+    heap_barrier_object(env, object);
 }
 
 void environment_push_native_function(environment_t env, native_function_pt native_function)
 {
-    value_t value = value_new(VALUE_TYPE_NATIVE_FUNCTION);
+    object_t object = heap_alloc_native_function(env, native_function);
 
-    value->u.object_value = heap_alloc_native_function(env, native_function);
-
-    list_push_back(env->stack, value->link);
+    __environment_push__(env, VALUE_TYPE_NATIVE_FUNCTION)->u.object_value = object;
 }
 
 void environment_push_array_generate(environment_t env, list_t array_generate)
 {
     list_iter_t  iter;
     expression_t expr;
-    value_t      value;
-    value_t      elem;
-    value_t*     dst;
-
-    value = value_new(VALUE_TYPE_ARRAY);
+    object_t     array;
 
-    value->u.object_value = heap_alloc_array_n(env, 10);
+    environment_push_array(env);
 
-    list_push_back(env->stack, value->link);
+    array = environment_stack_top(env)->u.object_value;
 
     list_for_each(array_generate, iter) {
         expr = list_element(iter, expression_t, link);
 
         evaluator_expression(env, expr);
 
-        elem = list_element(list_rbegin(env->stack), value_t, link);
-
-        list_pop_back(env->stack);
+        /* evaluating an element may have promoted the array */
+        heap_barrier_object(env, array);
+        *(value_t) array_push(array->u.array) = *environment_stack_top(env);
 
-        dst = (value_t*) array_push(value->u.object_value->u.array);
-
-        *dst = elem;
+        environment_pop_value(env);
     }
 }
 
 void environment_push_array(environment_t env)
 {
-    value_t array_value;
-
-    array_value = value_new(VALUE_TYPE_ARRAY);
+    object_t object = heap_alloc_array(env);
 
-    array_value->u.object_value = heap_alloc_array(env);
-
-    list_push_back(env->stack, array_value->link);
+    __environment_push__(env, VALUE_TYPE_ARRAY)->u.object_value = object;
 }
 
 void environment_push_table_generate(environment_t env, list_t table_generate)
 {
     list_iter_t     iter;
-    value_t         table_value;
-    value_t         value;
-
-    table_value = value_new(VALUE_TYPE_TABLE);
+    object_t        table;
 
-    table_value->u.object_value = heap_alloc_table(env);
+    environment_push_table(env);
 
-    list_push_back(env->stack, table_value->link);
+    table = environment_stack_top(env)->u.object_value;
 
     list_for_each(table_generate, iter) {
         expression_table_pair_t pair;
@@ -663,26 +444,22 @@ void environment_push_table_generate(environment_t env, list_t table_generate)
 
         evaluator_expression(env, pair->member_name);
 
-        value = list_element(list_rbegin(env->stack), value_t, link);
-
-        if (value->type == VALUE_TYPE_NULL && pair->member_name->type == EXPRESSION_TYPE_IDENTIFIER) {
-            value->u.object_value = heap_alloc_string(env, pair->member_name->u.identifier_expr);
-            value->type = VALUE_TYPE_STRING;
+        if (environment_stack_top(env)->type == VALUE_TYPE_NULL &&
+            pair->member_name->type == EXPRESSION_TYPE_IDENTIFIER) {
+            environment_pop_value(env);
+            environment_push_symbol(env, pair->member_name->u.identifier_expr->symbol);
         }
 
         evaluator_expression(env, pair->member_expr);
 
-        table_push_pair(table_value->u.object_value->u.table, env);
+        heap_barrier_object(env, table);
+        table_push_pair(table->u.table, env);
     }
 }
 
 void environment_push_table(environment_t env)
 {
-    value_t table_value;
-   
-    table_value = value_new(VALUE_TYPE_TABLE);
+    object_t object = heap_alloc_table(env);
 
-    table_value->u.object_value = heap_alloc_table(env);
-
-    list_push_back(env->stack, table_value->link);
-}
\ No newline at end of file
+    __environment_push__(env, VALUE_TYPE_TABLE)->u.object_value = object;
+}
@@ -20,9 +20,10 @@ typedef enum value_type_e       value_type_t;
 typedef struct value_s*         value_t;
 typedef struct table_pair_s*    table_pair_t;
 typedef struct table_s*         table_t;
-typedef struct local_context_s* local_context_t;
-typedef struct local_context_stack_s* local_context_stack_t;
+typedef struct frame_s*         frame_t;
+typedef struct upvalue_s*       upvalue_t;
 typedef struct package_s*       package_t;
+typedef enum engine_e           engine_t;
 
 enum object_type_e {
     OBJECT_TYPE_STRING,
@@ -30,6 +31,7 @@ enum object_type_e {
     OBJECT_TYPE_TABLE,
     OBJECT_TYPE_NATIVE_FUNCTION,
     OBJECT_TYPE_FUNCTION,
+    OBJECT_TYPE_UPVALUE,
 };
 
 typedef void (*native_function_pt)(environment_t env, unsigned int argc);
@@ -39,22 +41,27 @@ struct function_s {
         expression_function_t function_expr;
         native_function_pt    native_function;
     } f;
-    list_t scopes;
+    unsigned int nupvalues;
+    object_t*    upvalues;          /* upvalue objects the body refers to */
 };
 
+/*
+ * Objects live in the heap's pages, which keep their mark bits; the
+ * header is only the type and a few flags in front of the payload.
+ */
 struct object_s {
-    object_type_t type;
-    bool marked;
+    unsigned char type;             /* an object_type_t */
+    bool constant;                  /* a module's string constant, not on the heap */
+    bool old;                       /* survived a collection in generational mode */
+    bool remembered;                /* old, and in the heap's remembered set */
 
     union {       
         cstring_t       string;
         array_t         array;
         table_t         table;
         function_t      function;
+        upvalue_t       upvalue;
     } u;
-
-    list_node_t link_heap;
-    list_node_t link_scope;
 };
 
 enum value_type_e {
@@ -73,8 +80,16 @@ enum value_type_e {
     VALUE_TYPE_TABLE,
 
     VALUE_TYPE_POINTER,
+
+    VALUE_TYPE_UNBOUND,             /* frame slot whose name is not bound yet */
 };
 
+/*
+ * Values are passed around by copy: a tag plus an 8-byte payload, 16 bytes
+ * on 64-bit targets. Arrays, table pairs and the operand stack store them
+ * inline; only the payload of string/array/table/function values points
+ * at a heap object.
+ */
 struct value_s {
     value_type_t type;
 
@@ -88,42 +103,52 @@ struct value_s {
         object_t              object_value;
         void*                 pointer_value;
     }u;
-
-    list_node_t link;
 };
 
-value_t value_new(value_type_t type);
-value_t value_dup(const value_t src);
-void    value_free(value_t value);
-
 struct table_pair_s {
-    value_t      key;
-    value_t      value;
-    hlist_node_t link;
-};
-
-struct table_s {
-    hash_table_t table;
+    struct value_s key;
+    struct value_s value;
 };
 
 table_t table_new(void);
 void    table_free(table_t table);
+void    table_clear(table_t table);
 value_t table_search(table_t table, environment_t env);
 value_t table_search_by_value(table_t table, value_t key);
+value_t table_search_symbol(table_t table, symbol_t symbol);
 value_t table_new_member(table_t table, value_t key);
 void    table_add_member(table_t table, value_t key, value_t value);
 void    table_push_pair(table_t table, environment_t env);
 
 typedef struct heap_s* heap_t;
 
-struct local_context_s {
-    object_t object;
-    list_node_t link;
+/*
+ * A call frame. Its locals are size slots of the environment's slot stack
+ * starting at base, laid out by the resolver; closure is the function
+ * running in the frame, NULL for a module chunk.
+ */
+struct frame_s {
+    object_t      closure;
+    unsigned long base;
+    unsigned long size;
 };
 
-struct local_context_stack_s {
-  list_t context_stack;
-  list_node_t link;
+/*
+ * A variable of an enclosing function, as seen by a closure. While the
+ * scope that binds it is running the upvalue is open and refers to its
+ * slot by absolute index, since the slot stack moves as it grows; leaving
+ * the scope closes it, copying the value inside.
+ */
+struct upvalue_s {
+    bool           open;
+    unsigned long  index;
+    struct value_s closed;
+};
+
+/* how executor_run runs a module */
+enum engine_e {
+    ENGINE_VM,                      /* compile to bytecode for the vm */
+    ENGINE_TREE_WALKER,             /* interpret the AST directly */
 };
 
 struct package_s {
@@ -133,32 +158,72 @@ struct package_s {
 
 struct environment_s {
     stack_t statement_stack;
-    list_t  local_context_stack;
-    list_t  previous_context_frames;
-    list_t  stack;
+    array_t frames;                 /* struct frame_s, running frame on top */
+    array_t slots;                  /* locals of all active frames */
+    array_t upvalues;               /* object_t, open upvalues by slot */
+    array_t stack;
     heap_t  heap;
     table_t global_table;
     hash_table_t packages;
     list_t  modules;
+    engine_t engine;
+    bool     verbose;               /* report what the optimizer does */
 };
 
+#ifndef ENVIRONMENT_STACK_INIT_SIZE
+#define ENVIRONMENT_STACK_INIT_SIZE (1024UL)
+#endif
+
+/*
+ * The operand stack is a contiguous array of values stored inline, so
+ * pointers into it are only valid until the next push.
+ */
+#define environment_stack_size(env)                                           \
+    array_length((env)->stack)
+
+#define environment_stack_at(env, index)                                      \
+    (array_base((env)->stack, value_t) + (index))
+
+#define environment_stack_top(env)                                            \
+    environment_stack_at(env, environment_stack_size(env) - 1)
+
+#ifndef ENVIRONMENT_SLOTS_INIT_SIZE
+#define ENVIRONMENT_SLOTS_INIT_SIZE (1024UL)
+#endif
+
+#ifndef ENVIRONMENT_FRAMES_INIT_SIZE
+#define ENVIRONMENT_FRAMES_INIT_SIZE (256UL)
+#endif
+
+/*
+ * Frame slots are only valid until the next call pushes a frame, which
+ * may move the slot stack.
+ */
+#define environment_slot_at(env, index)                                       \
+    (array_base((env)->slots, value_t) + (index))
+
+#define environment_frame_slot(env, frame, index)                             \
+    environment_slot_at(env, (frame)->base + (index))
+
+#define environment_upvalue_value(env, upvalue)                               \
+    ((upvalue)->open ? environment_slot_at(env, (upvalue)->index) : &(upvalue)->closed)
+
 environment_t environment_new(void);
 void          environment_free(environment_t env);
 table_t       environment_get_global_table(environment_t env);
 
-/* local context */
-void          environment_push_local_context(environment_t env);
-void          environment_push_scope_local_context(environment_t env, object_t object);
-void          environment_pop_local_context(environment_t env);
-
-/* Push/pop local context stack to/from previous frames */
-void          environment_push_context_frame(environment_t env);
-void          environment_pop_context_frame(environment_t env);
+/* frames */
+frame_t       environment_push_frame(environment_t env, object_t closure, unsigned long size);
+void          environment_pop_frame(environment_t env);
+frame_t       environment_get_frame(environment_t env);
+void          environment_clear_slots(environment_t env, unsigned int offset, unsigned int size);
+void          environment_close_upvalues(environment_t env, unsigned int offset);
 
 /* stack op */
 void          environment_clear_stack(environment_t env);
 void          environment_xchg_stack(environment_t env);
 void          environment_pop_value(environment_t env);
+void          environment_pop_values(environment_t env, unsigned long n);
 void          environment_push_pointer(environment_t env, void *pointer);
 void          environment_push_value(environment_t env, value_t value);
 void          environment_push_char(environment_t env, char char_value);
@@ -169,6 +234,7 @@ void          environment_push_float(environment_t env, float float_value);
 void          environment_push_double(environment_t env, double double_value);
 void          environment_push_str(environment_t env, const char* str);
 void          environment_push_string(environment_t env, cstring_t string_value);
+void          environment_push_symbol(environment_t env, symbol_t symbol);
 void          environment_push_null(environment_t env);
 void          environment_push_function(environment_t env, expression_function_t function);
 void          environment_push_native_function(environment_t env, native_function_pt native_function);
@@ -31,17 +31,20 @@ const char* get_expression_type_string(expression_type_t type);
 const char* get_value_type_string(value_type_t type);
 
 static void         __evaluator_identifier_expression__(environment_t env, expression_t lexpr);
-static value_t      __evaluator_search_function__(environment_t env, expression_t function_expr);
+static void         __evaluator_search_function__(environment_t env, expression_t function_expr);
 static value_t      __evaluator_search_variable__(environment_t env, expression_t lexpr);
-static value_t      __evaluator_get_lvalue__(environment_t env, expression_t lexpr);
+static value_t      __evaluator_search_identifier_variable__(environment_t env, expression_identifier_t identifier);
+static value_t      __evaluator_get_variable_lvalue__(environment_t env, expression_identifier_t identifier, object_t *owner);
+static value_t      __evaluator_get_lvalue__(environment_t env, expression_t lexpr, object_t *owner);
 static void         __evaluator_call_expression__(environment_t env, expression_t call_expr);
 static void         __evaluator_function_call_expression__(environment_t env, value_t function_value, list_t args);
 static void         __evaluator_native_function_call_expression__(environment_t env, value_t function_value, list_t args);
 static void         __evaluator_assign_expression__(environment_t env, expression_type_t type, expression_t lvalue_expr, expression_t rvalue_expr);
-static void         __evaluator_do_assign_expression__(environment_t env, long line, long column, expression_type_t type, value_t left, value_t right);
+static void         __evaluator_do_assign_expression__(environment_t env, long line, long column, expression_type_t type, value_t left, value_t right, object_t owner);
 static void         __evaluator_unary_expression__(environment_t env, expression_t expr);
 static void         __evaluator_inc_dec_expression__(environment_t env, expression_t expr);
-static void         __evaluator_binary_expression__(environment_t env, expression_type_t type, expression_t left_expr, expression_t right_expr);
+static void         __evaluator_binary_expression__(environment_t env, expression_t expr);
+static void         __evaluator_int_binary_quick__(expression_type_t type, value_t left, value_t right);
 static value_type_t __evaluator_implicit_cast_expression__(value_t left_value, value_t right_value);
 static void         __evaluator_char_binary_expression__(environment_t env, long line, long column, expression_type_t type, value_t left, value_t right);
 static void         __evaluator_bool_binary_expression__(environment_t env, long line, long column, expression_type_t type, value_t left, value_t right);
@@ -52,10 +55,10 @@ static void         __evaluator_double_binary_expression__(environment_t env, lo
 static void         __evaluator_string_binary_expression__(environment_t env, long line, long column, expression_type_t type, value_t left, value_t right);
 static void         __evaluator_null_binary_expression__(environment_t env, long line, long column, expression_type_t type, value_t left, value_t right);
 static void         __evaluator_logic_binary_expression__(environment_t env, expression_type_t type, expression_t left_expr, expression_t right_expr);
-static value_t      __evaluator_index_expression__(environment_t env, expression_t expr);
+static value_t      __evaluator_index_expression__(environment_t env, expression_t expr, object_t *owner);
 static void         __evaluator_array_push__(environment_t env, expression_t expr);
 static void         __evaluator_array_pop__(environment_t env, expression_t expr);
-static value_t      __evaluator_table_dot_member__(environment_t env, expression_t expr);
+static value_t      __evaluator_table_dot_member__(environment_t env, expression_t expr, object_t *owner);
 
 void evaluator_expression(environment_t env, expression_t expr)
 {
@@ -87,7 +90,7 @@ void evaluator_expression(environment_t env, expression_t expr)
         break;
 
     case EXPRESSION_TYPE_STRING:
-        environment_push_string(env, expr->u.string_expr);
+        environment_push_symbol(env, expr->u.string_expr);
         break;
 
     case EXPRESSION_TYPE_NULL:
@@ -151,7 +154,7 @@ void evaluator_expression(environment_t env, expression_t expr)
     case EXPRESSION_TYPE_LEQ:
     case EXPRESSION_TYPE_EQ:
     case EXPRESSION_TYPE_NEQ:
-        __evaluator_binary_expression__(env, expr->type, expr->u.binary_expr->left, expr->u.binary_expr->right);
+        __evaluator_binary_expression__(env, expr);
         break;
 
     case EXPRESSION_TYPE_AND:
@@ -176,16 +179,16 @@ void evaluator_expression(environment_t env, expression_t expr)
         break;
 
     case EXPRESSION_TYPE_TABLE_DOT_MEMBER:
-        value = __evaluator_table_dot_member__(env, expr);
+        value = __evaluator_table_dot_member__(env, expr, NULL);
         if (value) {
-            list_push_back(env->stack, value_dup(value)->link);
+            environment_push_value(env, value);
         }
         break;
 
     case EXPRESSION_TYPE_INDEX:
-        value = __evaluator_get_lvalue__(env, expr);
+        value = __evaluator_index_expression__(env, expr, NULL);
         if (value) {
-            list_push_back(env->stack, value_dup(value)->link);
+            environment_push_value(env, value);
         }
         break;
 
@@ -194,9 +197,9 @@ void evaluator_expression(environment_t env, expression_t expr)
     }
 }
 
-value_t evaluator_get_lvalue(environment_t env, expression_t expr)
+value_t evaluator_get_lvalue(environment_t env, expression_t expr, object_t *owner)
 {
-    return __evaluator_get_lvalue__(env, expr);
+    return __evaluator_get_lvalue__(env, expr, owner);
 }
 
 void evaluator_binary_value(environment_t env, long line, long column, expression_type_t type, value_t left, value_t right)
@@ -250,43 +253,327 @@ void evaluator_binary_value(environment_t env, long line, long column, expressio
     }
 }
 
+value_t evaluator_search_identifier(environment_t env, expression_identifier_t identifier)
+{
+    return __evaluator_search_identifier_variable__(env, identifier);
+}
+
+value_t evaluator_identifier_lvalue(environment_t env, expression_identifier_t identifier)
+{
+    object_t owner;
+
+    return __evaluator_get_variable_lvalue__(env, identifier, &owner);
+}
+
+value_t evaluator_index_value(environment_t env, long line, long column, value_t dict, value_t index)
+{
+    static struct value_s out_of_range;
+    value_t elem = NULL;
+
+    switch (dict->type) {
+    case VALUE_TYPE_ARRAY:
+        if (index->type != VALUE_TYPE_INT) {
+            runtime_error("(%d, %d): array indices must be integers", 
+                          line, 
+                          column);
+        }
+
+        if (index->u.int_value >= 0 && index->u.int_value < (int)array_length(dict->u.object_value->u.array)) {
+            elem = (value_t)array_index(dict->u.object_value->u.array, index->u.int_value);
+
+        } else if (index->u.int_value == (int)array_length(dict->u.object_value->u.array)) {
+            elem = (value_t)array_push(dict->u.object_value->u.array);
+            elem->type = VALUE_TYPE_NULL;
+
+        } else {
+            /* writes past the end of the array are discarded */
+            elem = &out_of_range;
+            elem->type = VALUE_TYPE_NULL;
+        }
+        break;
+
+    case VALUE_TYPE_TABLE:
+        elem = table_search_by_value(dict->u.object_value->u.table, index);
+        if (!elem) {
+            heap_barrier_object(env, dict->u.object_value);
+            elem = table_new_member(dict->u.object_value->u.table, index);
+        }
+        break;
+
+    default:
+        runtime_error("(%d, %d): '%s' is not array/table", 
+                      line,
+                      column,
+                      get_value_type_string(dict->type));
+        break;
+    }
+
+    assert(elem != NULL);
+    return elem;
+}
+
+value_t evaluator_member_value(environment_t env, long line, long column, value_t table_value, symbol_t member_name)
+{
+    value_t elem;
+    table_t table;
+
+    if (table_value->type != VALUE_TYPE_TABLE) {
+        runtime_error("(%d, %d) '%s' object has no member\n",
+                      line,
+                      column,
+                      get_value_type_string(table_value->type));
+    }
+
+    table = table_value->u.object_value->u.table;
+
+    elem = table_search_symbol(table, member_name);
+    if (!elem) {
+        /* the key is the name's constant string, nothing is allocated */
+        environment_push_symbol(env, member_name);
+        elem = table_new_member(table, environment_stack_top(env));
+        environment_pop_value(env);
+    }
+
+    return elem;
+}
+
+void evaluator_unary_value(environment_t env, long line, long column, expression_type_t type, value_t operand)
+{
+    switch (operand->type) {
+    case VALUE_TYPE_BOOL:
+        switch (type) {
+        case EXPRESSION_TYPE_NOT:
+            operand->u.bool_value = !operand->u.bool_value;
+            break;
+        default:
+            runtime_error("(%d, %d): unsupport %s(%s)", 
+                          line, 
+                          column,
+                          get_expression_type_string(type),
+                          get_value_type_string(operand->type));
+        }
+        break;
+
+    case VALUE_TYPE_CHAR:
+        switch (type) {
+        case EXPRESSION_TYPE_PLUS:
+            break;
+        case EXPRESSION_TYPE_MINUS:
+            operand->u.bool_value = -operand->u.bool_value;
+            break;
+        case EXPRESSION_TYPE_CPL:
+            operand->u.bool_value = ~operand->u.bool_value;
+            break;
+        default:
+            runtime_error("(%d, %d): unsupport %s(%s)", 
+                          line, 
+                          column,
+                          get_expression_type_string(type),
+                          get_value_type_string(operand->type));
+        }
+        break;
+
+    case VALUE_TYPE_INT:
+        switch (type) {
+        case EXPRESSION_TYPE_PLUS:
+            break;
+        case EXPRESSION_TYPE_MINUS:
+            operand->u.int_value = -operand->u.int_value;
+            break;
+        case EXPRESSION_TYPE_CPL:
+            operand->u.int_value = ~operand->u.int_value;
+            break;
+        default:
+            runtime_error("(%d, %d): unsupport %s(%s)", 
+                          line, 
+                          column,
+                          get_expression_type_string(type),
+                          get_value_type_string(operand->type));
+        }
+        break;
+
+    case VALUE_TYPE_LONG:
+        switch (type) {
+        case EXPRESSION_TYPE_PLUS:
+            break;
+        case EXPRESSION_TYPE_MINUS:
+            operand->u.long_value = -operand->u.long_value;
+            break;
+        case EXPRESSION_TYPE_CPL:
+            operand->u.long_value = ~operand->u.long_value;
+            break;
+        default:
+            runtime_error("(%d, %d): unsupport %s(%s)", 
+                          line, 
+                          column,
+                          get_expression_type_string(type),
+                          get_value_type_string(operand->type));
+        }
+        break;
+
+    case VALUE_TYPE_FLOAT:
+        switch (type) {
+        case EXPRESSION_TYPE_PLUS:
+            break;
+        case EXPRESSION_TYPE_MINUS:
+            operand->u.float_value = -operand->u.float_value;
+            break;
+        default:
+            runtime_error("(%d, %d): unsupport %s(%s)", 
+                          line, 
+                          column,
+                          get_expression_type_string(type),
+                          get_value_type_string(operand->type));
+        }
+        break;
+
+    case VALUE_TYPE_DOUBLE:
+        switch (type) {
+        case EXPRESSION_TYPE_PLUS:
+            break;
+        case EXPRESSION_TYPE_MINUS:
+            operand->u.double_value = -operand->u.double_value;
+            break;
+        default:
+            runtime_error("(%d, %d): unsupport %s(%s)", 
+                          line, 
+                          column,
+                          get_expression_type_string(type),
+                          get_value_type_string(operand->type));
+        }
+        break;
+
+    default:
+        runtime_error("(%d, %d): unsupport %s(%s)", 
+                      line, 
+                      column,
+                      get_expression_type_string(type),
+                      get_value_type_string(operand->type));
+        break;
+    }
+}
+
+void evaluator_incdec_value(environment_t env, long line, long column, expression_type_t type, value_t operand)
+{
+    switch (operand->type) {
+    case VALUE_TYPE_CHAR:
+        switch (type) {
+        case EXPRESSION_TYPE_INC:
+            operand->u.char_value++;
+            break;
+        case EXPRESSION_TYPE_DEC:
+            operand->u.char_value--;
+            break;
+        default:
+            assert(false);
+            break;
+        }
+        break;
+    case VALUE_TYPE_INT:
+        switch (type) {
+        case EXPRESSION_TYPE_INC:
+            operand->u.int_value++;
+            break;
+        case EXPRESSION_TYPE_DEC:
+            operand->u.int_value--;
+            break;
+        default:
+            assert(false);
+            break;
+        }
+        break;
+    case VALUE_TYPE_LONG:
+        switch (type) {
+        case EXPRESSION_TYPE_INC:
+            operand->u.long_value++;
+            break;
+        case EXPRESSION_TYPE_DEC:
+            operand->u.long_value--;
+            break;
+        default:
+            assert(false);
+            break;
+        }
+        break;
+    case VALUE_TYPE_FLOAT:
+        switch (type) {
+        case EXPRESSION_TYPE_INC:
+            operand->u.float_value++;
+            break;
+        case EXPRESSION_TYPE_DEC:
+            operand->u.float_value--;
+            break;
+        default:
+            assert(false);
+            break;
+        }
+        break;
+    case VALUE_TYPE_DOUBLE:
+        switch (type) {
+        case EXPRESSION_TYPE_INC:
+            operand->u.double_value++;
+            break;
+        case EXPRESSION_TYPE_DEC:
+            operand->u.double_value--;
+            break;
+        default:
+            assert(false);
+            break;
+        }
+        break;
+    default:
+        runtime_error("(%d, %d): unsupport %s(%s)", 
+                      line, 
+                      column,
+                      get_expression_type_string(type),
+                      get_value_type_string(operand->type));
+        break;
+    }
+}
+
 static void __evaluator_identifier_expression__(environment_t env, expression_t lexpr)
 {
     value_t value = __evaluator_search_variable__(env, lexpr);
 
     if (value) {
-        list_push_back(env->stack, value_dup(value)->link);
+        environment_push_value(env, value);
     } else {
         environment_push_null(env);
     }
 }
 
-static value_t __evaluator_search_identifier_variable__(environment_t env) 
+static value_t __evaluator_search_identifier_variable__(environment_t env, expression_identifier_t identifier)
 {
-    list_iter_t iter;
+    expression_slot_t slots;
+    value_t value;
+    frame_t frame;
+    int index;
 
-    list_reverse_for_each(env->local_context_stack, iter) {
-        local_context_t context = list_element(iter, local_context_t, link);
+    frame = environment_get_frame(env);
 
-        value_t value = table_search(context->object->u.table, env);
+    array_for_each(identifier->slots, slots, index) {
+        if (slots[index].upvalue) {
+            value = environment_upvalue_value(env,
+                frame->closure->u.function->upvalues[slots[index].index]->u.upvalue);
+        } else {
+            value = environment_frame_slot(env, frame, slots[index].index);
+        }
 
-        if (value) {
+        if (value->type != VALUE_TYPE_UNBOUND) {
             return value;
         }
     }
 
-    return table_search(environment_get_global_table(env), env);
+    return table_search_symbol(environment_get_global_table(env), identifier->symbol);
 }
 
-static value_t __evaluator_search_function__(environment_t env, expression_t function_expr)
+static void __evaluator_search_function__(environment_t env, expression_t function_expr)
 {
     value_t value;
 
     switch (function_expr->type) {
     case EXPRESSION_TYPE_IDENTIFIER:
-        environment_push_string(env, function_expr->u.identifier_expr);
-        
-        value = __evaluator_search_identifier_variable__(env);
+        value = __evaluator_search_identifier_variable__(env, function_expr->u.identifier_expr);
 
         if (!value || !(value->type == VALUE_TYPE_FUNCTION || value->type == VALUE_TYPE_NATIVE_FUNCTION)) {
             runtime_error("(%d, %d): called object type '%s' is not a function",
@@ -295,25 +582,20 @@ static value_t __evaluator_search_function__(environment_t env, expression_t fun
                            value ? get_value_type_string(value->type) : "null");
         }
 
-        value = value_dup(value);
-
-        environment_pop_value(env);
+        environment_push_value(env, value);
         break;
 
     default:
         evaluator_expression(env, function_expr);
-        value = list_element(list_rbegin(env->stack), value_t, link);
+        value = environment_stack_top(env);
         if (value->type != VALUE_TYPE_FUNCTION && value->type != VALUE_TYPE_NATIVE_FUNCTION) {
             runtime_error("(%d, %d): called object type '%s' is not a function",
                            function_expr->line,
                            function_expr->column,
                            get_value_type_string(value->type));
         }
-        list_pop_back(env->stack);
         break;
     }
-
-    return value;
 }
 
 static value_t __evaluator_search_variable__(environment_t env, expression_t expr)
@@ -322,10 +604,7 @@ static value_t __evaluator_search_variable__(environment_t env, expression_t exp
 
     switch (expr->type) {
     case EXPRESSION_TYPE_IDENTIFIER:
-        environment_push_string(env, expr->u.identifier_expr);
-        value = __evaluator_search_identifier_variable__(env);
-        environment_pop_value(env);
-        return value;
+        return __evaluator_search_identifier_variable__(env, expr->u.identifier_expr);
 
     default:
         assert(false);
@@ -334,230 +613,179 @@ static value_t __evaluator_search_variable__(environment_t env, expression_t exp
     return NULL;
 }
 
-static value_t __evaluator_get_variable_lvalue__(environment_t env, cstring_t identifier)
+/*
+ * Sets *owner to the upvalue object holding the variable, if any, so a
+ * caller that allocates before storing can barrier it again.
+ */
+static value_t __evaluator_get_variable_lvalue__(environment_t env, expression_identifier_t identifier, object_t *owner)
 {
+    expression_slot_t slot;
     value_t value = NULL;
+    object_t upvalue;
+    frame_t frame;
+    int index;
 
-    environment_push_string(env, identifier);
-
-    value = __evaluator_search_identifier_variable__(env);
+    *owner = NULL;
 
-    if (!value) {
-        if (list_is_empty(env->local_context_stack)) {
-            value = value_new(VALUE_TYPE_NULL);
-            environment_push_value(env, value);
-            table_push_pair(environment_get_global_table(env), env);
-        } else {
-            local_context_t context = list_element(list_rbegin(env->local_context_stack), local_context_t, link);
-            value = value_new(VALUE_TYPE_NULL);
-            environment_push_value(env, value);
-            table_push_pair(context->object->u.table, env);
+    value = __evaluator_search_identifier_variable__(env, identifier);
+    if (value) {
+        /* the value may live in a closed upvalue, which is a heap object */
+        frame = environment_get_frame(env);
+
+        array_for_each(identifier->slots, slot, index) {
+            if (slot[index].upvalue) {
+                upvalue = frame->closure->u.function->upvalues[slot[index].index];
+                if (environment_upvalue_value(env, upvalue->u.upvalue) == value) {
+                    heap_barrier_object(env, upvalue);
+                    *owner = upvalue;
+                    break;
+                }
+            }
         }
 
-    } else {
-        environment_pop_value(env);
+        return value;
+    }
+
+    if (identifier->bind_local) {
+        slot  = array_base(identifier->slots, expression_slot_t);
+        value = environment_frame_slot(env, environment_get_frame(env), slot->index);
+        value->type = VALUE_TYPE_NULL;
+        return value;
     }
 
+    environment_push_string(env, identifier->symbol->name);
+
+    value = table_new_member(environment_get_global_table(env), environment_stack_top(env));
+
+    environment_pop_value(env);
+
     assert(value != NULL);
     return value;
 }
 
-static value_t __evaluator_index_expression__(environment_t env, expression_t expr)
+/*
+ * When owner is given the element is about to be stored to, and *owner is
+ * set to the container.
+ */
+static value_t __evaluator_index_expression__(environment_t env, expression_t expr, object_t *owner)
 {
-    value_t value = NULL;
     value_t elem = NULL;
-    value_t index_value = NULL;
 
     evaluator_expression(env, expr->u.index_expr->dict);
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
-
     evaluator_expression(env, expr->u.index_expr->index);
 
-    index_value = list_element(list_rbegin(env->stack), value_t, link);
-
-    switch (value->type) {
-    case VALUE_TYPE_ARRAY:
-        if (index_value->type != VALUE_TYPE_INT) {
-            runtime_error("(%d, %d): array indices must be integers", 
-                          expr->line, 
-                          expr->column);
-        }
-
-        if (index_value->u.int_value >= 0 && index_value->u.int_value < (int)array_length(value->u.object_value->u.array)) {
-            elem = *(value_t*)array_index(value->u.object_value->u.array, index_value->u.int_value);
-        } else {
-            environment_push_null(env);
-            elem = list_element(list_rbegin(env->stack), value_t, link);
-            list_pop_back(env->stack);
-            if (index_value->u.int_value == (int)array_length(value->u.object_value->u.array)) {
-                value_t *ptr = (value_t*)array_push(value->u.object_value->u.array);
-                *ptr = elem;
-            }
-        }
-        break;
+    elem = evaluator_index_value(env, expr->line, expr->column, environment_stack_top(env) - 1, environment_stack_top(env));
 
-    case VALUE_TYPE_TABLE:
-        elem = table_search_by_value(value->u.object_value->u.table, index_value);
-        if (!elem) {
-            environment_push_null(env);
-            elem = list_element(list_rbegin(env->stack), value_t, link);
-            table_push_pair(value->u.object_value->u.table, env);
-            environment_pop_value(env);
-            return elem;
-        }
-        break;
-
-    default:
-        runtime_error("(%d, %d): '%s' is not array/table", 
-                      expr->line,
-                      expr->column,
-                      get_value_type_string(value->type));
-        break;
+    if (owner) {
+        *owner = (environment_stack_top(env) - 1)->u.object_value;
+        heap_barrier_object(env, *owner);
     }
 
-    environment_pop_value(env);
-    environment_pop_value(env);
+    environment_pop_values(env, 2);
 
-    assert(elem != NULL);
     return elem;
 }
 
 static void __evaluator_array_push__(environment_t env, expression_t expr)
 {
-    value_t array_value = NULL;
-    value_t elem_value = NULL;
-    value_t *elem = NULL;
+    object_t array = NULL;
 
     evaluator_expression(env, expr->u.array_push_expr->array_expr);
 
-    array_value = list_element(list_rbegin(env->stack), value_t, link);
-
-    if (array_value->type != VALUE_TYPE_ARRAY) {
+    if (environment_stack_top(env)->type != VALUE_TYPE_ARRAY) {
         runtime_error("(%d, %d): '%s' is not array",
                       expr->line,
                       expr->column,
-                      get_value_type_string(array_value->type));
+                      get_value_type_string(environment_stack_top(env)->type));
     }
 
-    evaluator_expression(env, expr->u.array_push_expr->elem_expr);
+    array = environment_stack_top(env)->u.object_value;
 
-    elem_value = list_element(list_rbegin(env->stack), value_t, link);
-
-    elem = (value_t *) array_push(array_value->u.object_value->u.array);
+    evaluator_expression(env, expr->u.array_push_expr->elem_expr);
 
-    *elem = elem_value;
+    heap_barrier_object(env, array);
+    *(value_t) array_push(array->u.array) = *environment_stack_top(env);
 
-    list_pop_back(env->stack);
+    environment_pop_value(env);
 }
 
 static void __evaluator_array_pop__(environment_t env, expression_t expr)
 {
-    value_t array_value = NULL;
+    array_t array = NULL;
     value_t variable_value = NULL;
-    value_t elem_value = NULL;
-    value_t *elems = NULL;
+    object_t owner;
+    struct value_s elem_value;
 
     evaluator_expression(env, expr->u.array_push_expr->array_expr);
 
-    array_value = list_element(list_rbegin(env->stack), value_t, link);
-
-    if (array_value->type != VALUE_TYPE_ARRAY) {
+    if (environment_stack_top(env)->type != VALUE_TYPE_ARRAY) {
         runtime_error("(%d, %d): '%s' is not array",
                       expr->line,
                       expr->column,
-                      get_value_type_string(array_value->type));
+                      get_value_type_string(environment_stack_top(env)->type));
     }
 
+    array = environment_stack_top(env)->u.object_value->u.array;
 
-    if (array_length(array_value->u.object_value->u.array) == 0) {
-        list_pop_back(env->stack);
-
-        value_free(array_value);
+    if (array_length(array) == 0) {
+        environment_pop_value(env);
 
         environment_push_null(env);
 
         return;
-
-    } else {
-        elems = array_base(array_value->u.object_value->u.array, value_t*);
-
-        environment_push_value(env, elems[array_length(array_value->u.object_value->u.array) - 1]);
-
-        array_pop(array_value->u.object_value->u.array);
     }
 
-    variable_value = __evaluator_get_lvalue__(env, expr->u.array_pop_expr->lvalue_expr);
+    elem_value = array_base(array, value_t)[array_length(array) - 1];
 
-    elem_value = list_element(list_rbegin(env->stack), value_t, link);
+    heap_barrier(env, &elem_value);
+    array_pop(array);
 
-    list_pop_back(env->stack);
+    /* the popped element stays reachable through the stack */
+    environment_push_value(env, &elem_value);
 
-    *variable_value = *elem_value;
-  
-    value_free(elem_value);
+    variable_value = __evaluator_get_lvalue__(env, expr->u.array_pop_expr->lvalue_expr, &owner);
 
-    list_pop_back(env->stack);
+    heap_barrier(env, variable_value);
+    *variable_value = *environment_stack_top(env);
 
-    value_free(array_value);
+    environment_pop_values(env, 2);
 
-    environment_push_value(env, value_dup(variable_value));
+    environment_push_value(env, variable_value);
 }
 
-static value_t __evaluator_table_dot_member__(environment_t env, expression_t expr)
+static value_t __evaluator_table_dot_member__(environment_t env, expression_t expr, object_t *owner)
 {
-    value_t table_value;
-    value_t member_name_value;
     value_t elem;
 
-    environment_push_string(env, expr->u.table_dot_member_expr->member_name);
-
-    member_name_value = list_element(list_rbegin(env->stack), value_t, link);
-
-    evaluator_expression(env, expr->u.table_dot_member_expr->table_expr);
-
-    table_value = list_element(list_rbegin(env->stack), value_t, link);
-
-    if (table_value->type != VALUE_TYPE_TABLE) {
-        runtime_error("(%d, %d) '%s' object has no member\n",
-                      expr->line,
-                      expr->column,
-                      get_value_type_string(table_value->type));
-    }
-
-    elem = table_search_by_value(table_value->u.object_value->u.table, member_name_value);
-    if (elem) {
-        environment_pop_value(env);
-
-    } else {
-        environment_xchg_stack(env);
+    evaluator_expression(env, expr->u.table_dot_member_expr->table_expr);
 
-        environment_push_null(env);
+    elem = evaluator_member_value(env, expr->line, expr->column, environment_stack_top(env), expr->u.table_dot_member_expr->member_name);
 
-        elem = list_element(list_rbegin(env->stack), value_t, link);
-        
-        table_push_pair(table_value->u.object_value->u.table, env);
+    if (owner) {
+        *owner = environment_stack_top(env)->u.object_value;
+        heap_barrier_object(env, *owner);
     }
 
     environment_pop_value(env);
     return elem;
 }
 
-static value_t __evaluator_get_lvalue__(environment_t env, expression_t expr)
+static value_t __evaluator_get_lvalue__(environment_t env, expression_t expr, object_t *owner)
 {
     value_t value = NULL;
  
     switch (expr->type) {
     case EXPRESSION_TYPE_IDENTIFIER:
-        value = __evaluator_get_variable_lvalue__(env, expr->u.identifier_expr);
+        value = __evaluator_get_variable_lvalue__(env, expr->u.identifier_expr, owner);
         break;
 
     case EXPRESSION_TYPE_INDEX:
-        value = __evaluator_index_expression__(env, expr);
+        value = __evaluator_index_expression__(env, expr, owner);
         break;
 
     case EXPRESSION_TYPE_TABLE_DOT_MEMBER:
-        value = __evaluator_table_dot_member__(env, expr);
+        value = __evaluator_table_dot_member__(env, expr, owner);
         break;
 
     default:
@@ -569,19 +797,20 @@ static value_t __evaluator_get_lvalue__(environment_t env, expression_t expr)
 
 static void __evaluator_call_expression__(environment_t env, expression_t call_expr)
 {
-    value_t function_value;
+    struct value_s function_value;
 
-    function_value = __evaluator_search_function__(env, call_expr->u.call_expr->function_expr);
+    __evaluator_search_function__(env, call_expr->u.call_expr->function_expr);
 
-    environment_push_value(env, function_value);
+    /* the callee stays on the stack while it runs, which keeps it alive */
+    function_value = *environment_stack_top(env);
 
-    switch (function_value->type) {
+    switch (function_value.type) {
     case VALUE_TYPE_FUNCTION:
-        __evaluator_function_call_expression__(env, function_value, call_expr->u.call_expr->args);
+        __evaluator_function_call_expression__(env, &function_value, call_expr->u.call_expr->args);
         break;
 
     case VALUE_TYPE_NATIVE_FUNCTION:
-        __evaluator_native_function_call_expression__(env, function_value, call_expr->u.call_expr->args);
+        __evaluator_native_function_call_expression__(env, &function_value, call_expr->u.call_expr->args);
         break;
     }
 
@@ -592,47 +821,39 @@ static void __evaluator_call_expression__(environment_t env, expression_t call_e
 static void __evaluator_function_call_expression__(environment_t env, value_t function_value, list_t args)
 {
     list_iter_t iter;
-    list_iter_t args_iter;
     statement_t stmt;
-    object_t object;
+    frame_t frame;
+    value_t slots;
+    value_t argv;
     executor_result_t result = EXECUTOR_RESULT_NORMAL;
     expression_function_t function;
-    int scopecount = 0;
+    unsigned long argc = 0;
+    unsigned long index = 0;
 
-    // old context shouldn't interfere with function body evaluation
-    environment_push_context_frame(env);
+    function = function_value->u.object_value->u.function->f.function_expr;
 
-    list_for_each(function_value->u.object_value->u.function->scopes, iter) {
-        object = list_element(iter, object_t, link_scope);
-        environment_push_scope_local_context(env, object);
-        scopecount++;
+    /* arguments are evaluated in the caller's frame */
+    list_for_each(args, iter) {
+        evaluator_expression(env, list_element(iter, expression_t, link));
+        argc++;
     }
 
-    environment_push_local_context(env);
-
-    function = function_value->u.object_value->u.function->f.function_expr;
+    frame = environment_push_frame(env, function_value->u.object_value, function->frame_size);
 
-    args_iter = list_begin(args);
+    slots = environment_frame_slot(env, frame, 0);
+    argv  = environment_stack_at(env, environment_stack_size(env) - argc);
 
     list_for_each(function->parameters, iter) {
-        expression_function_parameter_t parameter;
-
-        parameter = list_element(iter, expression_function_parameter_t, link);
-
-        environment_push_string(env, parameter->name);
-
-        if (args_iter == NULL) {
-            environment_push_null(env);
-
+        if (index < argc) {
+            slots[index] = argv[index];
         } else {
-            expression_t expr = list_element(args_iter, expression_t, link);
-            evaluator_expression(env, expr);
-            args_iter = list_next(args, args_iter);
+            slots[index].type = VALUE_TYPE_NULL;
         }
-
-        table_push_pair(list_element(list_rbegin(env->local_context_stack), local_context_t, link)->object->u.table, env);
+        index++;
     }
 
+    environment_pop_values(env, argc);
+
     list_for_each(function->block, iter) {
         stmt = list_element(iter, statement_t, link);
         result = executor_statement(env, stmt);
@@ -651,13 +872,9 @@ static void __evaluator_function_call_expression__(environment_t env, value_t fu
         environment_push_null(env);
     }
 
-    while (scopecount--) {
-        environment_pop_local_context(env);
-    }
-
-    environment_pop_local_context(env);
+    environment_close_upvalues(env, 0);
 
-    environment_pop_context_frame(env);
+    environment_pop_frame(env);
 }
 
 static void __evaluator_native_function_call_expression__(environment_t env, value_t function_value, list_t args)
@@ -665,49 +882,49 @@ static void __evaluator_native_function_call_expression__(environment_t env, val
     list_iter_t iter;
     expression_t expr;
     native_function_pt native_function;
-    value_t  elem = NULL;
-    value_t* v = NULL;
-    value_t  array = NULL;
+    object_t array = NULL;
 
     native_function = function_value->u.object_value->u.function->f.native_function;
 
     environment_push_array(env);
 
-    array = list_element(list_rbegin(env->stack), value_t, link);
+    array = environment_stack_top(env)->u.object_value;
 
     list_for_each(args, iter) {
         expr = list_element(iter, expression_t, link);
 
         evaluator_expression(env, expr);
 
-        elem = list_element(list_rbegin(env->stack), value_t, link);
+        /* evaluating an argument may have promoted the array */
+        heap_barrier_object(env, array);
+        *(value_t) array_push(array->u.array) = *environment_stack_top(env);
 
-        list_pop_back(env->stack);
-
-        v = (value_t*) array_push(array->u.object_value->u.array);
-
-        *v = elem;
+        environment_pop_value(env);
     }
    
-    native_function(env, (unsigned int) array_length(array->u.object_value->u.array));
+    native_function(env, (unsigned int) array_length(array->u.array));
 }
 
 static void __evaluator_assign_expression__(environment_t env, expression_type_t type, expression_t lvalue_expr, expression_t rvalue_expr)
 {
     value_t rvalue;
     value_t lvalue;
+    object_t owner;
 
     evaluator_expression(env, rvalue_expr);
 
-    rvalue = list_element(list_rbegin(env->stack), value_t, link);
+    lvalue = __evaluator_get_lvalue__(env, lvalue_expr, &owner);
 
-    lvalue = __evaluator_get_lvalue__(env, lvalue_expr);
+    /* computing the lvalue may have grown the stack */
+    rvalue = environment_stack_top(env);
 
-    __evaluator_do_assign_expression__(env, lvalue_expr->line, lvalue_expr->column, type, lvalue, rvalue);
+    __evaluator_do_assign_expression__(env, lvalue_expr->line, lvalue_expr->column, type, lvalue, rvalue, owner);
 }
 
-static void __evaluator_do_assign_expression__(environment_t env, long line, long column, expression_type_t type, value_t left, value_t right)
+static void __evaluator_do_assign_expression__(environment_t env, long line, long column, expression_type_t type, value_t left, value_t right, object_t owner)
 {
+    heap_barrier(env, left);
+
     switch (type) {
     case EXPRESSION_TYPE_ASSIGN:
         *left = *right;
@@ -763,238 +980,169 @@ static void __evaluator_do_assign_expression__(environment_t env, long line, lon
 
     environment_xchg_stack(env);
     environment_pop_value(env);
-    right = list_element(list_rbegin(env->stack), value_t, link);
+    right = environment_stack_top(env);
+
+    /* a minor collection in the operator forgets what was remembered */
+    if (owner) {
+        heap_barrier_object(env, owner);
+    }
     *left = *right;
 }
 
 static void __evaluator_unary_expression__(environment_t env, expression_t expr)
 {
-    value_t operand;
-
     assert(expr->type == EXPRESSION_TYPE_PLUS || expr->type == EXPRESSION_TYPE_MINUS ||
            expr->type == EXPRESSION_TYPE_CPL || expr->type == EXPRESSION_TYPE_NOT);
 
     evaluator_expression(env, expr->u.unary_expr);
 
-    operand = list_element(list_rbegin(env->stack), value_t, link);
+    evaluator_unary_value(env, expr->line, expr->column, expr->type, environment_stack_top(env));
+}
 
-    switch (operand->type) {
-    case VALUE_TYPE_BOOL:
-        switch (expr->type) {
-        case EXPRESSION_TYPE_NOT:
-            operand->u.bool_value = !operand->u.bool_value;
-            break;
-        default:
-            runtime_error("(%d, %d): unsupport %s(%s)", 
-                          expr->line, 
-                          expr->column,
-                          get_expression_type_string(expr->type),
-                          get_value_type_string(operand->type));
-        }
-        break;
+static void __evaluator_inc_dec_expression__(environment_t env, expression_t expr)
+{
+    value_t operand;
+    object_t owner;
 
-    case VALUE_TYPE_CHAR:
-        switch (expr->type) {
-        case EXPRESSION_TYPE_PLUS:
-            break;
-        case EXPRESSION_TYPE_MINUS:
-            operand->u.bool_value = -operand->u.bool_value;
-            break;
-        case EXPRESSION_TYPE_CPL:
-            operand->u.bool_value = ~operand->u.bool_value;
-            break;
-        default:
-            runtime_error("(%d, %d): unsupport %s(%s)", 
-                          expr->line, 
-                          expr->column,
-                          get_expression_type_string(expr->type),
-                          get_value_type_string(operand->type));
-        }
-        break;
+    assert(expr->type == EXPRESSION_TYPE_INC || expr->type == EXPRESSION_TYPE_DEC);
 
-    case VALUE_TYPE_INT:
-        switch (expr->type) {
-        case EXPRESSION_TYPE_PLUS:
-            break;
-        case EXPRESSION_TYPE_MINUS:
-            operand->u.int_value = -operand->u.int_value;
-            break;
-        case EXPRESSION_TYPE_CPL:
-            operand->u.int_value = ~operand->u.int_value;
-            break;
-        default:
-            runtime_error("(%d, %d): unsupport %s(%s)", 
-                          expr->line, 
-                          expr->column,
-                          get_expression_type_string(expr->type),
-                          get_value_type_string(operand->type));
-        }
-        break;
+    operand = __evaluator_get_lvalue__(env, expr->u.unary_expr, &owner);
 
-    case VALUE_TYPE_LONG:
-        switch (expr->type) {
-        case EXPRESSION_TYPE_PLUS:
-            break;
-        case EXPRESSION_TYPE_MINUS:
-            operand->u.long_value = -operand->u.long_value;
-            break;
-        case EXPRESSION_TYPE_CPL:
-            operand->u.long_value = ~operand->u.long_value;
-            break;
-        default:
-            runtime_error("(%d, %d): unsupport %s(%s)", 
-                          expr->line, 
-                          expr->column,
-                          get_expression_type_string(expr->type),
-                          get_value_type_string(operand->type));
-        }
-        break;
+    evaluator_incdec_value(env, expr->line, expr->column, expr->type, operand);
 
-    case VALUE_TYPE_FLOAT:
-        switch (expr->type) {
-        case EXPRESSION_TYPE_PLUS:
-            break;
-        case EXPRESSION_TYPE_MINUS:
-            operand->u.float_value = -operand->u.float_value;
-            break;
-        default:
-            runtime_error("(%d, %d): unsupport %s(%s)", 
-                          expr->line, 
-                          expr->column,
-                          get_expression_type_string(expr->type),
-                          get_value_type_string(operand->type));
+    environment_push_value(env, operand);
+}
+
+static void __evaluator_binary_expression__(environment_t env, expression_t expr)
+{
+    expression_binary_t binary_expr = expr->u.binary_expr;
+    value_t left_value;
+    value_t right_value;
+    value_t result;
+
+    evaluator_expression(env, binary_expr->left);
+    evaluator_expression(env, binary_expr->right);
+
+    left_value  = environment_stack_top(env) - 1;
+    right_value = environment_stack_top(env);
+
+    /*
+     * A node that has only seen ints computes in place and skips the
+     * implicit cast; the first other pair sends it to the generic path
+     * for good.
+     */
+    switch (binary_expr->quicken) {
+    case EXPRESSION_QUICKEN_INT:
+        if (left_value->type == VALUE_TYPE_INT && right_value->type == VALUE_TYPE_INT) {
+            __evaluator_int_binary_quick__(expr->type, left_value, right_value);
+            environment_pop_values(env, 1);
+            return;
         }
+        binary_expr->quicken = EXPRESSION_QUICKEN_GENERIC;
         break;
 
-    case VALUE_TYPE_DOUBLE:
-        switch (expr->type) {
-        case EXPRESSION_TYPE_PLUS:
-            break;
-        case EXPRESSION_TYPE_MINUS:
-            operand->u.double_value = -operand->u.double_value;
-            break;
-        default:
-            runtime_error("(%d, %d): unsupport %s(%s)", 
-                          expr->line, 
-                          expr->column,
-                          get_expression_type_string(expr->type),
-                          get_value_type_string(operand->type));
+    case EXPRESSION_QUICKEN_UNSEEN:
+        if (left_value->type == VALUE_TYPE_INT && right_value->type == VALUE_TYPE_INT) {
+            binary_expr->quicken = EXPRESSION_QUICKEN_INT;
+        } else {
+            binary_expr->quicken = EXPRESSION_QUICKEN_GENERIC;
         }
         break;
 
     default:
-        runtime_error("(%d, %d): unsupport %s(%s)", 
-                      expr->line, 
-                      expr->column,
-                      get_expression_type_string(expr->type),
-                      get_value_type_string(operand->type));
         break;
     }
+
+    evaluator_binary_value(env, binary_expr->left->line, binary_expr->left->column, expr->type, left_value, right_value);
+
+    /* replace both operands with the result */
+    result = environment_stack_top(env);
+    result[-2] = result[0];
+    environment_pop_values(env, 2);
 }
 
-static void __evaluator_inc_dec_expression__(environment_t env, expression_t expr)
+/* the int/int cases of __evaluator_int_binary_expression__, into left */
+static void __evaluator_int_binary_quick__(expression_type_t type, value_t left, value_t right)
 {
-    value_t operand;
+    switch (type) {
+    case EXPRESSION_TYPE_BITAND:
+        left->u.int_value &= right->u.int_value;
+        break;
 
-    assert(expr->type == EXPRESSION_TYPE_INC || expr->type == EXPRESSION_TYPE_DEC);
+    case EXPRESSION_TYPE_BITOR:
+        left->u.int_value |= right->u.int_value;
+        break;
 
-    operand = __evaluator_get_lvalue__(env, expr->u.unary_expr);
+    case EXPRESSION_TYPE_XOR:
+        left->u.int_value ^= right->u.int_value;
+        break;
 
-    switch (operand->type) {
-    case VALUE_TYPE_CHAR:
-        switch (expr->type) {
-        case EXPRESSION_TYPE_INC:
-            operand->u.char_value++;
-            break;
-        case EXPRESSION_TYPE_DEC:
-            operand->u.char_value--;
-            break;
-        default:
-            assert(false);
-            break;
-        }
+    case EXPRESSION_TYPE_LEFT_SHIFT:
+        left->u.int_value <<= right->u.int_value;
         break;
-    case VALUE_TYPE_INT:
-        switch (expr->type) {
-        case EXPRESSION_TYPE_INC:
-            operand->u.int_value++;
-            break;
-        case EXPRESSION_TYPE_DEC:
-            operand->u.int_value--;
-            break;
-        default:
-            assert(false);
-            break;
-        }
+
+    case EXPRESSION_TYPE_RIGHT_SHIFT:
+        left->u.int_value >>= right->u.int_value;
         break;
-    case VALUE_TYPE_LONG:
-        switch (expr->type) {
-        case EXPRESSION_TYPE_INC:
-            operand->u.long_value++;
-            break;
-        case EXPRESSION_TYPE_DEC:
-            operand->u.long_value--;
-            break;
-        default:
-            assert(false);
-            break;
-        }
+
+    case EXPRESSION_TYPE_LOGIC_RIGHT_SHIFT:
+        left->u.int_value = (int)((unsigned int)left->u.int_value >> (unsigned int)right->u.int_value);
         break;
-    case VALUE_TYPE_FLOAT:
-        switch (expr->type) {
-        case EXPRESSION_TYPE_INC:
-            operand->u.float_value++;
-            break;
-        case EXPRESSION_TYPE_DEC:
-            operand->u.float_value--;
-            break;
-        default:
-            assert(false);
-            break;
-        }
+
+    case EXPRESSION_TYPE_ADD:
+        left->u.int_value += right->u.int_value;
         break;
-    case VALUE_TYPE_DOUBLE:
-        switch (expr->type) {
-        case EXPRESSION_TYPE_INC:
-            operand->u.double_value++;
-            break;
-        case EXPRESSION_TYPE_DEC:
-            operand->u.double_value--;
-            break;
-        default:
-            assert(false);
-            break;
-        }
+
+    case EXPRESSION_TYPE_SUB:
+        left->u.int_value -= right->u.int_value;
         break;
-    default:
-        runtime_error("(%d, %d): unsupport %s(%s)", 
-                      expr->line, 
-                      expr->column,
-                      get_expression_type_string(expr->type),
-                      get_value_type_string(operand->type));
+
+    case EXPRESSION_TYPE_MUL:
+        left->u.int_value *= right->u.int_value;
         break;
-    }
 
-    list_push_back(env->stack, value_dup(operand)->link);
-}
+    case EXPRESSION_TYPE_DIV:
+        left->u.int_value = right->u.int_value == 0 ? 0 : left->u.int_value / right->u.int_value;
+        break;
 
-static void __evaluator_binary_expression__(environment_t env, expression_type_t type, expression_t left_expr, expression_t right_expr)
-{
-    value_t left_value;
-    value_t right_value;
+    case EXPRESSION_TYPE_MOD:
+        left->u.int_value = right->u.int_value == 0 ? 0 : left->u.int_value % right->u.int_value;
+        break;
 
-    evaluator_expression(env, left_expr);
-    left_value  = list_element(list_rbegin(env->stack), value_t, link);
-    evaluator_expression(env, right_expr);
-    right_value = list_element(list_rbegin(env->stack), value_t, link);
+    case EXPRESSION_TYPE_GT:
+        left->u.bool_value = left->u.int_value > right->u.int_value;
+        left->type         = VALUE_TYPE_BOOL;
+        break;
+
+    case EXPRESSION_TYPE_GEQ:
+        left->u.bool_value = left->u.int_value >= right->u.int_value;
+        left->type         = VALUE_TYPE_BOOL;
+        break;
+
+    case EXPRESSION_TYPE_LT:
+        left->u.bool_value = left->u.int_value < right->u.int_value;
+        left->type         = VALUE_TYPE_BOOL;
+        break;
 
-    evaluator_binary_value(env, left_expr->line, left_expr->column, type, left_value, right_value);
+    case EXPRESSION_TYPE_LEQ:
+        left->u.bool_value = left->u.int_value <= right->u.int_value;
+        left->type         = VALUE_TYPE_BOOL;
+        break;
+
+    case EXPRESSION_TYPE_EQ:
+        left->u.bool_value = left->u.int_value == right->u.int_value;
+        left->type         = VALUE_TYPE_BOOL;
+        break;
 
-    list_erase(env->stack, left_value->link);
-    value_free(left_value);
+    case EXPRESSION_TYPE_NEQ:
+        left->u.bool_value = left->u.int_value != right->u.int_value;
+        left->type         = VALUE_TYPE_BOOL;
+        break;
 
-    list_erase(env->stack, right_value->link);
-    value_free(right_value);
+    default:
+        assert(false);
+        break;
+    }
 }
 
 static value_type_t __evaluator_implicit_cast_expression__(value_t left_value, value_t right_value)
@@ -1031,6 +1179,14 @@ static value_type_t __evaluator_implicit_cast_expression__(value_t left_value, v
     } else if (left_value->type == VALUE_TYPE_LONG && right_value->type == VALUE_TYPE_LONG) {
         return VALUE_TYPE_LONG;
 
+    } else if (left_value->type == VALUE_TYPE_LONG && right_value->type == VALUE_TYPE_INT) {
+        right_value->u.long_value = (long)right_value->u.int_value;
+        return VALUE_TYPE_LONG;
+
+    } else if (left_value->type == VALUE_TYPE_INT && right_value->type == VALUE_TYPE_LONG) {
+        left_value->u.long_value = (long)left_value->u.int_value;
+        return VALUE_TYPE_LONG;
+
     } else if (left_value->type == VALUE_TYPE_FLOAT && right_value->type == VALUE_TYPE_LONG) {
         right_value->u.float_value = (float)right_value->u.long_value;
         return VALUE_TYPE_FLOAT;
@@ -1090,11 +1246,10 @@ static value_type_t __evaluator_implicit_cast_expression__(value_t left_value, v
 
 static void __evaluator_char_binary_expression__(environment_t env, long line, long column, expression_type_t type, value_t left, value_t right)
 {
-    value_t result;
+    struct value_s value;
+    value_t result = &value;
 
-    environment_push_null(env);
-
-    result = list_element(list_rbegin(env->stack), value_t, link);
+    result->type = VALUE_TYPE_NULL;
 
     if (__is_math_operator__(type)) {
         result->type = VALUE_TYPE_CHAR;
@@ -1197,15 +1352,17 @@ static void __evaluator_char_binary_expression__(environment_t env, long line, l
         result->type = VALUE_TYPE_NULL;
         break;
     }
+
+    environment_push_value(env, result);
 }
 
 static void __evaluator_bool_binary_expression__(environment_t env, long line, long column, expression_type_t type, value_t left, value_t right)
 {
-    value_t result;
-
-    environment_push_bool(env, false);
+    struct value_s value;
+    value_t result = &value;
 
-    result = list_element(list_rbegin(env->stack), value_t, link);
+    result->type = VALUE_TYPE_BOOL;
+    result->u.bool_value = false;
 
     if (type == EXPRESSION_TYPE_EQ) {
         result->u.bool_value = left->u.bool_value == right->u.bool_value;
@@ -1221,15 +1378,16 @@ static void __evaluator_bool_binary_expression__(environment_t env, long line, l
                       get_expression_type_string(type),
                       get_value_type_string(right->type));
     }
+
+    environment_push_value(env, result);
 }
 
 static void __evaluator_int_binary_expression__(environment_t env, long line, long column, expression_type_t type, value_t left, value_t right)
 {
-    value_t result;
+    struct value_s value;
+    value_t result = &value;
 
-    environment_push_null(env);
-
-    result = list_element(list_rbegin(env->stack), value_t, link);
+    result->type = VALUE_TYPE_NULL;
 
     if (__is_math_operator__(type)) {
         result->type = VALUE_TYPE_INT;
@@ -1332,15 +1490,16 @@ static void __evaluator_int_binary_expression__(environment_t env, long line, lo
         result->type = VALUE_TYPE_NULL;
         break;
     }
+
+    environment_push_value(env, result);
 }
 
 static void __evaluator_long_binary_expression__(environment_t env, long line, long column, expression_type_t type, value_t left, value_t right)
 {
-    value_t result;
-
-    environment_push_null(env);
+    struct value_s value;
+    value_t result = &value;
 
-    result = list_element(list_rbegin(env->stack), value_t, link);
+    result->type = VALUE_TYPE_NULL;
 
     if (__is_math_operator__(type)) {
         result->type = VALUE_TYPE_LONG;
@@ -1443,15 +1602,16 @@ static void __evaluator_long_binary_expression__(environment_t env, long line, l
         result->type = VALUE_TYPE_NULL;
         break;
     }
+
+    environment_push_value(env, result);
 }
 
 static void __evaluator_float_binary_expression__(environment_t env, long line, long column, expression_type_t type, value_t left, value_t right)
 {
-    value_t result;
+    struct value_s value;
+    value_t result = &value;
 
-    environment_push_null(env);
-
-    result = list_element(list_rbegin(env->stack), value_t, link);
+    result->type = VALUE_TYPE_NULL;
 
     if (__is_math_operator__(type)) {
         result->type = VALUE_TYPE_FLOAT;
@@ -1517,15 +1677,16 @@ static void __evaluator_float_binary_expression__(environment_t env, long line,
         result->type = VALUE_TYPE_NULL;
         break;
     }
+
+    environment_push_value(env, result);
 }
 
 static void __evaluator_double_binary_expression__(environment_t env, long line, long column, expression_type_t type, value_t left, value_t right)
 {
-    value_t result;
-
-    environment_push_null(env);
+    struct value_s value;
+    value_t result = &value;
 
-    result = list_element(list_rbegin(env->stack), value_t, link);
+    result->type = VALUE_TYPE_NULL;
 
     if (__is_math_operator__(type)) {
         result->type = VALUE_TYPE_DOUBLE;
@@ -1591,15 +1752,16 @@ static void __evaluator_double_binary_expression__(environment_t env, long line,
         result->type = VALUE_TYPE_NULL;
         break;
     }
+
+    environment_push_value(env, result);
 }
 
 static void __evaluator_string_binary_expression__(environment_t env, long line, long column, expression_type_t type, value_t left, value_t right)
 {
-    value_t result;
+    struct value_s value;
+    value_t result = &value;
 
-    environment_push_null(env);
-    
-    result = list_element(list_rbegin(env->stack), value_t, link);
+    result->type = VALUE_TYPE_NULL;
 
     if (type == EXPRESSION_TYPE_ADD) {
         result->u.object_value           = heap_alloc_string_n(env, cstring_length(left->u.object_value->u.string) + cstring_length(right->u.object_value->u.string) + 10);
@@ -1651,15 +1813,16 @@ static void __evaluator_string_binary_expression__(environment_t env, long line,
         result->type = VALUE_TYPE_NULL;
         break;
     }
+
+    environment_push_value(env, result);
 }
 
 static void __evaluator_null_binary_expression__(environment_t env, long line, long column, expression_type_t type, value_t left, value_t right)
 {
-    value_t result;
-
-    environment_push_null(env);
+    struct value_s value;
+    value_t result = &value;
 
-    result = list_element(list_rbegin(env->stack), value_t, link);
+    result->type = VALUE_TYPE_NULL;
 
     if (type == EXPRESSION_TYPE_EQ || type == EXPRESSION_TYPE_NEQ) {
         result->type = VALUE_TYPE_BOOL;
@@ -1684,37 +1847,40 @@ static void __evaluator_null_binary_expression__(environment_t env, long line, l
         result->type = VALUE_TYPE_NULL;
         break;
     }
+
+    environment_push_value(env, result);
 }
 
 static void __evaluator_logic_binary_expression__(environment_t env, expression_type_t type, expression_t left_expr, expression_t right_expr)
 {
-    value_t lvalue = NULL;
-    value_t rvalue = NULL;
+    struct value_s lvalue;
+    struct value_s rvalue;
 
     evaluator_expression(env, left_expr);
 
-    lvalue = list_element(list_rbegin(env->stack), value_t, link);
-    list_pop_back(env->stack);
+    lvalue = *environment_stack_top(env);
+    environment_pop_value(env);
 
-    if (lvalue->type != VALUE_TYPE_BOOL) {
+    if (lvalue.type != VALUE_TYPE_BOOL) {
         runtime_error("(%d, %d): unsupported operand for : type(%s) %s", 
                       left_expr->line,
                       left_expr->column,
-                      get_value_type_string(lvalue->type),
+                      get_value_type_string(lvalue.type),
                       get_expression_type_string(type));
     }
 
     switch (type) {
     case EXPRESSION_TYPE_AND:
-        if (lvalue->u.bool_value == false) {
-            goto eval_success;
+        if (lvalue.u.bool_value == false) {
+            environment_push_bool(env, false);
+            return;
         }
         break;
 
     case EXPRESSION_TYPE_OR:
-        if (lvalue->u.bool_value == true) {
+        if (lvalue.u.bool_value == true) {
             environment_push_bool(env, true);
-            goto eval_success;
+            return;
         }
         break;
 
@@ -1725,27 +1891,19 @@ static void __evaluator_logic_binary_expression__(environment_t env, expression_
 
     evaluator_expression(env, right_expr);
 
-    rvalue = list_element(list_rbegin(env->stack), value_t, link);
-    list_pop_back(env->stack);
+    rvalue = *environment_stack_top(env);
+    environment_pop_value(env);
 
-    if (rvalue->type != VALUE_TYPE_BOOL) {
+    if (rvalue.type != VALUE_TYPE_BOOL) {
         runtime_error("(%d, %d): unsupported operand for : type(%s) %s type(%s)", 
                       left_expr->line,
                       left_expr->column,
-                      get_value_type_string(lvalue->type),
+                      get_value_type_string(lvalue.type),
                       get_expression_type_string(type),
-                      get_value_type_string(rvalue->type));
+                      get_value_type_string(rvalue.type));
     }
 
-    environment_push_bool(env, rvalue->u.bool_value);
-
-eval_success:
-    if (lvalue) {
-        value_free(lvalue);
-    }
-    if (rvalue) {
-        value_free(rvalue);
-    }
+    environment_push_bool(env, rvalue.u.bool_value);
 }
 
 const char* get_expression_type_string(expression_type_t type)
@@ -7,7 +7,13 @@
 
 void evaluator_expression(environment_t env, expression_t expr);
 void evaluator_binary_value(environment_t env, long line, long column, expression_type_t type, value_t left, value_t right);
-value_t evaluator_get_lvalue(environment_t env, expression_t expr);
+value_t evaluator_get_lvalue(environment_t env, expression_t expr, object_t *owner);
+value_t evaluator_search_identifier(environment_t env, expression_identifier_t identifier);
+value_t evaluator_identifier_lvalue(environment_t env, expression_identifier_t identifier);
+value_t evaluator_index_value(environment_t env, long line, long column, value_t dict, value_t index);
+value_t evaluator_member_value(environment_t env, long line, long column, value_t table_value, symbol_t member_name);
+void evaluator_unary_value(environment_t env, long line, long column, expression_type_t type, value_t operand);
+void evaluator_incdec_value(environment_t env, long line, long column, expression_type_t type, value_t operand);
 const char* get_expression_type_string(expression_type_t type);
 const char* get_value_type_string(value_type_t type);
 
@@ -2,13 +2,18 @@
 
 #include "executor.h"
 #include "environment.h"
+#include "table.h"
 #include "statement.h"
 #include "evaluator.h"
 #include "error.h"
 #include "alloc.h"
+#include "heap.h"
 #include "parser.h"
+#include "resolver.h"
+#include "optimizer.h"
 #include "lexer.h"
 #include "source_code.h"
+#include "vm.h"
 
 #include <assert.h>
 
@@ -24,6 +29,9 @@ static executor_result_t __executor_for_statement__(environment_t env, statement
 static executor_result_t __executor_foreach_statement__(environment_t env, statement_t stmt);
 static executor_result_t __executor_while_statement__(environment_t env, statement_t stmt);
 static executor_result_t __executor_block_statement__(environment_t env, list_t block);
+static void              __executor_enter_scope__(environment_t env, statement_t stmt);
+static void              __executor_leave_scope__(environment_t env, statement_t stmt);
+static value_t           __executor_foreach_lvalue__(environment_t env, expression_t lvalue_expr, value_t lvalue, object_t *owner);
 
 executor_t executor_new(environment_t env)
 {
@@ -55,6 +63,13 @@ void executor_run(executor_t exec)
 
     stmts = stack_element(stack_pop(env->statement_stack), statements_t, link);
 
+    if (env->engine == ENGINE_VM) {
+        vm_run(env, stmts);
+        return;
+    }
+
+    environment_push_frame(env, NULL, stmts->frame_size);
+
     list_for_each(stmts->stmts, iter) {
         stmt = list_element(iter, statement_t, link);
         switch (executor_statement(env, stmt)) {
@@ -71,6 +86,10 @@ void executor_run(executor_t exec)
             break;
         }
     }
+
+    environment_close_upvalues(env, 0);
+
+    environment_pop_frame(env);
 }
 
 executor_result_t executor_statement(environment_t env, statement_t stmt)
@@ -87,33 +106,33 @@ executor_result_t executor_statement(environment_t env, statement_t stmt)
         return EXECUTOR_RESULT_NORMAL;
 
     case STATEMENT_TYPE_IF:
-        environment_push_local_context(env);
+        __executor_enter_scope__(env, stmt);
         result = __executor_if_statement__(env, stmt);
-        environment_pop_local_context(env);
+        __executor_leave_scope__(env, stmt);
         return result;
 
     case STATEMENT_TYPE_SWITCH:
-        environment_push_local_context(env);
+        __executor_enter_scope__(env, stmt);
         result = __executor_switch_statement__(env, stmt);
-        environment_pop_local_context(env);
+        __executor_leave_scope__(env, stmt);
         return result;
 
     case STATEMENT_TYPE_WHILE:
-        environment_push_local_context(env);
+        __executor_enter_scope__(env, stmt);
         result = __executor_while_statement__(env, stmt);
-        environment_pop_local_context(env);
+        __executor_leave_scope__(env, stmt);
         return result;
 
     case STATEMENT_TYPE_FOR:
-        environment_push_local_context(env);
+        __executor_enter_scope__(env, stmt);
         result = __executor_for_statement__(env, stmt);
-        environment_pop_local_context(env);
+        __executor_leave_scope__(env, stmt);
         return result;
     
     case STATEMENT_TYPE_FOREACH:
-        environment_push_local_context(env);
+        __executor_enter_scope__(env, stmt);
         result = __executor_foreach_statement__(env, stmt);
-        environment_pop_local_context(env);
+        __executor_leave_scope__(env, stmt);
         return result;
 
     case STATEMENT_TYPE_CONTINUE:
@@ -137,7 +156,7 @@ executor_result_t executor_statement(environment_t env, statement_t stmt)
     return EXECUTOR_RESULT_NORMAL;
 }
 
-static executor_result_t __executor_require_statement__(environment_t env, statement_t stmt)
+void executor_require(environment_t env, cstring_t package_name)
 {
     source_code_t sc;
     lexer_t       lex;
@@ -146,7 +165,7 @@ static executor_result_t __executor_require_statement__(environment_t env, state
     executor_t    executor;
     cstring_t     package;
 
-    package = cstring_dup(stmt->u.package_name);
+    package = cstring_dup(package_name);
 
     if (environment_has_package(env, package)) {
         goto leave;
@@ -165,6 +184,10 @@ static executor_result_t __executor_require_statement__(environment_t env, state
 
     module = parser_generate_module(parse);
 
+    optimizer_optimize_module(module, env->verbose);
+
+    resolver_resolve_module(module);
+
     environment_add_module(env, module);
 
     executor_run((executor = executor_new(env)));
@@ -177,12 +200,34 @@ static executor_result_t __executor_require_statement__(environment_t env, state
 
     source_code_free(sc);
 
-    environment_add_package(env, cstring_dup(stmt->u.package_name));
+    environment_add_package(env, cstring_dup(package_name));
 leave:
     cstring_free(package);
+}
+
+static executor_result_t __executor_require_statement__(environment_t env, statement_t stmt)
+{
+    executor_require(env, stmt->u.package_name);
+
     return EXECUTOR_RESULT_NORMAL;
 }
 
+static void __executor_enter_scope__(environment_t env, statement_t stmt)
+{
+    /* a statement that binds no names has no slots to reset */
+    if (stmt->scope_size > 0) {
+        environment_clear_slots(env, stmt->scope_offset, stmt->scope_size);
+    }
+}
+
+static void __executor_leave_scope__(environment_t env, statement_t stmt)
+{
+    /* closures created inside keep their own copy of the scope's variables */
+    if (stmt->scope_size > 0) {
+        environment_close_upvalues(env, stmt->scope_offset);
+    }
+}
+
 static executor_result_t __executor_block_statement__(environment_t env, list_t block)
 {
     list_iter_t iter;
@@ -204,6 +249,7 @@ static executor_result_t __executor_block_statement__(environment_t env, list_t
 static executor_result_t __executor_if_statement__(environment_t env, statement_t stmt)
 {
     value_t condition_value;
+    bool condition;
     statement_if_t stmt_if;
     executor_result_t result = EXECUTOR_RESULT_NORMAL;
 
@@ -211,9 +257,7 @@ static executor_result_t __executor_if_statement__(environment_t env, statement_
 
     evaluator_expression(env, stmt_if->condition);
 
-    condition_value = list_element(list_rbegin(env->stack), value_t, link);
-
-    list_erase(env->stack, condition_value->link);
+    condition_value = environment_stack_top(env);
 
     if (condition_value->type != VALUE_TYPE_BOOL) {
         runtime_error("(%d, %d): %s cannot be converted to bool", 
@@ -222,13 +266,16 @@ static executor_result_t __executor_if_statement__(environment_t env, statement_
                       get_value_type_string(condition_value->type));
     }
 
-    if (condition_value->u.bool_value) {
+    condition = condition_value->u.bool_value;
+
+    environment_pop_value(env);
+
+    if (condition) {
         result = __executor_block_statement__(env, stmt_if->if_block);
     } else {
         result = __executor_elif_statement__(env, stmt);
     }
 
-    value_free(condition_value);
     return result;
 }
 
@@ -247,9 +294,7 @@ static executor_result_t __executor_elif_statement__(environment_t env, statemen
 
         evaluator_expression(env, stmt_elif->condition);
 
-        condition_value = list_element(list_rbegin(env->stack), value_t, link);
-
-        list_erase(env->stack, condition_value->link);
+        condition_value = environment_stack_top(env);
 
         if (condition_value->type != VALUE_TYPE_BOOL) {
             runtime_error("(%d, %d): %s cannot be converted to bool",
@@ -260,7 +305,7 @@ static executor_result_t __executor_elif_statement__(environment_t env, statemen
 
         condition = condition_value->u.bool_value;
 
-        value_free(condition_value);
+        environment_pop_value(env);
 
         if (condition) {
             return __executor_block_statement__(env, stmt_elif->block);
@@ -277,10 +322,8 @@ static executor_result_t __executor_elif_statement__(environment_t env, statemen
 static executor_result_t __executor_switch_statement__(environment_t env, statement_t stmt)
 {
     bool compare_result;
-    value_t lvalue;
-    value_t rvalue;
     list_iter_t iter;
-    value_t compare_value;
+    unsigned long lvalue_index;
     statement_switch_t stmt_switch;
     statement_switch_case_t stmt_case;
 
@@ -288,38 +331,29 @@ static executor_result_t __executor_switch_statement__(environment_t env, statem
 
     evaluator_expression(env, stmt_switch->expr);
 
-    lvalue = list_element(list_rbegin(env->stack), value_t, link);
+    lvalue_index = environment_stack_size(env) - 1;
 
     list_for_each(stmt_switch->cases, iter) {
         stmt_case = list_element(iter, statement_switch_case_t, link);
 
         evaluator_expression(env, stmt_case->case_expr);
 
-        rvalue = list_element(list_rbegin(env->stack), value_t, link);
-
-        evaluator_binary_value(env, stmt->line, stmt->column, EXPRESSION_TYPE_EQ, lvalue, rvalue);
+        evaluator_binary_value(env, stmt->line, stmt->column, EXPRESSION_TYPE_EQ, 
+                               environment_stack_at(env, lvalue_index),
+                               environment_stack_top(env));
 
-        compare_value = list_element(list_rbegin(env->stack), value_t, link);
+        compare_result = environment_stack_top(env)->u.bool_value;
 
-        list_pop_back(env->stack);  /* pop compare_result */
-        list_pop_back(env->stack);  /* pop rvalue */
-
-        compare_result = compare_value->u.bool_value;
-
-        value_free(rvalue);
-        value_free(compare_value);
+        environment_pop_values(env, 2);  /* pop compare_result and rvalue */
 
         if (compare_result) {
-            list_pop_back(env->stack); /* pop lvalue */
-
-            value_free(lvalue);
+            environment_pop_value(env); /* pop lvalue */
           
             return __executor_block_statement__(env, stmt_case->block);
         }
     }
 
-    list_pop_back(env->stack);
-    value_free(lvalue);
+    environment_pop_value(env);
 
     return __executor_block_statement__(env, stmt_switch->default_block);
 }
@@ -335,8 +369,7 @@ static executor_result_t __executor_while_statement__(environment_t env, stateme
 
     while (true) {
         evaluator_expression(env, stmt_while->condition);
-        condition_value = list_element(list_rbegin(env->stack), value_t, link);
-        list_pop_back(env->stack);
+        condition_value = environment_stack_top(env);
 
         if (condition_value->type != VALUE_TYPE_BOOL) {
             runtime_error("(%d, %d): %s cannot be converted to bool",
@@ -347,7 +380,7 @@ static executor_result_t __executor_while_statement__(environment_t env, stateme
        
         condition = condition_value->u.bool_value;
 
-        value_free(condition_value);
+        environment_pop_value(env);
 
         if (!condition) {
             break;
@@ -359,10 +392,12 @@ static executor_result_t __executor_while_statement__(environment_t env, stateme
         } else if (result == EXECUTOR_RESULT_BREAK) {
             result = EXECUTOR_RESULT_NORMAL;
             break;
+        } else if (result == EXECUTOR_RESULT_CONTINUE) {
+            result = EXECUTOR_RESULT_NORMAL;
         }
     }
 
-    return EXECUTOR_RESULT_NORMAL;
+    return result;
 }
 
 static executor_result_t __executor_for_statement__(environment_t env, statement_t stmt)
@@ -376,16 +411,13 @@ static executor_result_t __executor_for_statement__(environment_t env, statement
 
     if (stmt_for->init) {
         evaluator_expression(env, stmt_for->init);
-        value = list_element(list_rbegin(env->stack), value_t, link);
-        list_pop_back(env->stack);
-        value_free(value);
+        environment_pop_value(env);
     }
 
     while (true) {
         if (stmt_for->condition) {
             evaluator_expression(env, stmt_for->condition);
-            value = list_element(list_rbegin(env->stack), value_t, link);
-            list_pop_back(env->stack);
+            value = environment_stack_top(env);
 
             if (value->type != VALUE_TYPE_BOOL) {
                 runtime_error("(%d, %d): %s cannot be converted to bool",
@@ -396,7 +428,7 @@ static executor_result_t __executor_for_statement__(environment_t env, statement
 
             condition = value->u.bool_value;
 
-            value_free(value);
+            environment_pop_value(env);
 
             if (!condition) {
                 break;
@@ -409,49 +441,73 @@ static executor_result_t __executor_for_statement__(environment_t env, statement
         } else if (result == EXECUTOR_RESULT_BREAK) {
             result = EXECUTOR_RESULT_NORMAL;
             break;
+        } else if (result == EXECUTOR_RESULT_CONTINUE) {
+            result = EXECUTOR_RESULT_NORMAL;
         }
 
         if (stmt_for->post) {
             evaluator_expression(env, stmt_for->post);
             
-            value = list_element(list_rbegin(env->stack), value_t, link);
-            
-            list_pop_back(env->stack);
-
-            value_free(value);
+            environment_pop_value(env);
         }
     }
 
     return result;
 }
 
+/*
+ * A call in the loop may move the frame slots, so a variable is looked up
+ * again on each pass; other lvalues are evaluated only once, but the body
+ * may have run a minor collection, so their owner is barriered again.
+ */
+static value_t __executor_foreach_lvalue__(environment_t env, expression_t lvalue_expr, value_t lvalue, object_t *owner)
+{
+    if (lvalue_expr->type == EXPRESSION_TYPE_IDENTIFIER) {
+        return evaluator_get_lvalue(env, lvalue_expr, owner);
+    }
+
+    if (*owner) {
+        heap_barrier_object(env, *owner);
+    }
+
+    return lvalue;
+}
+
 static executor_result_t __executor_foreach_statement__(environment_t env, statement_t stmt)
 {
     executor_result_t result = EXECUTOR_RESULT_NORMAL;
     value_t key_value = NULL;
     value_t value_value = NULL;
-    value_t at = NULL;
+    object_t key_owner;
+    object_t value_owner;
+    object_t at = NULL;
     statement_foreach_t stmt_foreach;
     
     stmt_foreach = stmt->u.foreach_stmt;
 
-    key_value = evaluator_get_lvalue(env, stmt_foreach->key);
+    key_value = evaluator_get_lvalue(env, stmt_foreach->key, &key_owner);
 
-    value_value = evaluator_get_lvalue(env, stmt_foreach->value);
+    value_value = evaluator_get_lvalue(env, stmt_foreach->value, &value_owner);
 
     evaluator_expression(env, stmt_foreach->at);
 
-    at = list_element(list_rbegin(env->stack), value_t, link);
+    /* the collection stays on the stack for the whole loop */
+    at = environment_stack_top(env)->u.object_value;
+
+    if (environment_stack_top(env)->type == VALUE_TYPE_ARRAY) {
+        unsigned long index;
+
+        /* elements live inline, so the body may move them by growing the array */
+        for (index = 0; index < array_length(at->u.array); index++) {
+            key_value   = __executor_foreach_lvalue__(env, stmt_foreach->key, key_value, &key_owner);
+            value_value = __executor_foreach_lvalue__(env, stmt_foreach->value, value_value, &value_owner);
 
-    if (at->type == VALUE_TYPE_ARRAY) {
-        value_t* values;
-        int index;
-        
-        key_value->type = VALUE_TYPE_INT;
-        
-        array_for_each(at->u.object_value->u.array, values, index) {
-            key_value->u.int_value = index;
-            *value_value = *(values[index]);
+            heap_barrier(env, key_value);
+            heap_barrier(env, value_value);
+
+            key_value->type        = VALUE_TYPE_INT;
+            key_value->u.int_value = (int)index;
+            *value_value = *(value_t)array_index(at->u.array, index);
 
             result = __executor_block_statement__(env, stmt_foreach->block);
             if (result == EXECUTOR_RESULT_RETURN) {
@@ -459,19 +515,25 @@ static executor_result_t __executor_foreach_statement__(environment_t env, state
             } else if (result == EXECUTOR_RESULT_BREAK) {
                 result = EXECUTOR_RESULT_NORMAL;
                 break;
+            } else if (result == EXECUTOR_RESULT_CONTINUE) {
+                result = EXECUTOR_RESULT_NORMAL;
             }
         }
 
-    } else if (at->type == VALUE_TYPE_TABLE) {
-        hash_table_iter_t hiter;
+    } else if (environment_stack_top(env)->type == VALUE_TYPE_TABLE) {
+        unsigned long cursor;
         table_pair_t variable;
 
-        hiter = hash_table_iter_new(at->u.object_value->u.table->table);
-        hash_table_for_each(at->u.object_value->u.table->table, hiter) {
-            variable = hash_table_iter_element(hiter, table_pair_t, link);
+        /* the body may add to the table; the cursor is only a position */
+        table_for_each(at->u.table, cursor, variable) {
+            key_value   = __executor_foreach_lvalue__(env, stmt_foreach->key, key_value, &key_owner);
+            value_value = __executor_foreach_lvalue__(env, stmt_foreach->value, value_value, &value_owner);
 
-            *key_value = *variable->key;
-            *value_value = *variable->value;
+            heap_barrier(env, key_value);
+            heap_barrier(env, value_value);
+
+            *key_value = variable->key;
+            *value_value = variable->value;
 
             result = __executor_block_statement__(env, stmt_foreach->block);
             if (result == EXECUTOR_RESULT_RETURN) {
@@ -479,16 +541,21 @@ static executor_result_t __executor_foreach_statement__(environment_t env, state
             } else if (result == EXECUTOR_RESULT_BREAK) {
                 result = EXECUTOR_RESULT_NORMAL;
                 break;
+            } else if (result == EXECUTOR_RESULT_CONTINUE) {
+                result = EXECUTOR_RESULT_NORMAL;
             }
         }
 
-        hash_table_iter_free(hiter);
-
     } else {
         runtime_error("(%d, %d): '%s' is not array/table",
                         stmt->line,
                         stmt->column,
-                        get_value_type_string(at->type));
+                        get_value_type_string(environment_stack_top(env)->type));
+    }
+
+    if (result == EXECUTOR_RESULT_RETURN) {
+        /* keep the return value on top */
+        environment_xchg_stack(env);
     }
 
     environment_pop_value(env);
@@ -20,5 +20,6 @@ executor_t executor_new(environment_t env);
 void executor_free(executor_t exec);
 void executor_run(executor_t exec);
 executor_result_t executor_statement(environment_t env, statement_t stmt);
+void executor_require(environment_t env, cstring_t package_name);
 
 #endif
\ No newline at end of file
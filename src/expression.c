@@ -2,6 +2,7 @@
 
 #include "expression.h"
 #include "statement.h"
+#include "compiler.h"
 #include "alloc.h"
 
 #include <stdio.h>
@@ -34,8 +35,7 @@ expression_t expression_new_literal(expression_type_t type, token_t tok)
            tok->value == TOKEN_VALUE_LITERAL_INT    ||
            tok->value == TOKEN_VALUE_LITERAL_LONG   ||
            tok->value == TOKEN_VALUE_LITERAL_FLOAT  ||
-           tok->value == TOKEN_VALUE_LITERAL_DOUBLE ||
-           tok->value == TOKEN_VALUE_LITERAL_STRING);
+           tok->value == TOKEN_VALUE_LITERAL_DOUBLE);
 
     expr = __expression_new__(type, tok->line, tok->column);
 
@@ -76,13 +76,13 @@ expression_t expression_new_literal(expression_type_t type, token_t tok)
     case EXPRESSION_TYPE_LONG:
         switch (tok->numberbase) {
         case 8:
-            expr->u.int_expr = strtol(tok->token, &result, 8);
+            expr->u.long_expr = strtol(tok->token, &result, 8);
             break;
         case 10:
-            expr->u.int_expr = strtol(tok->token, &result, 10);
+            expr->u.long_expr = strtol(tok->token, &result, 10);
             break;
         case 16:
-            expr->u.int_expr = strtol(tok->token, &result, 16);
+            expr->u.long_expr = strtol(tok->token, &result, 16);
             break;
         default:
             assert(false);
@@ -98,10 +98,6 @@ expression_t expression_new_literal(expression_type_t type, token_t tok)
         sscanf(tok->token, "%lf", &expr->u.double_expr);
         break;
 
-    case EXPRESSION_TYPE_STRING:
-        expr->u.string_expr = cstring_dup(tok->token);
-        break;
-
     default:
         assert(false);
         break;
@@ -110,13 +106,34 @@ expression_t expression_new_literal(expression_type_t type, token_t tok)
     return expr;
 }
 
-expression_t expression_new_identifier(long line, long column, cstring_t identifier)
+expression_t expression_new_string(long line, long column, symbol_t symbol)
+{
+    expression_t expr = __expression_new__(EXPRESSION_TYPE_STRING, line, column);
+
+    expr->u.string_expr = symbol;
+
+    return expr;
+}
+
+expression_t expression_new_identifier(long line, long column, symbol_t symbol)
 {
-    expression_t expr = __expression_new__(EXPRESSION_TYPE_IDENTIFIER, line, column);
+    expression_t expr;
+    expression_identifier_t identifier_expr;
 
-    assert(!cstring_is_empty(identifier));
+    assert(!cstring_is_empty(symbol->name));
 
-    expr->u.identifier_expr = identifier;
+    expr = __expression_new__(EXPRESSION_TYPE_IDENTIFIER, line, column);
+
+    identifier_expr = (expression_identifier_t) mem_alloc(sizeof(struct expression_identifier_s));
+    if (!identifier_expr) {
+        return NULL;
+    }
+
+    identifier_expr->symbol     = symbol;
+    identifier_expr->slots      = array_new(sizeof(struct expression_slot_s));
+    identifier_expr->bind_local = false;
+
+    expr->u.identifier_expr = identifier_expr;
 
     return expr;
 }
@@ -188,9 +205,10 @@ expression_t expression_new_binary(long line, long column, expression_type_t bin
         return NULL;
     }
 
-    expr->u.binary_expr        = binary_expr;
-    expr->u.binary_expr->left  = left;
-    expr->u.binary_expr->right = right;
+    expr->u.binary_expr          = binary_expr;
+    expr->u.binary_expr->left    = left;
+    expr->u.binary_expr->right   = right;
+    expr->u.binary_expr->quicken = EXPRESSION_QUICKEN_UNSEEN;
 
     return expr;
 }
@@ -245,6 +263,9 @@ expression_t expression_new_function(long line, long column, cstring_t name, lis
     expr->u.function_expr->name       = name;
     expr->u.function_expr->parameters = parameters;
     expr->u.function_expr->block      = block;
+    expr->u.function_expr->frame_size = 0;
+    expr->u.function_expr->upvalues   = array_new(sizeof(struct expression_upvalue_s));
+    expr->u.function_expr->code       = NULL;
 
     return expr;
 }
@@ -350,7 +371,7 @@ expression_t expression_new_table_generate(long line, long column, list_t member
     return expr;
 }
 
-expression_t expression_new_table_dot_member(long line, long column, expression_t table, cstring_t member_name)
+expression_t expression_new_table_dot_member(long line, long column, expression_t table, symbol_t member_name)
 {
     expression_t expr;
     expression_table_dot_member_t dot_member;
@@ -393,12 +414,9 @@ void expression_free(expression_t expr)
     list_iter_t iter = NULL, next_iter = NULL;
 
     switch (expr->type) {
-    case EXPRESSION_TYPE_STRING:
-        cstring_free(expr->u.string_expr);
-        break;
-
     case EXPRESSION_TYPE_IDENTIFIER:
-        cstring_free(expr->u.identifier_expr);
+        array_free(expr->u.identifier_expr->slots);
+        mem_free(expr->u.identifier_expr);
         break;
 
     case EXPRESSION_TYPE_FUNCTION:
@@ -411,8 +429,6 @@ void expression_free(expression_t expr)
 
             parameter = list_element(iter, expression_function_parameter_t, link);
 
-            cstring_free(parameter->name);
-
             mem_free(parameter);
         }
 
@@ -421,6 +437,12 @@ void expression_free(expression_t expr)
             statement_free(list_element(iter, statement_t, link));
         }
 
+        array_free(expr->u.function_expr->upvalues);
+
+        if (expr->u.function_expr->code) {
+            code_free(expr->u.function_expr->code);
+        }
+
         mem_free(expr->u.function_expr);
         break;
 
@@ -514,7 +536,6 @@ void expression_free(expression_t expr)
 
     case EXPRESSION_TYPE_TABLE_DOT_MEMBER:
         expression_free(expr->u.table_dot_member_expr->table_expr);
-        cstring_free(expr->u.table_dot_member_expr->member_name);
         mem_free(expr->u.table_dot_member_expr);
         break;
 
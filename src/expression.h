@@ -5,11 +5,17 @@
 
 #include "config.h"
 #include "list.h"
+#include "array.h"
 #include "token.h"
 #include "cstring.h"
+#include "symbol.h"
 
 typedef enum   expression_type_e                expression_type_t;
+typedef enum   expression_quicken_e             expression_quicken_t;
 typedef struct expression_s*                    expression_t;
+typedef struct expression_slot_s*               expression_slot_t;
+typedef struct expression_upvalue_s*            expression_upvalue_t;
+typedef struct expression_identifier_s*         expression_identifier_t;
 typedef struct expression_function_parameter_s* expression_function_parameter_t;
 typedef struct expression_function_s*           expression_function_t;
 typedef struct expression_call_s*               expression_call_t;
@@ -94,15 +100,34 @@ enum expression_type_e {
     EXPRESSION_TYPE_INDEX,
 };
 
+struct expression_slot_s {
+    bool         upvalue;       /* index is into the closure's upvalues */
+    unsigned int index;         /* otherwise a slot in the running frame */
+};
+
+struct expression_upvalue_s {
+    bool         local;         /* captures a slot of the enclosing frame */
+    unsigned int index;         /* otherwise an upvalue of the enclosing closure */
+};
+
+struct expression_identifier_s {
+    symbol_t  symbol;
+    array_t   slots;            /* frame slots that may hold it, innermost first */
+    bool      bind_local;       /* unbound writes go to slots[0], not a global */
+};
+
 struct expression_function_parameter_s {
-    cstring_t   name;
+    symbol_t    symbol;
     list_node_t link;
 };
 
 struct expression_function_s {
-    cstring_t name;
-    list_t    parameters;
-    list_t    block;
+    cstring_t    name;
+    list_t       parameters;
+    list_t       block;
+    unsigned int frame_size;
+    array_t      upvalues;      /* struct expression_upvalue_s */
+    struct code_s *code;        /* bytecode, compiled on the first call */
 };
 
 struct expression_call_s {
@@ -115,9 +140,21 @@ struct expression_assign_s {
     expression_t rvalue_expr;
 };
 
+/*
+ * What a binary node has seen of its operands. The evaluator promotes an
+ * unseen node on its first run and drops it to generic once the operand
+ * types stop matching.
+ */
+enum expression_quicken_e {
+    EXPRESSION_QUICKEN_UNSEEN,
+    EXPRESSION_QUICKEN_INT,
+    EXPRESSION_QUICKEN_GENERIC,
+};
+
 struct expression_binary_s {
-    expression_t left;
-    expression_t right;
+    expression_t         left;
+    expression_t         right;
+    expression_quicken_t quicken;
 };
 
 struct expression_array_push_s {
@@ -138,7 +175,7 @@ struct expression_table_pair_s {
 
 struct expression_table_dot_member_s {
     expression_t table_expr;
-    cstring_t    member_name;
+    symbol_t     member_name;
 };
 
 struct expression_index_s {
@@ -158,7 +195,7 @@ struct expression_s {
         long                            long_expr;
         float                           float_expr;
         double                          double_expr;
-        cstring_t                       string_expr;
+        symbol_t                        string_expr;    /* interned by the module */
         expression_function_t           function_expr;
         list_t                          array_generate_expr;
         list_t                          table_generate_expr;
@@ -166,7 +203,7 @@ struct expression_s {
         expression_array_pop_t          array_pop_expr;
         expression_index_t              index_expr;
         expression_table_dot_member_t   table_dot_member_expr;
-        cstring_t                       identifier_expr;
+        expression_identifier_t         identifier_expr;
         expression_binary_t             binary_expr;
         expression_t                    unary_expr;
         expression_call_t               call_expr;
@@ -179,7 +216,8 @@ struct expression_s {
 };
 
 expression_t            expression_new_literal(expression_type_t type, token_t tok);
-expression_t            expression_new_identifier(long line, long column, cstring_t identifier);
+expression_t            expression_new_string(long line, long column, symbol_t symbol);
+expression_t            expression_new_identifier(long line, long column, symbol_t symbol);
 expression_t            expression_new_assign(long line, long column, expression_type_t assign_type, expression_t lvalue_expr, expression_t rvalue_expr);
 expression_t            expression_new_binary(long line, long column, expression_type_t binary_expr_type, expression_t left, expression_t right);
 expression_t            expression_new_unary(long line, long column, expression_type_t unary_expr_type, expression_t expression);
@@ -192,7 +230,7 @@ expression_t            expression_new_array_pop(long line, long column, express
 expression_table_pair_t expression_new_table_pair(expression_t name, expression_t expr);
 void                    expression_free_table_pair(expression_table_pair_t pair);
 expression_t            expression_new_table_generate(long line, long column, list_t members);
-expression_t            expression_new_table_dot_member(long line, long column, expression_t table, cstring_t member_name);
+expression_t            expression_new_table_dot_member(long line, long column, expression_t table, symbol_t member_name);
 expression_t            expression_new_index(long line, long column, expression_t dict, expression_t index);
 void                    expression_free(expression_t expr);
 
@@ -179,7 +179,16 @@ bool hash_table_replace(hash_table_t ht, hlist_node_t *node)
 
 hlist_node_t *hash_table_search(hash_table_t ht, hlist_node_t *node)
 {
-    unsigned long hash;
+    if (ht->hb[0].size == 0) {
+        return NULL;
+    }
+
+    return hash_table_search_hash(ht, ht->ops->hashfn(node), node);
+}
+
+/* search with a hash the caller already knows, e.g. one cached in a symbol */
+hlist_node_t *hash_table_search_hash(hash_table_t ht, unsigned long hash, hlist_node_t *node)
+{
     long i;
 
     if (ht->hb[0].size == 0) {
@@ -190,8 +199,6 @@ hlist_node_t *hash_table_search(hash_table_t ht, hlist_node_t *node)
         hash_table_rehash(ht);
     }
 
-    hash = ht->ops->hashfn(node);
-
     for (i = 0; i < 2; i++) {
         hlist_node_t *hn;
         long index = hash & ht->hb[i].sizemask;
@@ -47,6 +47,7 @@ bool hash_table_insert(hash_table_t ht, hlist_node_t *node);
 bool hash_table_remove(hash_table_t ht, hlist_node_t *node);
 bool hash_table_replace(hash_table_t ht, hlist_node_t *node);
 hlist_node_t *hash_table_search(hash_table_t ht, hlist_node_t *node);
+hlist_node_t *hash_table_search_hash(hash_table_t ht, unsigned long hash, hlist_node_t *node);
 
 /* low level interface */
 bool hash_table_expand_bucket(hash_table_t ht, unsigned long size);
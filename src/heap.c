@@ -2,33 +2,315 @@
 
 #include "environment.h"
 #include "alloc.h"
-#include "list.h"
+#include "thread.h"
+#include "table.h"
 #include "heap.h"
 
 #include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Collections are paced by bytes, not objects. Every allocation charges
+ * the size of the object and its payload to allocated; when that reaches
+ * threshold a full collection runs, measures the bytes that survived and
+ * lets the program allocate pause percent of them (never less than
+ * minimum) before the next one. Containers that grow in place are
+ * measured at their current size by the next mark.
+ */
+
+/*
+ * Object headers are all the same size and are carved out of pages of
+ * HEAP_PAGE_SIZE bytes, aligned to that size so that masking an object's
+ * address finds its page. A page keeps two bitmaps, one bit per slot:
+ * used for the slots holding an object and marks for the ones marked in
+ * the current cycle. Allocation takes the first free slot at or after a
+ * cursor that walks the pages in order. When marking is over the pages
+ * are swept one at a time, lazily: the cursor sweeps a page before it
+ * allocates from it, so the sweep keeps just ahead of allocation.
+ * Sweeping a page frees what is used and not marked, a word of slots at
+ * a time, and only touches the objects it frees. It also clears the
+ * page's marks, so the next cycle starts without a pass to unmark the
+ * heap. Pages are kept for reuse until the heap itself is freed.
+ */
+
+/*
+ * A cycle can also run incrementally. Marking is tri-color: white objects
+ * are unmarked, gray ones are marked and wait on the gray stack for their
+ * children, black ones are marked and done. The roots are shaded when the
+ * cycle starts and objects allocated during it are born black, so the
+ * cycle keeps everything that was reachable at its start. The mutator
+ * may then only hide such an object by overwriting or removing the last
+ * reference held by a heap object, and heap_barrier shades the old value
+ * at exactly those stores. Once the gray stack is empty the pages are
+ * swept a few at a time, turning survivors white again. Each step runs
+ * after step_size bytes were allocated and stops after step_time
+ * microseconds.
+ *
+ * In generational mode new objects start on the young list instead. Every
+ * nursery bytes a minor collection marks from the roots and the
+ * remembered set, skipping old objects, frees the young ones it did not
+ * reach and promotes the rest in place: objects never move, since their
+ * addresses are held everywhere from the stack to native code. An old
+ * object joins the remembered set when heap_barrier_object sees it about
+ * to take a store that may point at a young one. A full collection runs
+ * once the bytes promoted since the last one reach threshold, all at
+ * once: the two modes do not mix, and neither can be turned on while the
+ * other is.
+ */
+
+/*
+ * The gray stack is popped from the top, so what sits a little below the
+ * top is what gets blackened next. Marking prefetches the header of the
+ * object HEAP_PREFETCH_DISTANCE * 2 down, and the payload of the one
+ * HEAP_PREFETCH_DISTANCE down, whose header has arrived by then.
+ */
+#ifndef HEAP_PREFETCH_DISTANCE
+#define HEAP_PREFETCH_DISTANCE (4)
+#endif
+
+#if defined(__GNUC__)
+#define __heap_prefetch__(p) __builtin_prefetch(p)
+#else
+#define __heap_prefetch__(p) ((void) (p))
+#endif
+
+#ifndef HEAP_PAGE_SIZE
+#define HEAP_PAGE_SIZE (32 * 1024)
+#endif
+
+/* pages are allocated this many at a time, to align them */
+#ifndef HEAP_CHUNK_PAGES
+#define HEAP_CHUNK_PAGES (32)
+#endif
+
+#define HEAP_WORD_BITS (sizeof(unsigned long) * 8)
+
+/* as many slots as fit with their two bits each, in whole bitmap words */
+#define HEAP_PAGE_OBJECTS                                                     \
+    ((HEAP_PAGE_SIZE - 64) * 8 / (8 * sizeof(struct object_s) + 2)            \
+        / HEAP_WORD_BITS * HEAP_WORD_BITS)
+
+#define HEAP_PAGE_WORDS (HEAP_PAGE_OBJECTS / HEAP_WORD_BITS)
+
+typedef struct heap_page_s* heap_page_t;
+
+struct heap_page_s {
+    heap_page_t     next;
+    unsigned long   used[HEAP_PAGE_WORDS];
+    unsigned long   marks[HEAP_PAGE_WORDS];
+    struct object_s objects[HEAP_PAGE_OBJECTS];
+};
+
+#define __heap_page__(obj)                                                    \
+    ((heap_page_t) ((size_t) (obj) & ~((size_t) HEAP_PAGE_SIZE - 1)))
+
+#define __heap_slot__(page, obj)                                              \
+    ((unsigned long) ((obj) - (page)->objects))
+
+#define __heap_bit__(slot)                                                    \
+    (1UL << ((slot) % HEAP_WORD_BITS))
+
+#define __heap_is_marked__(page, slot)                                        \
+    (((page)->marks[(slot) / HEAP_WORD_BITS] & __heap_bit__(slot)) != 0)
+
+#define __heap_set_marked__(page, slot)                                       \
+    ((page)->marks[(slot) / HEAP_WORD_BITS] |= __heap_bit__(slot))
+
+#define __heap_clear_marked__(page, slot)                                     \
+    ((page)->marks[(slot) / HEAP_WORD_BITS] &= ~__heap_bit__(slot))
+
+/*
+ * A full mark that stops the program can be shared by mark_threads
+ * markers, the program's thread being one of them. Each traces from its
+ * own gray stack and sets mark bits atomically, so whoever sets a bit
+ * first blackens that object. Each also owns a bounded deque, under a
+ * lock of its own, that the others may steal from: a marker with plenty
+ * of work and an empty deque moves the older half of its stack there,
+ * and one that runs dry takes half of another's deque. A marker with
+ * nothing to steal sleeps until someone shares, and the mark is over
+ * once every marker is idle with nothing left to steal. The markers'
+ * threads are started when mark_threads is set and wait between marks.
+ */
+typedef struct heap_marker_s* heap_marker_t;
+typedef struct heap_pool_s*   heap_pool_t;
+
+/* gray objects a marker's deque holds */
+#define HEAP_MARK_DEQUE (256)
+
+struct heap_marker_s {
+    heap_t        heap;
+    array_t       gray;             /* marked objects whose children are not */
+    unsigned long live;             /* bytes blackened in a full mark */
+    bool          atomic;           /* other markers run at the same time */
+    heap_pool_t   pool;
+    mutex_t       lock;             /* guards the deque */
+    object_t      deque[HEAP_MARK_DEQUE];
+    unsigned long head;             /* oldest entry of the deque */
+    unsigned long count;            /* entries in it, stored atomically */
+    unsigned long epoch;            /* last mark the marker's thread joined */
+};
+
+struct heap_pool_s {
+    mutex_t       lock;
+    cond_t        start;            /* a mark begins, or the pool quits */
+    cond_t        work;             /* something was shared, or the mark is over */
+    cond_t        finished;         /* the last thread left the mark */
+    heap_marker_t markers;          /* the first runs on the program's thread */
+    thread_t     *threads;
+    unsigned long size;             /* markers in markers */
+    unsigned long epoch;            /* marks started */
+    unsigned long running;          /* threads still in the current mark */
+    unsigned long pending;          /* objects in the deques, atomic */
+    unsigned long idle;             /* markers waiting for work, atomic */
+    bool          done;
+    bool          quit;
+};
+
+/*
+ * With background_sweep on, the sweep still returns dead objects' slots
+ * to the allocator itself, but copies their headers into garbage rather
+ * than freeing their payloads. Whatever garbage holds at the end of a
+ * page is handed to a sweeper thread, which frees it while the program
+ * runs on. Freeing a payload touches nothing but the payload, as no two
+ * objects share one.
+ */
+typedef struct heap_sweeper_s* heap_sweeper_t;
+
+struct heap_sweeper_s {
+    thread_t      thread;
+    mutex_t       lock;
+    cond_t        wake;
+    array_t       queue;            /* headers handed over, under lock */
+    unsigned long freed;            /* payload bytes freed, under lock */
+    bool          quit;
+};
+
+typedef enum heap_state_e {
+    HEAP_STATE_PAUSE,
+    HEAP_STATE_MARK,
+    HEAP_STATE_SWEEP
+} heap_state_t;
 
 struct heap_s {
-    long   allocated;
-    long   threshold;
-    list_t objects;
+    unsigned long allocated;        /* bytes charged since the last collection */
+    unsigned long threshold;        /* collect once allocated reaches this */
+    unsigned long live;             /* bytes that survived the last full mark */
+    unsigned long pause;            /* threshold as a percentage of live */
+    unsigned long minimum;          /* smallest threshold, in bytes */
+    heap_state_t  state;
+    bool          incremental;      /* run cycles in steps instead of all at once */
+    unsigned long step_size;        /* bytes allocated between two steps */
+    unsigned long step_time;        /* microseconds a step may run */
+    unsigned long stepped;          /* allocated at the last step, reset with it */
+    struct heap_marker_s marker;    /* the marker on the program's thread */
+    unsigned long mark_threads;     /* markers of a full mark that stops the program */
+    heap_pool_t   pool;             /* their threads, when there are more than one */
+    heap_page_t   sweep;            /* next page the sweep looks at */
+    heap_sweeper_t sweeper;         /* frees dead payloads, or NULL */
+    array_t       garbage;          /* dead headers not yet handed over */
+    unsigned long mark_clock;       /* microseconds of wall time spent marking */
+    unsigned long sweep_clock;      /* and sweeping */
+    struct heap_stats_s stats;      /* but for live, which is the heap's */
+    unsigned long pausing;          /* nested pauses under way */
+    unsigned long pause_begin;      /* when the outermost one started, by thread_clock */
+    bool          generational;     /* collect young objects on their own */
+    bool          minor;            /* the current mark leaves old objects alone */
+    unsigned long nursery;          /* bytes allocated between minor collections */
+    unsigned long promoted;         /* bytes promoted since the last full collection */
+    array_t       remembered;       /* old objects that may point at young ones */
+    array_t       young;            /* objects no collection has seen yet */
+    heap_page_t   pages;
+    heap_page_t   tail;
+    heap_page_t   cursor;           /* page allocation looks at first */
+    unsigned long cursor_word;      /* word of cursor's used bitmap it starts at */
+    array_t       chunks;           /* the blocks the pages were cut from */
+    char         *chunk;            /* next page of the last block */
+    unsigned long chunk_pages;      /* pages left in it */
 };
 
 #ifndef HEAP_THRESHOLD_SIZE
-#define HEAP_THRESHOLD_SIZE (128)
+#define HEAP_THRESHOLD_SIZE (256 * 1024)
+#endif
+
+#ifndef HEAP_PAUSE
+#define HEAP_PAUSE (100)
+#endif
+
+#ifndef HEAP_INCREMENTAL
+#define HEAP_INCREMENTAL (false)
+#endif
+
+#ifndef HEAP_STEP_SIZE
+#define HEAP_STEP_SIZE (32 * 1024)
+#endif
+
+#ifndef HEAP_STEP_TIME
+#define HEAP_STEP_TIME (1000)
+#endif
+
+#ifndef HEAP_NURSERY_SIZE
+#define HEAP_NURSERY_SIZE (256 * 1024)
+#endif
+
+/* objects a step handles between two looks at the clock */
+#define HEAP_STEP_CHECK (64)
+
+#ifndef HEAP_MARK_THREADS
+#define HEAP_MARK_THREADS (1)
+#endif
+
+#define HEAP_MARK_THREADS_MAX (64)
+
+#ifndef HEAP_BACKGROUND_SWEEP
+#define HEAP_BACKGROUND_SWEEP (false)
 #endif
 
+/* gray objects a marker keeps to itself before it shares */
+#define HEAP_MARK_SHARE (64)
+
 #define __heap_value_is_object__(value)                                       \
     (((value)->type == VALUE_TYPE_STRING) || ((value)->type == VALUE_TYPE_ARRAY) || \
      ((value)->type == VALUE_TYPE_FUNCTION) ||  ((value)->type == VALUE_TYPE_NATIVE_FUNCTION) || \
      ((value)->type == VALUE_TYPE_TABLE)) 
 
-static void     __heap_unmark_object__(object_t obj);
-static void     __heap_mark_object__(object_t obj);
-static void     __heap_dispose_object__(object_t obj);
-static void     __heap_mark_objects__(environment_t env);
-static void     __heap_mark_objects_in_context__(list_t ctx);
-static void     __heap_sweep_objects__(environment_t env);
+static void     __heap_shade_object__(heap_marker_t marker, object_t obj);
+static bool     __heap_object_is_marked__(object_t obj);
+static void     __heap_shade_value__(heap_marker_t marker, value_t value);
+static bool     __heap_mark_step__(heap_marker_t marker);
+static void     __heap_blacken_object__(heap_marker_t marker, object_t obj);
+static void     __heap_init_marker__(heap_marker_t marker, heap_t heap, heap_pool_t pool);
+static void     __heap_free_marker__(heap_marker_t marker);
+static bool     __heap_start_markers__(heap_t heap, unsigned long count);
+static void     __heap_stop_markers__(heap_t heap);
+static void     __heap_mark_thread__(void *arg);
+static void     __heap_mark_parallel__(environment_t env);
+static void     __heap_mark_worker__(void *arg);
+static void     __heap_share__(heap_marker_t marker);
+static bool     __heap_steal__(heap_marker_t marker);
+static bool     __heap_wait__(heap_marker_t marker);
+static unsigned long __heap_dispose_object__(object_t obj);
+static void     __heap_begin_pause__(heap_t heap);
+static void     __heap_end_pause__(heap_t heap);
+static void     __heap_discard_object__(heap_t heap, object_t obj);
+static void     __heap_hand_over__(heap_t heap);
+static bool     __heap_start_sweeper__(heap_t heap);
+static void     __heap_stop_sweeper__(heap_t heap);
+static void     __heap_sweeper_main__(void *arg);
+static void     __heap_start_cycle__(environment_t env);
+static void     __heap_minor_gc__(environment_t env);
+static unsigned long __heap_sweep_young__(environment_t env);
+static void     __heap_set_generational__(environment_t env, bool generational);
+static void     __heap_sweep_page__(heap_t heap);
+static void     __heap_mark__(environment_t env);
+static void     __heap_finish_mark__(environment_t env);
+static void     __heap_work__(environment_t env, bool bounded);
+static object_t __heap_take_slot__(heap_t heap);
+static heap_page_t __heap_new_page__(heap_t heap);
+static unsigned long __heap_lowest_bit__(unsigned long word);
 static object_t __heap_alloc_object__(environment_t env, object_type_t type);
+static object_t __heap_charge_object__(environment_t env, object_t obj);
+static unsigned long __heap_object_size__(object_t obj);
 static void     __heap_auto_gc__(environment_t env);
 
 heap_t heap_new(void)
@@ -40,30 +322,308 @@ heap_t heap_new(void)
 
     heap->allocated = 0;
     heap->threshold = HEAP_THRESHOLD_SIZE;
+    heap->live      = 0;
+    heap->pause     = HEAP_PAUSE;
+    heap->minimum   = HEAP_THRESHOLD_SIZE;
+
+    heap->state       = HEAP_STATE_PAUSE;
+    heap->incremental = HEAP_INCREMENTAL;
+    heap->step_size   = HEAP_STEP_SIZE;
+    heap->step_time   = HEAP_STEP_TIME;
+    heap->stepped     = 0;
+    heap->sweep       = NULL;
+    heap->sweeper     = NULL;
+    heap->garbage     = array_new(sizeof(struct object_s));
+    heap->mark_clock  = 0;
+    heap->sweep_clock = 0;
+    heap->pausing     = 0;
+    heap->pause_begin = 0;
+    memset(&heap->stats, 0, sizeof(heap->stats));
+
+    __heap_init_marker__(&heap->marker, heap, NULL);
+    heap->mark_threads = 1;
+    heap->pool         = NULL;
+
+    if (HEAP_MARK_THREADS > 1 && __heap_start_markers__(heap, HEAP_MARK_THREADS)) {
+        heap->mark_threads = heap->pool->size;
+    }
 
-    list_init(heap->objects);
+    /* turned on by the program, after the libraries have filled their tables */
+    heap->generational = false;
+    heap->minor        = false;
+    heap->nursery      = HEAP_NURSERY_SIZE;
+    heap->promoted     = 0;
+    heap->remembered   = array_new(sizeof(object_t));
+    heap->young        = array_new(sizeof(object_t));
+
+    heap->pages       = NULL;
+    heap->tail        = NULL;
+    heap->cursor      = NULL;
+    heap->cursor_word = 0;
+    heap->chunks      = array_new(sizeof(char*));
+    heap->chunk       = NULL;
+    heap->chunk_pages = 0;
+
+    if (HEAP_BACKGROUND_SWEEP) {
+        __heap_start_sweeper__(heap);
+    }
 
     return heap;
 }
 
 void heap_free(heap_t heap)
 {
-    list_iter_t iter, next_iter;
-    object_t object;
+    heap_page_t   page;
+    unsigned long slot;
+    char        **chunks;
+    int           index;
+
+    if (heap->sweeper) {
+        __heap_hand_over__(heap);
+        __heap_stop_sweeper__(heap);
+    }
+
+    if (heap->pool) {
+        __heap_stop_markers__(heap);
+    }
+
+    for (page = heap->pages; page; page = page->next) {
+        for (slot = 0; slot < HEAP_PAGE_OBJECTS; slot++) {
+            if (page->used[slot / HEAP_WORD_BITS] & __heap_bit__(slot)) {
+                __heap_dispose_object__(&page->objects[slot]);
+            }
+        }
+    }
 
-    list_safe_for_each(heap->objects, iter, next_iter) {
-        object = list_element(iter, object_t, link_heap);
-        list_erase(heap->objects, *iter);
-        __heap_dispose_object__(object);
+    array_for_each(heap->chunks, chunks, index) {
+        mem_free(chunks[index]);
     }
 
+    array_free(heap->chunks);
+    __heap_free_marker__(&heap->marker);
+    array_free(heap->remembered);
+    array_free(heap->young);
+    array_free(heap->garbage);
+
     mem_free(heap);
 }
 
+/*
+ * A full collection. A cycle already in progress is finished first, as
+ * it cannot free what became garbage after it started.
+ */
 void heap_gc(environment_t env)
 {
-    __heap_mark_objects__(env);
-    __heap_sweep_objects__(env);
+    __heap_begin_pause__(env->heap);
+
+    if (env->heap->state != HEAP_STATE_PAUSE) {
+        __heap_work__(env, false);
+    }
+
+    __heap_start_cycle__(env);
+    __heap_mark__(env);
+    __heap_work__(env, false);
+
+    __heap_end_pause__(env->heap);
+}
+
+void heap_get_stats(environment_t env, heap_stats_t stats)
+{
+    heap_t heap = env->heap;
+
+    *stats      = heap->stats;
+    stats->live = heap->live;
+
+    if (heap->sweeper) {
+        mutex_lock(heap->sweeper->lock);
+        stats->bytes_freed += heap->sweeper->freed;
+        mutex_unlock(heap->sweeper->lock);
+    }
+}
+
+void heap_dump_stats(environment_t env, FILE *fp)
+{
+    struct heap_stats_s stats;
+    unsigned long       bucket;
+
+    heap_get_stats(env, &stats);
+
+    fprintf(fp, "collections        %lu\n", stats.collections);
+    fprintf(fp, "minor collections  %lu\n", stats.minor_collections);
+    fprintf(fp, "objects allocated  %lu\n", stats.objects_allocated);
+    fprintf(fp, "bytes allocated    %lu\n", stats.bytes_allocated);
+    fprintf(fp, "objects freed      %lu\n", stats.objects_freed);
+    fprintf(fp, "bytes freed        %lu\n", stats.bytes_freed);
+    fprintf(fp, "live bytes         %lu\n", stats.live);
+    fprintf(fp, "pauses             %lu\n", stats.pause_count);
+    fprintf(fp, "pause total        %lu us\n", stats.pause_total);
+    fprintf(fp, "pause max          %lu us\n", stats.pause_max);
+
+    for (bucket = 0; bucket < HEAP_PAUSE_BUCKETS; bucket++) {
+        if (!stats.pauses[bucket]) {
+            continue;
+        }
+
+        if (bucket == HEAP_PAUSE_BUCKETS - 1) {
+            fprintf(fp, "  >= %8lu us     %lu\n", 1UL << (bucket - 1), stats.pauses[bucket]);
+        } else {
+            fprintf(fp, "  <  %8lu us     %lu\n", 1UL << bucket, stats.pauses[bucket]);
+        }
+    }
+}
+
+/*
+ * Called before value is overwritten or removed from wherever it is held.
+ * While marking, its object may be the last way to something that was
+ * reachable when the cycle started, so it is shaded.
+ */
+void heap_barrier(environment_t env, value_t value)
+{
+    if (env->heap->state == HEAP_STATE_MARK) {
+        __heap_shade_value__(&env->heap->marker, value);
+    }
+}
+
+/*
+ * Called before a value that may be young is stored into object, or a
+ * key is added to it. Only old objects are ever remembered, so outside
+ * generational mode this does nothing.
+ */
+void heap_barrier_object(environment_t env, object_t object)
+{
+    if (object->old && !object->remembered) {
+        object->remembered = true;
+        *(object_t*) array_push(env->heap->remembered) = object;
+    }
+}
+
+long heap_get_param(environment_t env, const char *name)
+{
+    if (strcmp(name, "pause") == 0) {
+        return (long) env->heap->pause;
+
+    } else if (strcmp(name, "minimum") == 0) {
+        return (long) env->heap->minimum;
+
+    } else if (strcmp(name, "threshold") == 0) {
+        return (long) env->heap->threshold;
+
+    } else if (strcmp(name, "allocated") == 0) {
+        return (long) env->heap->allocated;
+
+    } else if (strcmp(name, "live") == 0) {
+        return (long) env->heap->live;
+
+    } else if (strcmp(name, "incremental") == 0) {
+        return (long) env->heap->incremental;
+
+    } else if (strcmp(name, "step_size") == 0) {
+        return (long) env->heap->step_size;
+
+    } else if (strcmp(name, "step_time") == 0) {
+        return (long) env->heap->step_time;
+
+    } else if (strcmp(name, "generational") == 0) {
+        return (long) env->heap->generational;
+
+    } else if (strcmp(name, "nursery") == 0) {
+        return (long) env->heap->nursery;
+
+    } else if (strcmp(name, "promoted") == 0) {
+        return (long) env->heap->promoted;
+
+    } else if (strcmp(name, "mark_time") == 0) {
+        return (long) env->heap->mark_clock;
+
+    } else if (strcmp(name, "sweep_time") == 0) {
+        return (long) env->heap->sweep_clock;
+
+    } else if (strcmp(name, "mark_threads") == 0) {
+        return (long) env->heap->mark_threads;
+
+    } else if (strcmp(name, "background_sweep") == 0) {
+        return (long) (env->heap->sweeper != NULL);
+    }
+
+    return -1;
+}
+
+/*
+ * Only the pacing knobs can be set; the counters are read-only. A new
+ * setting takes effect from the next threshold computed, except that
+ * raising minimum also raises the current one. A value out of a knob's
+ * range is refused rather than cut down to fit.
+ */
+bool heap_set_param(environment_t env, const char *name, long value)
+{
+    if (value < 0) {
+        return false;
+    }
+
+    if (strcmp(name, "pause") == 0) {
+        env->heap->pause = (unsigned long) value;
+
+    } else if (strcmp(name, "minimum") == 0) {
+        env->heap->minimum = (unsigned long) value;
+        if (env->heap->threshold < env->heap->minimum) {
+            env->heap->threshold = env->heap->minimum;
+        }
+
+    } else if (strcmp(name, "incremental") == 0) {
+        if (value > 1 || (value && env->heap->generational)) {
+            return false;
+        }
+        env->heap->incremental = value != 0;
+
+    } else if (strcmp(name, "step_size") == 0) {
+        env->heap->step_size = (unsigned long) value;
+
+    } else if (strcmp(name, "step_time") == 0) {
+        env->heap->step_time = (unsigned long) value;
+
+    } else if (strcmp(name, "generational") == 0) {
+        if (value > 1 || (value && env->heap->incremental)) {
+            return false;
+        }
+        __heap_set_generational__(env, value != 0);
+
+    } else if (strcmp(name, "nursery") == 0) {
+        env->heap->nursery = (unsigned long) value;
+
+    } else if (strcmp(name, "mark_threads") == 0) {
+        if (value < 1 || value > HEAP_MARK_THREADS_MAX) {
+            return false;
+        }
+        if ((unsigned long) value != env->heap->mark_threads) {
+            if (env->heap->pool) {
+                __heap_stop_markers__(env->heap);
+            }
+            env->heap->mark_threads = 1;
+
+            if (value > 1) {
+                if (!__heap_start_markers__(env->heap, (unsigned long) value)) {
+                    return false;
+                }
+                env->heap->mark_threads = env->heap->pool->size;
+            }
+        }
+
+    } else if (strcmp(name, "background_sweep") == 0) {
+        if (value > 1) {
+            return false;
+        }
+        if (value && !env->heap->sweeper) {
+            return __heap_start_sweeper__(env->heap);
+        } else if (!value && env->heap->sweeper) {
+            __heap_hand_over__(env->heap);
+            __heap_stop_sweeper__(env->heap);
+        }
+
+    } else {
+        return false;
+    }
+
+    return true;
 }
 
 object_t heap_alloc_str(environment_t env, const char* str)
@@ -72,7 +632,7 @@ object_t heap_alloc_str(environment_t env, const char* str)
 
     object->u.string = cstring_new(str);
 
-    return object;
+    return __heap_charge_object__(env, object);
 }
 
 object_t heap_alloc_string(environment_t env, cstring_t cstr)
@@ -81,7 +641,7 @@ object_t heap_alloc_string(environment_t env, cstring_t cstr)
 
     object->u.string = cstring_dup(cstr);
 
-    return object;
+    return __heap_charge_object__(env, object);
 }
 
 object_t heap_alloc_string_n(environment_t env, unsigned long n) 
@@ -90,25 +650,25 @@ object_t heap_alloc_string_n(environment_t env, unsigned long n)
 
     object->u.string = cstring_newempty(n);
 
-    return object;
+    return __heap_charge_object__(env, object);
 }
 
 object_t heap_alloc_array(environment_t env)
 {
     object_t object = __heap_alloc_object__(env, OBJECT_TYPE_ARRAY);
 
-    object->u.array = array_new(sizeof(value_t));
+    object->u.array = array_new(sizeof(struct value_s));
 
-    return object;
+    return __heap_charge_object__(env, object);
 }
 
 object_t heap_alloc_array_n(environment_t env, unsigned long n)
 {
     object_t object = __heap_alloc_object__(env, OBJECT_TYPE_ARRAY);
 
-    object->u.array = array_newlen(sizeof(value_t), n);
+    object->u.array = array_newlen(sizeof(struct value_s), n);
 
-    return object;
+    return __heap_charge_object__(env, object);
 }
 
 object_t heap_alloc_table(environment_t env)
@@ -117,20 +677,27 @@ object_t heap_alloc_table(environment_t env)
 
     object->u.table = table_new();
 
-    return object;
+    return __heap_charge_object__(env, object);
 }
 
 object_t heap_alloc_function(environment_t env, expression_function_t function_expr)
 {
     object_t object = __heap_alloc_object__(env, OBJECT_TYPE_FUNCTION);
+    unsigned int nupvalues = (unsigned int) array_length(function_expr->upvalues);
+    unsigned int index;
 
-    object->u.function = mem_alloc(sizeof(struct function_s));
+    /* the upvalue pointers follow the function in the same block */
+    object->u.function = mem_alloc(sizeof(struct function_s) + nupvalues * sizeof(object_t));
 
     object->u.function->f.function_expr = function_expr;
-    
-    list_init(object->u.function->scopes);
+    object->u.function->nupvalues       = nupvalues;
+    object->u.function->upvalues        = (object_t*) (object->u.function + 1);
 
-    return object;
+    for (index = 0; index < nupvalues; index++) {
+        object->u.function->upvalues[index] = NULL;
+    }
+
+    return __heap_charge_object__(env, object);
 }
 
 object_t heap_alloc_native_function(environment_t env, native_function_pt native_function)
@@ -140,8 +707,45 @@ object_t heap_alloc_native_function(environment_t env, native_function_pt native
     object->u.function = mem_alloc(sizeof(struct function_s));
 
     object->u.function->f.native_function = native_function;
+    object->u.function->nupvalues         = 0;
+    object->u.function->upvalues          = NULL;
+
+    return __heap_charge_object__(env, object);
+}
+
+object_t heap_alloc_upvalue(environment_t env, unsigned long index)
+{
+    object_t object = __heap_alloc_object__(env, OBJECT_TYPE_UPVALUE);
+
+    object->u.upvalue = mem_alloc(sizeof(struct upvalue_s));
+
+    object->u.upvalue->open        = true;
+    object->u.upvalue->index       = index;
+    object->u.upvalue->closed.type = VALUE_TYPE_NULL;
+
+    return __heap_charge_object__(env, object);
+}
+
+/*
+ * The constant string of an interned name. It lives with the symbol, off
+ * the heap: the collector never sees it and allocating it is not counted
+ * towards the next collection.
+ */
+object_t heap_symbol_string(symbol_t symbol)
+{
+    object_t object = symbol->string;
+
+    if (!object) {
+        object = mem_alloc(sizeof(struct object_s));
+
+        object->type       = OBJECT_TYPE_STRING;
+        object->constant   = true;
+        object->old        = false;
+        object->remembered = false;
+        object->u.string   = symbol->name;
 
-    list_init(object->u.function->scopes);
+        symbol->string = object;
+    }
 
     return object;
 }
@@ -152,239 +756,1187 @@ static object_t __heap_alloc_object__(environment_t env, object_type_t type)
 
     __heap_auto_gc__(env);
 
-    object = mem_alloc(sizeof(struct object_s));
+    object = __heap_take_slot__(env->heap);
     if (!object) {
         return NULL;
     }
 
-    object->type   = type;
-    object->marked = false;
+    env->heap->stats.objects_allocated++;
 
-    list_push_back(env->heap->objects, object->link_heap);
+    object->type       = (unsigned char) type;
+    object->constant   = false;
+    object->old        = false;
+    object->remembered = false;
 
-    env->heap->allocated++;
+    if (env->heap->generational) {
+        *(object_t*) array_push(env->heap->young) = object;
+    }
 
     return object;
 }
 
-static void __heap_auto_gc__(environment_t env)
-{
-    if (env->heap->allocated >= env->heap->threshold) {
-        heap_gc(env);
-    }
-}
-
-static void __heap_mark_objects__(environment_t env)
+/*
+ * The first free slot from the cursor on, sweeping the pages it reaches
+ * that the sweep has not. Objects made while marking are black, the sweep
+ * whitens them; the pages the cursor looks at then have been swept.
+ */
+static object_t __heap_take_slot__(heap_t heap)
 {
-    
-    {
-        /* clear mark */
-        list_iter_t iter;
-        object_t object;
-
-        list_for_each(env->heap->objects, iter) {
-            object = list_element(iter, object_t, link_heap);
-            __heap_unmark_object__(object);
+    heap_page_t   page;
+    unsigned long word;
+    unsigned long slot;
+
+    for (;;) {
+        page = heap->cursor;
+        if (!page) {
+            page = __heap_new_page__(heap);
+            if (!page) {
+                return NULL;
+            }
+            heap->cursor      = page;
+            heap->cursor_word = 0;
         }
-    }
 
-    {
-        /* mark global variable */
-        table_pair_t variable;
-        hash_table_iter_t iter;
+        if (page == heap->sweep) {
+            __heap_sweep_page__(heap);
+        }
 
-        iter = hash_table_iter_new(env->global_table->table);
-        hash_table_for_each(env->global_table->table, iter) {
-            variable = hash_table_iter_element(iter, table_pair_t, link);
+        for (word = heap->cursor_word; word < HEAP_PAGE_WORDS; word++) {
+            if (page->used[word] != ~0UL) {
+                slot = word * HEAP_WORD_BITS + __heap_lowest_bit__(~page->used[word]);
 
-            if (__heap_value_is_object__(variable->key)) {
-                __heap_mark_object__(variable->key->u.object_value);
-            }
+                page->used[word] |= __heap_bit__(slot);
+                if (heap->state == HEAP_STATE_MARK) {
+                    __heap_set_marked__(page, slot);
+                }
 
-            if (__heap_value_is_object__(variable->value)) {
-                __heap_mark_object__(variable->value->u.object_value);
+                heap->cursor_word = word;
+                return &page->objects[slot];
             }
         }
 
-        hash_table_iter_free(iter);
+        heap->cursor      = page->next;
+        heap->cursor_word = 0;
     }
+}
 
-    {
-        /* mark stack */
-        list_iter_t iter;
-        value_t value;
-
-        list_for_each(env->stack, iter) {
-            value = list_element(iter, value_t, link);
-            if (__heap_value_is_object__(value)) {
-                __heap_mark_object__(value->u.object_value);
-            }
-        }
-    }
+static heap_page_t __heap_new_page__(heap_t heap)
+{
+    heap_page_t page;
+    char       *chunk;
 
-    __heap_mark_objects_in_context__(env->local_context_stack);
-    
-    {
-        /* mark previous contexts frames */
-        list_iter_t iter;
-        local_context_stack_t stack;
-        list_for_each(env->previous_context_frames, iter) {
-            stack = list_element(iter, local_context_stack_t, link);
-            __heap_mark_objects_in_context__(stack->context_stack);
+    if (heap->chunk_pages == 0) {
+        chunk = mem_alloc((HEAP_CHUNK_PAGES + 1) * HEAP_PAGE_SIZE);
+        if (!chunk) {
+            return NULL;
         }
 
-    }
-}
+        *(char**) array_push(heap->chunks) = chunk;
 
-static void __heap_mark_objects_in_context__(list_t ctx)
-{
-    /* mark local context */
-    list_iter_t iter;
-    local_context_t context;
-    table_pair_t variable;
-    hash_table_iter_t hiter;
+        /* the first whole page inside the block */
+        heap->chunk       = (char*) (((size_t) chunk + HEAP_PAGE_SIZE - 1) & ~((size_t) HEAP_PAGE_SIZE - 1));
+        heap->chunk_pages = HEAP_CHUNK_PAGES;
+    }
 
-    list_for_each(ctx, iter) {
-        context = list_element(iter, local_context_t, link);
+    page = (heap_page_t) heap->chunk;
 
-        __heap_mark_object__(context->object);
+    heap->chunk       += HEAP_PAGE_SIZE;
+    heap->chunk_pages -= 1;
 
-        hiter = hash_table_iter_new(context->object->u.table->table);
-        hash_table_for_each(context->object->u.table->table, hiter) {
-            variable = hash_table_iter_element(hiter, table_pair_t, link);
+    memset(page->used, 0, sizeof(page->used));
+    memset(page->marks, 0, sizeof(page->marks));
+    page->next = NULL;
 
-            if (__heap_value_is_object__(variable->key)) {
-                __heap_mark_object__(variable->key->u.object_value);
-            }
+    if (heap->tail) {
+        heap->tail->next = page;
+    } else {
+        heap->pages = page;
+    }
+    heap->tail = page;
 
-            if (__heap_value_is_object__(variable->value)) {
-                __heap_mark_object__(variable->value->u.object_value);
-            }
-        }
+    return page;
+}
 
-        hash_table_iter_free(hiter);
+static unsigned long __heap_lowest_bit__(unsigned long word)
+{
+#if defined(__GNUC__)
+    return (unsigned long) __builtin_ctzl(word);
+#else
+    unsigned long bit = 0;
+
+    while (!(word & 1)) {
+        word >>= 1;
+        bit++;
     }
+
+    return bit;
+#endif
 }
 
-static void __heap_sweep_objects__(environment_t env)
+static object_t __heap_charge_object__(environment_t env, object_t obj)
 {
-    list_iter_t iter, next_iter;
-    object_t object;
+    unsigned long size = __heap_object_size__(obj);
 
-    list_safe_for_each(env->heap->objects, iter, next_iter) {
-        object = list_element(iter, object_t, link_heap);
-        if (!object->marked) {
-            list_erase(env->heap->objects, *iter);
-            __heap_dispose_object__(object);
-            env->heap->allocated--;
-        }
-    }
+    env->heap->allocated             += size;
+    env->heap->stats.bytes_allocated += size;
+    return obj;
 }
 
-static void __heap_dispose_object__(object_t obj)
+static unsigned long __heap_object_size__(object_t obj)
 {
-    value_t *base;
-    int index;
+    unsigned long size = sizeof(struct object_s);
 
     switch (obj->type) {
     case OBJECT_TYPE_STRING:
-        cstring_free(obj->u.string);
+        size += cstring_size(obj->u.string);
         break;
 
     case OBJECT_TYPE_ARRAY:
-        array_for_each(obj->u.array, base, index) {
-            value_free(base[index]);
-        }
-        array_free(obj->u.array);
+        size += sizeof(struct array_s) + obj->u.array->nalloc * obj->u.array->size;
         break;
 
     case OBJECT_TYPE_TABLE:
-        table_free(obj->u.table);
+        size += table_memory(obj->u.table);
         break;
 
     case OBJECT_TYPE_FUNCTION:
-
     case OBJECT_TYPE_NATIVE_FUNCTION:
-        mem_free(obj->u.function);
+        size += sizeof(struct function_s) + obj->u.function->nupvalues * sizeof(object_t);
+        break;
+
+    case OBJECT_TYPE_UPVALUE:
+        size += sizeof(struct upvalue_s);
         break;
 
     default:
         break;
     }
 
-    mem_free(obj);
+    return size;
 }
 
-static void __heap_unmark_object__(object_t obj)
+static void __heap_auto_gc__(environment_t env)
+{
+    heap_t heap = env->heap;
+
+    if (heap->generational) {
+        if (heap->allocated >= heap->nursery) {
+            __heap_begin_pause__(heap);
+            __heap_minor_gc__(env);
+            __heap_end_pause__(heap);
+        }
+        return;
+    }
+
+    if (heap->state != HEAP_STATE_PAUSE && heap->incremental) {
+        /* a program that outruns the steps gets the rest of the cycle at once */
+        if (heap->allocated >= heap->threshold * 2) {
+            __heap_begin_pause__(heap);
+            __heap_work__(env, false);
+            __heap_end_pause__(heap);
+
+        } else if (heap->allocated - heap->stepped >= heap->step_size) {
+            heap->stepped = heap->allocated;
+            __heap_begin_pause__(heap);
+            __heap_work__(env, true);
+            __heap_end_pause__(heap);
+        }
+        return;
+    }
+
+    /* incremental was turned off in the middle of a cycle */
+    if (heap->state == HEAP_STATE_MARK) {
+        __heap_begin_pause__(heap);
+        __heap_mark__(env);
+        __heap_end_pause__(heap);
+    }
+
+    if (heap->allocated < heap->threshold) {
+        return;
+    }
+
+    __heap_begin_pause__(heap);
+
+    /* what the last sweep has not reached yet */
+    if (heap->state != HEAP_STATE_PAUSE) {
+        __heap_work__(env, false);
+    }
+
+    __heap_start_cycle__(env);
+
+    if (heap->incremental) {
+        heap->stepped = heap->allocated;
+    } else {
+        __heap_mark__(env);
+    }
+
+    __heap_end_pause__(heap);
+}
+
+/*
+ * A pause is the wall time the collector holds the program up in one go: a
+ * collection, a minor collection or an incremental step. The pages
+ * allocation sweeps on its way are not counted, as they are part of
+ * allocating. Pauses nest, as when a minor collection ends in a full
+ * one, and only the outermost is recorded.
+ */
+static void __heap_begin_pause__(heap_t heap)
 {
-    obj->marked = false;
+    if (heap->pausing++ == 0) {
+        heap->pause_begin = thread_clock();
+    }
 }
 
-static void __heap_mark_object__(object_t obj)
+static void __heap_end_pause__(heap_t heap)
 {
-    value_t *base;
-    int index;
-    list_iter_t iter;
-    table_pair_t variable;
-    hash_table_iter_t hiter;
+    unsigned long pause;
+    unsigned long bucket;
 
-    if (obj->marked) {
+    if (--heap->pausing != 0) {
         return ;
     }
 
-    obj->marked = true;
+    pause = thread_clock() - heap->pause_begin;
 
-    switch (obj->type) {
-    case OBJECT_TYPE_NATIVE_FUNCTION:
-    case OBJECT_TYPE_FUNCTION:
-        list_for_each(obj->u.function->scopes, iter) {
-            object_t object = list_element(iter, object_t, link_scope);
+    heap->stats.pause_count++;
+    heap->stats.pause_total += pause;
+    if (pause > heap->stats.pause_max) {
+        heap->stats.pause_max = pause;
+    }
 
-            __heap_mark_object__(object);
-            
-            hiter = hash_table_iter_new(object->u.table->table);
-            hash_table_for_each(object->u.table->table, hiter) {
-                variable = hash_table_iter_element(hiter, table_pair_t, link);
+    for (bucket = 0; bucket < HEAP_PAUSE_BUCKETS - 1 && pause >= (1UL << bucket); bucket++) {
+        continue;
+    }
+    heap->stats.pauses[bucket]++;
+}
 
-                if (__heap_value_is_object__(variable->key)) {
-                    __heap_mark_object__(variable->key->u.object_value);
-                }
+static void __heap_start_cycle__(environment_t env)
+{
+    heap_t        heap = env->heap;
+    heap_marker_t marker = &heap->marker;
+    object_t     *remembered;
+    int           index;
+    unsigned long begin = thread_clock();
+
+    heap->state = HEAP_STATE_MARK;
+
+    if (heap->minor) {
+        heap->stats.minor_collections++;
+    } else {
+        heap->stats.collections++;
+    }
 
-                if (__heap_value_is_object__(variable->value)) {
-                    __heap_mark_object__(variable->value->u.object_value);
-                }
-            }
+    /* a full mark traces old objects anyway */
+    if (!heap->minor) {
+        marker->live = 0;
 
-            hash_table_iter_free(hiter);
+        array_for_each(heap->remembered, remembered, index) {
+            remembered[index]->remembered = false;
         }
-        break;
+        array_clear(heap->remembered);
+    }
 
-    case OBJECT_TYPE_ARRAY:
-        array_for_each(obj->u.array, base, index) {
-            if (__heap_value_is_object__(base[index])) {
-                __heap_mark_object__(base[index]->u.object_value);
-            }
+    {
+        /* shade global variable */
+        table_pair_t variable;
+        unsigned long cursor;
+
+        table_for_each(env->global_table, cursor, variable) {
+            __heap_shade_value__(marker, &variable->key);
+            __heap_shade_value__(marker, &variable->value);
         }
-        break;
+    }
 
-    case OBJECT_TYPE_TABLE:
-        hiter = hash_table_iter_new(obj->u.table->table);
-        hash_table_for_each(obj->u.table->table, hiter) {
-            variable = hash_table_iter_element(hiter, table_pair_t, link);
+    {
+        /* shade stack */
+        unsigned long index;
 
-            if (__heap_value_is_object__(variable->key)) {
-                __heap_mark_object__(variable->key->u.object_value);
-            }
+        for (index = 0; index < environment_stack_size(env); index++) {
+            __heap_shade_value__(marker, environment_stack_at(env, index));
+        }
+    }
 
-            if (__heap_value_is_object__(variable->value)) {
-                __heap_mark_object__(variable->value->u.object_value);
+    {
+        /* shade frames */
+        frame_t frames;
+        value_t slots;
+        int index;
+
+        array_for_each(env->frames, frames, index) {
+            if (frames[index].closure) {
+                __heap_shade_object__(marker, frames[index].closure);
             }
         }
 
-        hash_table_iter_free(hiter);
-        break;
+        array_for_each(env->slots, slots, index) {
+            __heap_shade_value__(marker, &slots[index]);
+        }
+    }
 
-    default:
-        break;
+    {
+        /* shade open upvalues */
+        object_t *upvalues;
+        int index;
+
+        array_for_each(env->upvalues, upvalues, index) {
+            __heap_shade_object__(marker, upvalues[index]);
+        }
     }
-}
\ No newline at end of file
+
+    heap->mark_clock += thread_clock() - begin;
+}
+
+/*
+ * Marks gray objects, then sweeps, until the cycle is over or, when
+ * bounded, the step has used up its time.
+ */
+static void __heap_work__(environment_t env, bool bounded)
+{
+    heap_t        heap = env->heap;
+    unsigned long begin = thread_clock();
+    unsigned long now;
+    unsigned long work;
+
+    for (work = 1; heap->state != HEAP_STATE_PAUSE; work++) {
+        if (heap->state == HEAP_STATE_MARK) {
+            if (!__heap_mark_step__(&heap->marker)) {
+                __heap_finish_mark__(env);
+                heap->mark_clock += thread_clock() - begin;
+                continue;
+            }
+
+        } else {
+            __heap_sweep_page__(heap);
+
+            /* a page is worth a look at the clock on its own */
+            work = HEAP_STEP_CHECK;
+        }
+
+        if (bounded && work % HEAP_STEP_CHECK == 0 && (now = thread_clock()) - begin >= heap->step_time) {
+            /* pages charge their sweep themselves */
+            if (heap->state == HEAP_STATE_MARK) {
+                heap->mark_clock += now - begin;
+            }
+            return;
+        }
+    }
+}
+
+/*
+ * Marks everything at once and leaves the sweep to allocation.
+ */
+static void __heap_mark__(environment_t env)
+{
+    unsigned long begin = thread_clock();
+
+    if (env->heap->pool && !env->heap->minor) {
+        __heap_mark_parallel__(env);
+    }
+
+    while (__heap_mark_step__(&env->heap->marker)) {
+        continue;
+    }
+
+    __heap_finish_mark__(env);
+
+    env->heap->mark_clock += thread_clock() - begin;
+}
+
+static void __heap_init_marker__(heap_marker_t marker, heap_t heap, heap_pool_t pool)
+{
+    marker->heap   = heap;
+    marker->gray   = array_new(sizeof(object_t));
+    marker->live   = 0;
+    marker->atomic = pool != NULL;
+    marker->pool   = pool;
+    marker->lock   = pool ? mutex_new() : NULL;
+    marker->head   = 0;
+    marker->count  = 0;
+    marker->epoch  = 0;
+}
+
+static void __heap_free_marker__(heap_marker_t marker)
+{
+    array_free(marker->gray);
+
+    if (marker->lock) {
+        mutex_free(marker->lock);
+    }
+}
+
+/*
+ * Starts the threads of count markers, the first of which runs on the
+ * program's thread. Returns false if none would start; if only some do,
+ * the pool is that much smaller.
+ */
+static bool __heap_start_markers__(heap_t heap, unsigned long count)
+{
+    heap_pool_t   pool;
+    heap_marker_t marker;
+    unsigned long index;
+
+    pool = (heap_pool_t) mem_alloc(sizeof(struct heap_pool_s));
+    if (!pool) {
+        return false;
+    }
+
+    pool->lock     = mutex_new();
+    pool->start    = cond_new();
+    pool->work     = cond_new();
+    pool->finished = cond_new();
+    pool->markers  = (heap_marker_t) mem_alloc(count * sizeof(struct heap_marker_s));
+    pool->threads  = (thread_t*) mem_alloc(count * sizeof(thread_t));
+    pool->size     = 1;
+    pool->epoch    = 0;
+    pool->running  = 0;
+    pool->pending  = 0;
+    pool->idle     = 0;
+    pool->done     = false;
+    pool->quit     = false;
+
+    heap->pool = pool;
+
+    if (!pool->lock || !pool->start || !pool->work || !pool->finished ||
+        !pool->markers || !pool->threads) {
+        pool->size = 0;
+        __heap_stop_markers__(heap);
+        return false;
+    }
+
+    __heap_init_marker__(&pool->markers[0], heap, pool);
+
+    for (index = 1; pool->markers[0].lock && index < count; index++) {
+        marker = &pool->markers[pool->size];
+
+        __heap_init_marker__(marker, heap, pool);
+
+        pool->threads[pool->size] = marker->lock
+                                  ? thread_new(__heap_mark_thread__, marker) : NULL;
+        if (pool->threads[pool->size]) {
+            pool->size++;
+        } else {
+            __heap_free_marker__(marker);
+        }
+    }
+
+    if (pool->size == 1) {
+        __heap_stop_markers__(heap);
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Tells the markers' threads to leave, waits for them and frees the
+ * pool. Called between marks.
+ */
+static void __heap_stop_markers__(heap_t heap)
+{
+    heap_pool_t   pool = heap->pool;
+    unsigned long index;
+
+    if (pool->lock && pool->start) {
+        mutex_lock(pool->lock);
+        pool->quit = true;
+        cond_broadcast(pool->start);
+        mutex_unlock(pool->lock);
+    }
+
+    for (index = 0; index < pool->size; index++) {
+        if (index > 0) {
+            thread_join(pool->threads[index]);
+        }
+        __heap_free_marker__(&pool->markers[index]);
+    }
+
+    if (pool->lock) {
+        mutex_free(pool->lock);
+    }
+    if (pool->start) {
+        cond_free(pool->start);
+    }
+    if (pool->work) {
+        cond_free(pool->work);
+    }
+    if (pool->finished) {
+        cond_free(pool->finished);
+    }
+    if (pool->markers) {
+        mem_free(pool->markers);
+    }
+    if (pool->threads) {
+        mem_free(pool->threads);
+    }
+    mem_free(pool);
+
+    heap->pool = NULL;
+}
+
+/*
+ * Where a marker's thread spends its life: it waits for a mark, takes
+ * part in it, and reports back, until the pool quits.
+ */
+static void __heap_mark_thread__(void *arg)
+{
+    heap_marker_t marker = (heap_marker_t) arg;
+    heap_pool_t   pool   = marker->pool;
+
+    mutex_lock(pool->lock);
+
+    for (;;) {
+        while (marker->epoch == pool->epoch && !pool->quit) {
+            cond_wait(pool->start, pool->lock);
+        }
+
+        if (pool->quit) {
+            break;
+        }
+
+        marker->epoch = pool->epoch;
+
+        mutex_unlock(pool->lock);
+
+        __heap_mark_worker__(marker);
+
+        mutex_lock(pool->lock);
+
+        if (--pool->running == 0) {
+            cond_signal(pool->finished);
+        }
+    }
+
+    mutex_unlock(pool->lock);
+}
+
+/*
+ * Hands the roots the heap's marker has shaded out to the pool's
+ * markers, wakes their threads, runs the first marker here and waits
+ * for the others to be done.
+ */
+static void __heap_mark_parallel__(environment_t env)
+{
+    heap_t        heap = env->heap;
+    heap_pool_t   pool = heap->pool;
+    object_t     *gray;
+    unsigned long index;
+    int           root;
+
+    for (index = 0; index < pool->size; index++) {
+        pool->markers[index].live = 0;
+    }
+
+    array_for_each(heap->marker.gray, gray, root) {
+        *(object_t*) array_push(pool->markers[root % pool->size].gray) = gray[root];
+    }
+    array_clear(heap->marker.gray);
+
+    mutex_lock(pool->lock);
+    pool->pending = 0;
+    pool->idle    = 0;
+    pool->done    = false;
+    pool->running = pool->size - 1;
+    pool->epoch++;
+    cond_broadcast(pool->start);
+    mutex_unlock(pool->lock);
+
+    __heap_mark_worker__(&pool->markers[0]);
+
+    mutex_lock(pool->lock);
+    while (pool->running > 0) {
+        cond_wait(pool->finished, pool->lock);
+    }
+    mutex_unlock(pool->lock);
+
+    for (index = 0; index < pool->size; index++) {
+        heap->marker.live += pool->markers[index].live;
+    }
+}
+
+static void __heap_mark_worker__(void *arg)
+{
+    heap_marker_t marker = (heap_marker_t) arg;
+
+    do {
+        while (__heap_mark_step__(marker)) {
+            if (array_length(marker->gray) > HEAP_MARK_SHARE && thread_load(&marker->count) == 0) {
+                __heap_share__(marker);
+            }
+        }
+    } while (__heap_steal__(marker) || __heap_wait__(marker));
+}
+
+/*
+ * Moves the older half of the marker's gray stack, as much of it as
+ * fits, to its deque, and wakes the markers waiting for work.
+ */
+static void __heap_share__(heap_marker_t marker)
+{
+    heap_pool_t   pool = marker->pool;
+    object_t     *gray;
+    unsigned long half;
+    unsigned long index;
+
+    gray = (object_t*) array_index(marker->gray, 0);
+    half = array_length(marker->gray) / 2;
+
+    mutex_lock(marker->lock);
+
+    if (half > HEAP_MARK_DEQUE - marker->count) {
+        half = HEAP_MARK_DEQUE - marker->count;
+    }
+
+    for (index = 0; index < half; index++) {
+        marker->deque[(marker->head + marker->count + index) % HEAP_MARK_DEQUE] = gray[index];
+    }
+    thread_store(&marker->count, marker->count + half);
+
+    mutex_unlock(marker->lock);
+
+    memmove(gray, gray + half, (array_length(marker->gray) - half) * sizeof(object_t));
+    array_pop_n(marker->gray, half);
+
+    /* a marker going idle counts itself before it looks at pending */
+    thread_fetch_add(&pool->pending, half);
+
+    if (thread_load(&pool->idle) > 0) {
+        mutex_lock(pool->lock);
+        cond_broadcast(pool->work);
+        mutex_unlock(pool->lock);
+    }
+}
+
+/*
+ * Takes half of the first deque that is not empty, starting with the
+ * marker's own. Returns false when all are.
+ */
+static bool __heap_steal__(heap_marker_t marker)
+{
+    heap_pool_t   pool = marker->pool;
+    heap_marker_t victim;
+    unsigned long first = (unsigned long) (marker - pool->markers);
+    unsigned long take;
+    unsigned long taken;
+    unsigned long index;
+
+    for (index = 0; index < pool->size && thread_load(&pool->pending) > 0; index++) {
+        victim = &pool->markers[(first + index) % pool->size];
+
+        if (thread_load(&victim->count) == 0) {
+            continue;
+        }
+
+        mutex_lock(victim->lock);
+
+        take = (victim->count + 1) / 2;
+
+        for (taken = 0; taken < take; taken++) {
+            *(object_t*) array_push(marker->gray) = victim->deque[victim->head];
+            victim->head = (victim->head + 1) % HEAP_MARK_DEQUE;
+        }
+        thread_store(&victim->count, victim->count - take);
+
+        mutex_unlock(victim->lock);
+
+        if (take > 0) {
+            thread_fetch_add(&pool->pending, 0 - take);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Sleeps until there is something to steal, or every marker is idle and
+ * the mark is over, when it returns false.
+ */
+static bool __heap_wait__(heap_marker_t marker)
+{
+    heap_pool_t pool = marker->pool;
+    bool        more;
+
+    mutex_lock(pool->lock);
+
+    thread_fetch_add(&pool->idle, 1);
+
+    for (;;) {
+        if (thread_load(&pool->pending) > 0) {
+            thread_fetch_add(&pool->idle, 0 - 1UL);
+            more = true;
+            break;
+        }
+
+        if (pool->done || thread_load(&pool->idle) == pool->size) {
+            pool->done = true;
+            cond_broadcast(pool->work);
+            more = false;
+            break;
+        }
+
+        cond_wait(pool->work, pool->lock);
+    }
+
+    mutex_unlock(pool->lock);
+    return more;
+}
+
+/*
+ * The marks are complete, so the cycle knows what survived and can set
+ * the next threshold. The young objects that did are promoted, and the
+ * sweep frees the ones that did not along with the rest.
+ */
+static void __heap_finish_mark__(environment_t env)
+{
+    heap_t    heap = env->heap;
+    object_t *young;
+    int       index;
+
+    array_for_each(heap->young, young, index) {
+        if (__heap_object_is_marked__(young[index])) {
+            young[index]->old = true;
+        }
+    }
+    array_clear(heap->young);
+
+    heap->live      = heap->marker.live;
+    heap->state     = heap->pages ? HEAP_STATE_SWEEP : HEAP_STATE_PAUSE;
+    heap->sweep     = heap->pages;
+    heap->allocated = 0;
+    heap->stepped   = 0;
+    heap->promoted  = 0;
+    heap->threshold = heap->live / 100 * heap->pause;
+
+    if (heap->threshold < heap->minimum) {
+        heap->threshold = heap->minimum;
+    }
+
+    heap->cursor      = heap->pages;
+    heap->cursor_word = 0;
+}
+
+/*
+ * Frees the objects of the next page that are used and not marked, and
+ * clears its marks.
+ */
+static void __heap_sweep_page__(heap_t heap)
+{
+    heap_page_t   page = heap->sweep;
+    unsigned long word;
+    unsigned long dead;
+    unsigned long slot;
+    unsigned long begin = thread_clock();
+
+    for (word = 0; word < HEAP_PAGE_WORDS; word++) {
+        dead = page->used[word] & ~page->marks[word];
+
+        page->used[word]  = page->marks[word];
+        page->marks[word] = 0;
+
+        while (dead) {
+            slot  = __heap_lowest_bit__(dead);
+            dead &= dead - 1;
+            __heap_discard_object__(heap, &page->objects[word * HEAP_WORD_BITS + slot]);
+        }
+    }
+
+    __heap_hand_over__(heap);
+
+    heap->sweep = page->next;
+    if (!heap->sweep) {
+        heap->state = HEAP_STATE_PAUSE;
+    }
+
+    heap->sweep_clock += thread_clock() - begin;
+}
+
+static void __heap_minor_gc__(environment_t env)
+{
+    heap_t        heap = env->heap;
+    object_t     *remembered;
+    int           index;
+    unsigned long begin;
+
+    heap->minor = true;
+
+    __heap_start_cycle__(env);
+
+    begin = thread_clock();
+
+    array_for_each(heap->remembered, remembered, index) {
+        remembered[index]->remembered = false;
+        __heap_blacken_object__(&heap->marker, remembered[index]);
+    }
+    array_clear(heap->remembered);
+
+    while (__heap_mark_step__(&heap->marker)) {
+        continue;
+    }
+
+    heap->mark_clock += thread_clock() - begin;
+
+    heap->minor      = false;
+    heap->state      = HEAP_STATE_PAUSE;
+    heap->allocated  = 0;
+    heap->stepped    = 0;
+    heap->promoted  += __heap_sweep_young__(env);
+
+    /* the slots freed can be anywhere */
+    heap->cursor      = heap->pages;
+    heap->cursor_word = 0;
+
+    if (heap->promoted >= heap->threshold) {
+        heap_gc(env);
+    }
+}
+
+/*
+ * Frees the young objects left white and promotes the others. Returns
+ * the bytes promoted.
+ */
+static unsigned long __heap_sweep_young__(environment_t env)
+{
+    heap_t        heap = env->heap;
+    object_t     *young;
+    heap_page_t   page;
+    unsigned long slot;
+    unsigned long promoted = 0;
+    int           index;
+    unsigned long begin = thread_clock();
+
+    array_for_each(heap->young, young, index) {
+        page = __heap_page__(young[index]);
+        slot = __heap_slot__(page, young[index]);
+
+        if (!__heap_is_marked__(page, slot)) {
+            page->used[slot / HEAP_WORD_BITS] &= ~__heap_bit__(slot);
+            __heap_discard_object__(heap, young[index]);
+        } else {
+            __heap_clear_marked__(page, slot);
+            young[index]->old = true;
+            promoted += __heap_object_size__(young[index]);
+        }
+    }
+    array_clear(heap->young);
+
+    __heap_hand_over__(heap);
+
+    heap->sweep_clock += thread_clock() - begin;
+
+    return promoted;
+}
+
+/*
+ * Switching modes starts from a full collection, after which nothing is
+ * young: every object is old in generational mode and none is otherwise.
+ */
+static void __heap_set_generational__(environment_t env, bool generational)
+{
+    heap_t        heap = env->heap;
+    heap_page_t   page;
+    unsigned long slot;
+
+    heap_gc(env);
+
+    heap->generational = generational;
+
+    for (page = heap->pages; page; page = page->next) {
+        for (slot = 0; slot < HEAP_PAGE_OBJECTS; slot++) {
+            if (page->used[slot / HEAP_WORD_BITS] & __heap_bit__(slot)) {
+                page->objects[slot].old = generational;
+            }
+        }
+    }
+}
+
+/*
+ * Returns the bytes the object held.
+ */
+static unsigned long __heap_dispose_object__(object_t obj)
+{
+    unsigned long size = __heap_object_size__(obj);
+
+    switch (obj->type) {
+    case OBJECT_TYPE_STRING:
+        cstring_free(obj->u.string);
+        break;
+
+    case OBJECT_TYPE_ARRAY:
+        array_free(obj->u.array);
+        break;
+
+    case OBJECT_TYPE_TABLE:
+        table_free(obj->u.table);
+        break;
+
+    case OBJECT_TYPE_FUNCTION:
+
+    case OBJECT_TYPE_NATIVE_FUNCTION:
+        mem_free(obj->u.function);
+        break;
+
+    case OBJECT_TYPE_UPVALUE:
+        mem_free(obj->u.upvalue);
+        break;
+
+    default:
+        break;
+    }
+
+    return size;
+}
+
+/*
+ * The slot of a dead object may be taken again as soon as this returns,
+ * so what the sweeper gets is a copy of the header.
+ */
+static void __heap_discard_object__(heap_t heap, object_t obj)
+{
+    heap->stats.objects_freed++;
+
+    if (heap->sweeper) {
+        *(struct object_s*) array_push(heap->garbage) = *obj;
+    } else {
+        heap->stats.bytes_freed += __heap_dispose_object__(obj);
+    }
+}
+
+static void __heap_hand_over__(heap_t heap)
+{
+    heap_sweeper_t sweeper = heap->sweeper;
+
+    if (!sweeper || array_is_empty(heap->garbage)) {
+        return ;
+    }
+
+    mutex_lock(sweeper->lock);
+
+    if (array_is_empty(sweeper->queue)) {
+        array_swap(sweeper->queue, heap->garbage);
+    } else {
+        memcpy(array_push_n(sweeper->queue, array_length(heap->garbage)),
+               heap->garbage->elts, array_length(heap->garbage) * sizeof(struct object_s));
+        array_clear(heap->garbage);
+    }
+
+    cond_signal(sweeper->wake);
+    mutex_unlock(sweeper->lock);
+}
+
+/*
+ * Returns false if the thread cannot be started, in which case the sweep
+ * goes on freeing payloads itself.
+ */
+static bool __heap_start_sweeper__(heap_t heap)
+{
+    heap_sweeper_t sweeper = (heap_sweeper_t) mem_alloc(sizeof(struct heap_sweeper_s));
+    if (!sweeper) {
+        return false;
+    }
+
+    sweeper->lock  = mutex_new();
+    sweeper->wake  = cond_new();
+    sweeper->queue = array_new(sizeof(struct object_s));
+    sweeper->freed = 0;
+    sweeper->quit  = false;
+
+    sweeper->thread = sweeper->lock && sweeper->wake
+                    ? thread_new(__heap_sweeper_main__, sweeper) : NULL;
+
+    if (!sweeper->thread) {
+        if (sweeper->lock) {
+            mutex_free(sweeper->lock);
+        }
+        if (sweeper->wake) {
+            cond_free(sweeper->wake);
+        }
+        array_free(sweeper->queue);
+        mem_free(sweeper);
+        return false;
+    }
+
+    heap->sweeper = sweeper;
+    return true;
+}
+
+/*
+ * The sweeper frees everything it was handed before it leaves.
+ */
+static void __heap_stop_sweeper__(heap_t heap)
+{
+    heap_sweeper_t sweeper = heap->sweeper;
+
+    mutex_lock(sweeper->lock);
+    sweeper->quit = true;
+    cond_signal(sweeper->wake);
+    mutex_unlock(sweeper->lock);
+
+    thread_join(sweeper->thread);
+
+    heap->stats.bytes_freed += sweeper->freed;
+
+    mutex_free(sweeper->lock);
+    cond_free(sweeper->wake);
+    array_free(sweeper->queue);
+    mem_free(sweeper);
+
+    heap->sweeper = NULL;
+}
+
+static void __heap_sweeper_main__(void *arg)
+{
+    heap_sweeper_t  sweeper = (heap_sweeper_t) arg;
+    array_t         batch   = array_new(sizeof(struct object_s));
+    struct object_s *objects;
+    int             index;
+    unsigned long   freed = 0;
+
+    mutex_lock(sweeper->lock);
+
+    for (;;) {
+        while (array_is_empty(sweeper->queue) && !sweeper->quit) {
+            cond_wait(sweeper->wake, sweeper->lock);
+        }
+
+        if (array_is_empty(sweeper->queue)) {
+            break;
+        }
+
+        array_swap(sweeper->queue, batch);
+
+        mutex_unlock(sweeper->lock);
+
+        array_for_each(batch, objects, index) {
+            freed += __heap_dispose_object__(&objects[index]);
+        }
+        array_clear(batch);
+
+        mutex_lock(sweeper->lock);
+        sweeper->freed += freed;
+        freed           = 0;
+    }
+
+    mutex_unlock(sweeper->lock);
+
+    array_free(batch);
+}
+
+static void __heap_shade_object__(heap_marker_t marker, object_t obj)
+{
+    heap_page_t   page;
+    unsigned long slot;
+
+    if (obj->constant || (marker->heap->minor && obj->old)) {
+        return ;
+    }
+
+    page = __heap_page__(obj);
+    slot = __heap_slot__(page, obj);
+
+    if (!marker->atomic) {
+        if (__heap_is_marked__(page, slot)) {
+            return ;
+        }
+        __heap_set_marked__(page, slot);
+
+    } else if ((thread_load(&page->marks[slot / HEAP_WORD_BITS]) & __heap_bit__(slot)) ||
+               (thread_fetch_or(&page->marks[slot / HEAP_WORD_BITS], __heap_bit__(slot)) & __heap_bit__(slot))) {
+        /* another marker got there first */
+        return ;
+    }
+
+    *(object_t*) array_push(marker->gray) = obj;
+}
+
+static bool __heap_object_is_marked__(object_t obj)
+{
+    heap_page_t page = __heap_page__(obj);
+
+    return __heap_is_marked__(page, __heap_slot__(page, obj));
+}
+
+static void __heap_shade_value__(heap_marker_t marker, value_t value)
+{
+    if (__heap_value_is_object__(value)) {
+        __heap_shade_object__(marker, value->u.object_value);
+    }
+}
+
+/*
+ * Blackens the object on top of the gray stack and, in a full mark,
+ * counts it as live. Returns false when the stack is empty.
+ */
+static bool __heap_mark_step__(heap_marker_t marker)
+{
+    object_t *gray;
+    object_t  obj;
+    long      length;
+
+    length = array_length(marker->gray);
+    if (length == 0) {
+        return false;
+    }
+
+    gray = (object_t*) array_index(marker->gray, 0);
+
+    if (length > HEAP_PREFETCH_DISTANCE * 2) {
+        __heap_prefetch__(gray[length - 1 - HEAP_PREFETCH_DISTANCE * 2]);
+    }
+
+    if (length > HEAP_PREFETCH_DISTANCE) {
+        __heap_prefetch__(gray[length - 1 - HEAP_PREFETCH_DISTANCE]->u.table);
+    }
+
+    obj = gray[length - 1];
+    array_pop(marker->gray);
+
+    if (!marker->heap->minor) {
+        marker->live += __heap_object_size__(obj);
+    }
+
+    __heap_blacken_object__(marker, obj);
+
+    return true;
+}
+
+static void __heap_blacken_object__(heap_marker_t marker, object_t obj)
+{
+    value_t base;
+    int index;
+    table_pair_t variable;
+    unsigned long cursor;
+
+    switch (obj->type) {
+    case OBJECT_TYPE_NATIVE_FUNCTION:
+    case OBJECT_TYPE_FUNCTION:
+        for (index = 0; index < (int) obj->u.function->nupvalues; index++) {
+            if (obj->u.function->upvalues[index]) {
+                __heap_shade_object__(marker, obj->u.function->upvalues[index]);
+            }
+        }
+        break;
+
+    case OBJECT_TYPE_UPVALUE:
+        /* an open upvalue's slot is shaded with the frame holding it */
+        if (!obj->u.upvalue->open) {
+            __heap_shade_value__(marker, &obj->u.upvalue->closed);
+        }
+        break;
+
+    case OBJECT_TYPE_ARRAY:
+        array_for_each(obj->u.array, base, index) {
+            __heap_shade_value__(marker, &base[index]);
+        }
+        break;
+
+    case OBJECT_TYPE_TABLE:
+        table_for_each(obj->u.table, cursor, variable) {
+            __heap_shade_value__(marker, &variable->key);
+            __heap_shade_value__(marker, &variable->value);
+        }
+        break;
+
+    default:
+        break;
+    }
+}
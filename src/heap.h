@@ -5,9 +5,37 @@
 
 #include "config.h"
 
+#include <stdio.h>
+
+/* pauses of less than 1 << n microseconds go into bucket n, the last
+   bucket taking the rest */
+#define HEAP_PAUSE_BUCKETS (24)
+
+typedef struct heap_stats_s* heap_stats_t;
+
+struct heap_stats_s {
+    unsigned long collections;
+    unsigned long minor_collections;
+    unsigned long objects_allocated;
+    unsigned long bytes_allocated;      /* as charged when allocated */
+    unsigned long objects_freed;
+    unsigned long bytes_freed;          /* as held when freed */
+    unsigned long live;                 /* bytes that survived the last full mark */
+    unsigned long pause_count;
+    unsigned long pause_total;          /* microseconds of wall time */
+    unsigned long pause_max;
+    unsigned long pauses[HEAP_PAUSE_BUCKETS];
+};
+
 heap_t heap_new(void);
 void heap_free(heap_t heap);
 void heap_gc(environment_t env);
+void heap_barrier(environment_t env, value_t value);
+void heap_barrier_object(environment_t env, object_t object);
+long heap_get_param(environment_t env, const char *name);
+bool heap_set_param(environment_t env, const char *name, long value);
+void heap_get_stats(environment_t env, heap_stats_t stats);
+void heap_dump_stats(environment_t env, FILE *fp);
 object_t heap_alloc_str(environment_t env, const char* str);
 object_t heap_alloc_string(environment_t env, cstring_t cstr);
 object_t heap_alloc_string_n(environment_t env, unsigned long n);
@@ -16,6 +44,8 @@ object_t heap_alloc_array_n(environment_t env, unsigned long n);
 object_t heap_alloc_table(environment_t env);
 object_t heap_alloc_function(environment_t env, expression_function_t function_expr);
 object_t heap_alloc_native_function(environment_t env, native_function_pt native_function);
+object_t heap_alloc_upvalue(environment_t env, unsigned long index);
+object_t heap_symbol_string(symbol_t symbol);
 void     heap_hold_value(environment_t env, value_t v);
 void     heap_drop_value(environment_t env, value_t v);
 
@@ -12,12 +12,12 @@
 static void native_file_open(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
     FILE* fp;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t*);
+    values = array_base(value->u.object_value->u.array, value_t);
 
     if (argc < 2) {
         environment_pop_value(env);
@@ -25,8 +25,8 @@ static void native_file_open(environment_t env, unsigned int argc)
         return;
     }
 
-    fp = fopen(native_check_string_value(values[0]),
-        native_check_string_value(values[1]));
+    fp = fopen(native_check_string_value(&values[0]),
+        native_check_string_value(&values[1]));
 
     environment_push_pointer(env, (void*)fp);
 
@@ -38,11 +38,11 @@ static void native_file_open(environment_t env, unsigned int argc)
 static void native_file_close(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t*);
+    values = array_base(value->u.object_value->u.array, value_t);
 
     if (argc < 1) {
         environment_pop_value(env);
@@ -50,7 +50,7 @@ static void native_file_close(environment_t env, unsigned int argc)
         return;
     }
 
-    environment_push_int(env, fclose((FILE*)native_check_pointer_value(values[0])));
+    environment_push_int(env, fclose((FILE*)native_check_pointer_value(&values[0])));
 
     environment_xchg_stack(env);
 
@@ -60,11 +60,11 @@ static void native_file_close(environment_t env, unsigned int argc)
 static void native_file_read(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t*);
+    values = array_base(value->u.object_value->u.array, value_t);
 
     if (argc < 3) {
         environment_pop_value(env);
@@ -72,10 +72,10 @@ static void native_file_read(environment_t env, unsigned int argc)
         return;
     }
 
-    environment_push_int(env, fread((void*)native_check_pointer_value(values[1]),
+    environment_push_int(env, fread((void*)native_check_pointer_value(&values[1]),
         1,
-        native_check_int_value(values[2]),
-        (FILE*)native_check_pointer_value(values[0])));
+        native_check_int_value(&values[2]),
+        (FILE*)native_check_pointer_value(&values[0])));
 
     environment_xchg_stack(env);
 
@@ -85,11 +85,11 @@ static void native_file_read(environment_t env, unsigned int argc)
 static void native_file_write(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t*);
+    values = array_base(value->u.object_value->u.array, value_t);
 
     if (argc < 3) {
         environment_pop_value(env);
@@ -97,10 +97,10 @@ static void native_file_write(environment_t env, unsigned int argc)
         return;
     }
 
-    environment_push_int(env, fwrite((void*)native_check_pointer_value(values[1]),
+    environment_push_int(env, fwrite((void*)native_check_pointer_value(&values[1]),
             1,
-            native_check_int_value(values[2]),
-            (FILE*)native_check_pointer_value(values[0])));
+            native_check_int_value(&values[2]),
+            (FILE*)native_check_pointer_value(&values[0])));
 
     environment_xchg_stack(env);
 
@@ -115,13 +115,13 @@ void import_file_library(environment_t env)
     };
 
     int i;
-    value_t string_table;
+    table_t string_table;
 
     environment_push_str(env, "file");
 
     environment_push_table(env);
 
-    string_table = list_element(list_rbegin(env->stack), value_t, link);
+    string_table = environment_stack_top(env)->u.object_value->u.table;
 
     table_push_pair(environment_get_global_table(env), env);
 
@@ -135,6 +135,6 @@ void import_file_library(environment_t env)
     for (i = 0; i < sizeof(pairs) / sizeof(struct pair_s); i++) {
         environment_push_str(env, pairs[i].name);
         environment_push_native_function(env, pairs[i].func);
-        table_push_pair(string_table->u.object_value->u.table, env);
+        table_push_pair(string_table, env);
     }
 }
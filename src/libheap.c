@@ -12,11 +12,11 @@
 static void native_heap_alloc(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t*);
+    values = array_base(value->u.object_value->u.array, value_t);
 
     if (argc < 1) {
         environment_pop_value(env);
@@ -24,7 +24,7 @@ static void native_heap_alloc(environment_t env, unsigned int argc)
         return;
     }
 
-    environment_push_pointer(env, (void*)malloc(native_check_int_value(values[0])));
+    environment_push_pointer(env, (void*)malloc(native_check_int_value(&values[0])));
 
     environment_xchg_stack(env);
 
@@ -34,11 +34,11 @@ static void native_heap_alloc(environment_t env, unsigned int argc)
 static void native_heap_free(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t*);
+    values = array_base(value->u.object_value->u.array, value_t);
 
     if (argc < 1) {
         environment_pop_value(env);
@@ -46,7 +46,7 @@ static void native_heap_free(environment_t env, unsigned int argc)
         return;
     }
 
-    free(native_check_pointer_value(values[0]));
+    free(native_check_pointer_value(&values[0]));
 
     environment_pop_value(env);
 
@@ -61,13 +61,13 @@ void import_heap_library(environment_t env)
     };
 
     int i;
-    value_t string_table;
+    table_t string_table;
 
     environment_push_str(env, "heap");
 
     environment_push_table(env);
 
-    string_table = list_element(list_rbegin(env->stack), value_t, link);
+    string_table = environment_stack_top(env)->u.object_value->u.table;
 
     table_push_pair(environment_get_global_table(env), env);
 
@@ -79,6 +79,6 @@ void import_heap_library(environment_t env)
     for (i = 0; i < sizeof(pairs) / sizeof(struct pair_s); i++) {
         environment_push_str(env, pairs[i].name);
         environment_push_native_function(env, pairs[i].func);
-        table_push_pair(string_table->u.object_value->u.table, env);
+        table_push_pair(string_table, env);
     }
 }
\ No newline at end of file
@@ -14,11 +14,11 @@
 static void native_math_sqrt(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t*);
+    values = array_base(value->u.object_value->u.array, value_t);
 
     if (argc < 1) {
         environment_pop_value(env);
@@ -26,7 +26,7 @@ static void native_math_sqrt(environment_t env, unsigned int argc)
         return;
     }
 
-    environment_push_double(env, sqrt(native_check_double_value(values[0])));
+    environment_push_double(env, sqrt(native_check_double_value(&values[0])));
 
     environment_xchg_stack(env);
 
@@ -36,11 +36,11 @@ static void native_math_sqrt(environment_t env, unsigned int argc)
 static void native_math_sin(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t*);
+    values = array_base(value->u.object_value->u.array, value_t);
 
     if (argc < 1) {
         environment_pop_value(env);
@@ -48,7 +48,7 @@ static void native_math_sin(environment_t env, unsigned int argc)
         return;
     }
 
-    environment_push_double(env, sin(native_check_double_value(values[0])));
+    environment_push_double(env, sin(native_check_double_value(&values[0])));
 
     environment_xchg_stack(env);
     
@@ -58,11 +58,11 @@ static void native_math_sin(environment_t env, unsigned int argc)
 static void native_math_cos(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t*);
+    values = array_base(value->u.object_value->u.array, value_t);
 
     if (argc < 1) {
         environment_pop_value(env);
@@ -70,7 +70,7 @@ static void native_math_cos(environment_t env, unsigned int argc)
         return;
     }
 
-    environment_push_double(env, cos(native_check_double_value(values[0])));
+    environment_push_double(env, cos(native_check_double_value(&values[0])));
 
     environment_xchg_stack(env);
 
@@ -80,11 +80,11 @@ static void native_math_cos(environment_t env, unsigned int argc)
 static void native_math_tan(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t*);
+    values = array_base(value->u.object_value->u.array, value_t);
 
     if (argc < 1) {
         environment_pop_value(env);
@@ -92,7 +92,7 @@ static void native_math_tan(environment_t env, unsigned int argc)
         return;
     }
 
-    environment_push_double(env, tan(native_check_double_value(values[0])));
+    environment_push_double(env, tan(native_check_double_value(&values[0])));
 
     environment_xchg_stack(env);
 
@@ -102,11 +102,11 @@ static void native_math_tan(environment_t env, unsigned int argc)
 static void native_math_asin(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t*);
+    values = array_base(value->u.object_value->u.array, value_t);
 
     if (argc < 1) {
         environment_pop_value(env);
@@ -114,7 +114,7 @@ static void native_math_asin(environment_t env, unsigned int argc)
         return;
     }
 
-    environment_push_double(env, asin(native_check_double_value(values[0])));
+    environment_push_double(env, asin(native_check_double_value(&values[0])));
 
     environment_xchg_stack(env);
 
@@ -124,11 +124,11 @@ static void native_math_asin(environment_t env, unsigned int argc)
 static void native_math_acos(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t*);
+    values = array_base(value->u.object_value->u.array, value_t);
 
     if (argc < 1) {
         environment_pop_value(env);
@@ -136,7 +136,7 @@ static void native_math_acos(environment_t env, unsigned int argc)
         return;
     }
 
-    environment_push_double(env, acos(native_check_double_value(values[0])));
+    environment_push_double(env, acos(native_check_double_value(&values[0])));
 
     environment_xchg_stack(env);
 
@@ -146,11 +146,11 @@ static void native_math_acos(environment_t env, unsigned int argc)
 static void native_math_atan(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t*);
+    values = array_base(value->u.object_value->u.array, value_t);
 
     if (argc < 1) {
         environment_pop_value(env);
@@ -158,7 +158,7 @@ static void native_math_atan(environment_t env, unsigned int argc)
         return;
     }
 
-    environment_push_double(env, atan(native_check_double_value(values[0])));
+    environment_push_double(env, atan(native_check_double_value(&values[0])));
 
     environment_xchg_stack(env);
 
@@ -168,11 +168,11 @@ static void native_math_atan(environment_t env, unsigned int argc)
 static void native_math_atan2(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t *);
+    values = array_base(value->u.object_value->u.array, value_t);
 
     if (argc < 2) {
         environment_pop_value(env);
@@ -181,8 +181,8 @@ static void native_math_atan2(environment_t env, unsigned int argc)
     }
 
     environment_push_double(env, atan2(
-        native_check_double_value(values[0]),
-        native_check_double_value(values[1])
+        native_check_double_value(&values[0]),
+        native_check_double_value(&values[1])
         ));
 
     environment_xchg_stack(env);
@@ -193,11 +193,11 @@ static void native_math_atan2(environment_t env, unsigned int argc)
 static void native_math_sinh(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t*);
+    values = array_base(value->u.object_value->u.array, value_t);
 
     if (argc < 1) {
         environment_pop_value(env);
@@ -205,7 +205,7 @@ static void native_math_sinh(environment_t env, unsigned int argc)
         return;
     }
 
-    environment_push_double(env, sinh(native_check_double_value(values[0])));
+    environment_push_double(env, sinh(native_check_double_value(&values[0])));
 
     environment_xchg_stack(env);
 
@@ -215,11 +215,11 @@ static void native_math_sinh(environment_t env, unsigned int argc)
 static void native_math_cosh(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t*);
+    values = array_base(value->u.object_value->u.array, value_t);
 
     if (argc < 1) {
         environment_pop_value(env);
@@ -227,7 +227,7 @@ static void native_math_cosh(environment_t env, unsigned int argc)
         return;
     }
 
-    environment_push_double(env, cosh(native_check_double_value(values[0])));
+    environment_push_double(env, cosh(native_check_double_value(&values[0])));
 
     environment_xchg_stack(env);
 
@@ -237,11 +237,11 @@ static void native_math_cosh(environment_t env, unsigned int argc)
 static void native_math_tanh(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t*);
+    values = array_base(value->u.object_value->u.array, value_t);
 
     if (argc < 1) {
         environment_pop_value(env);
@@ -249,7 +249,7 @@ static void native_math_tanh(environment_t env, unsigned int argc)
         return;
     }
 
-    environment_push_double(env, tanh(native_check_double_value(values[0])));
+    environment_push_double(env, tanh(native_check_double_value(&values[0])));
 
     environment_xchg_stack(env);
 
@@ -284,17 +284,17 @@ void import_math_library(environment_t env)
     };
 
     int i;
-    value_t math_table;
+    table_t math_table;
 
     environment_push_str(env, "math");
 
     environment_push_table(env);
 
-    math_table = list_element(list_rbegin(env->stack), value_t, link);
+    math_table = environment_stack_top(env)->u.object_value->u.table;
 
     table_push_pair(environment_get_global_table(env), env);
 
-    import_math_const(env, math_table->u.object_value->u.table);
+    import_math_const(env, math_table);
 
     struct pair_s pairs[] = {
         { "sqrt",         native_math_sqrt },
@@ -311,6 +311,6 @@ void import_math_library(environment_t env)
     for (i = 0; i < sizeof(pairs) / sizeof(struct pair_s); i++) {
         environment_push_str(env, pairs[i].name);
         environment_push_native_function(env, pairs[i].func);
-        table_push_pair(math_table->u.object_value->u.table, env);
+        table_push_pair(math_table, env);
     }
 }
\ No newline at end of file
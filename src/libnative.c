@@ -4,6 +4,7 @@
 #include "error.h"
 #include "evaluator.h"
 #include "environment.h"
+#include "table.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -48,13 +49,13 @@ static void print_value(value_t value)
     {
         int index;
         int last;
-        value_t* base;
+        value_t  base;
 
         last = array_length(value->u.object_value->u.array) - 1;
 
         printf("[");
         array_for_each(value->u.object_value->u.array, base, index) {
-            print_value(base[index]);
+            print_value(&base[index]);
             if (last != index) {
                 printf(", ");
             }
@@ -65,23 +66,21 @@ static void print_value(value_t value)
 
     case VALUE_TYPE_TABLE:
     {
-        hash_table_iter_t hiter;
+        unsigned long cursor;
         table_pair_t pair;
         int index;
         int last;
 
         index = 0;
-        last = hash_table_size(value->u.object_value->u.table->table) - 1;
+        last = table_size(value->u.object_value->u.table) - 1;
 
         printf("{");
-        hash_table_for_each(value->u.object_value->u.table->table, hiter) {
-            pair = hash_table_iter_element(hiter, table_pair_t, link);
-
-            print_value(pair->key);
+        table_for_each(value->u.object_value->u.table, cursor, pair) {
+            print_value(&pair->key);
 
             printf(":");
 
-            print_value(pair->value);
+            print_value(&pair->value);
 
             if (last != index++) {
                 printf(", ");
@@ -109,13 +108,13 @@ static void print_value(value_t value)
 static void native_print(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
     int i;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
     array_for_each(value->u.object_value->u.array, values, i) {
-        print_value(values[i]);
+        print_value(&values[i]);
     }
 
     environment_pop_value(env);
@@ -125,11 +124,11 @@ static void native_print(environment_t env, unsigned int argc)
 static void native_type(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t*);
+    values = array_base(value->u.object_value->u.array, value_t);
 
     environment_pop_value(env);
 
@@ -138,7 +137,7 @@ static void native_type(environment_t env, unsigned int argc)
         return;
     }
 
-    switch (values[0]->type) {
+    switch (values[0].type) {
     case VALUE_TYPE_ARRAY:
         environment_push_str(env, "array");
         return;
@@ -197,11 +196,11 @@ static void native_type(environment_t env, unsigned int argc)
 static void native_len(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t*);
+    values = array_base(value->u.object_value->u.array, value_t);
 
     environment_pop_value(env);
 
@@ -210,15 +209,15 @@ static void native_len(environment_t env, unsigned int argc)
         return;
     }
 
-    switch (values[0]->type) {
+    switch (values[0].type) {
     case VALUE_TYPE_ARRAY:
-        environment_push_int(env, array_length(values[0]->u.object_value->u.array));
+        environment_push_int(env, array_length(values[0].u.object_value->u.array));
         return;
     case VALUE_TYPE_TABLE:
-        environment_push_int(env, hash_table_size(values[0]->u.object_value->u.table->table));
+        environment_push_int(env, table_size(values[0].u.object_value->u.table));
         return;
     case VALUE_TYPE_STRING:
-        environment_push_int(env, cstring_length(values[0]->u.object_value->u.string));
+        environment_push_int(env, cstring_length(values[0].u.object_value->u.string));
         return;
     default:
         environment_push_int(env, 0);
@@ -18,6 +18,116 @@ static void native_runtime_gc(environment_t env, unsigned int argc)
     environment_push_null(env);
 }
 
+/*
+ * runtime.gc_param(name [, value]) returns the collector setting called
+ * name, and sets it to value when one is given. "pause", "minimum",
+ * "incremental", "step_size", "step_time", "generational", "nursery",
+ * "mark_threads" and "background_sweep" can be set; "threshold",
+ * "allocated", "live", "promoted", "mark_time" and "sweep_time" are
+ * read-only, the last two being the microseconds of wall time
+ * spent in each phase. "incremental" and "generational" exclude each
+ * other, so one must be off before the other is turned on.
+ * "mark_threads" is experimental: sharing the mark has not been measured
+ * on more than one core yet.
+ */
+static void native_runtime_gc_param(environment_t env, unsigned int argc)
+{
+    value_t     value;
+    value_t     values;
+    const char *name;
+    long        old;
+
+    value = environment_stack_top(env);
+
+    values = array_base(value->u.object_value->u.array, value_t);
+
+    if (argc < 1) {
+        environment_pop_value(env);
+        environment_push_null(env);
+        return;
+    }
+
+    name = native_check_string_value(&values[0]);
+
+    old = heap_get_param(env, name);
+    if (old < 0) {
+        runtime_error("unknown gc parameter '%s'", name);
+    }
+
+    if (argc > 1 && !heap_set_param(env, name, native_check_long_value(&values[1]))) {
+        runtime_error("gc parameter '%s' cannot be set to %ld", name, native_check_long_value(&values[1]));
+    }
+
+    environment_push_long(env, old);
+
+    environment_xchg_stack(env);
+
+    environment_pop_value(env);
+}
+
+/*
+ * runtime.gc_stats() returns a table of what the collector has done so
+ * far: "collections", "minor_collections", "objects_allocated",
+ * "bytes_allocated", "objects_freed", "bytes_freed", "live",
+ * "pause_count", "pause_total" and "pause_max", pauses being in
+ * microseconds of wall time, and "pauses", an array counting in
+ * element n the pauses of less than 1 << n microseconds that are not
+ * counted in an earlier one.
+ */
+static void __runtime_push_stat__(environment_t env, object_t table, const char *name, unsigned long value)
+{
+    environment_push_str(env, name);
+    environment_push_long(env, (long) value);
+
+    /* making the key may have promoted the table */
+    heap_barrier_object(env, table);
+    table_push_pair(table->u.table, env);
+}
+
+static void native_runtime_gc_stats(environment_t env, unsigned int argc)
+{
+    struct heap_stats_s stats;
+    object_t            table;
+    array_t             pauses;
+    value_t             value;
+    int                 i;
+
+    heap_get_stats(env, &stats);
+
+    environment_push_table(env);
+
+    table = environment_stack_top(env)->u.object_value;
+
+    __runtime_push_stat__(env, table, "collections",       stats.collections);
+    __runtime_push_stat__(env, table, "minor_collections", stats.minor_collections);
+    __runtime_push_stat__(env, table, "objects_allocated", stats.objects_allocated);
+    __runtime_push_stat__(env, table, "bytes_allocated",   stats.bytes_allocated);
+    __runtime_push_stat__(env, table, "objects_freed",     stats.objects_freed);
+    __runtime_push_stat__(env, table, "bytes_freed",       stats.bytes_freed);
+    __runtime_push_stat__(env, table, "live",              stats.live);
+    __runtime_push_stat__(env, table, "pause_count",       stats.pause_count);
+    __runtime_push_stat__(env, table, "pause_total",       stats.pause_total);
+    __runtime_push_stat__(env, table, "pause_max",         stats.pause_max);
+
+    environment_push_str(env, "pauses");
+    environment_push_array(env);
+
+    pauses = environment_stack_top(env)->u.object_value->u.array;
+
+    for (i = 0; i < HEAP_PAUSE_BUCKETS; i++) {
+        value               = (value_t) array_push(pauses);
+        value->type         = VALUE_TYPE_LONG;
+        value->u.long_value = (long) stats.pauses[i];
+    }
+
+    heap_barrier_object(env, table);
+    table_push_pair(table->u.table, env);
+
+    environment_xchg_stack(env);
+
+    environment_pop_value(env);
+}
+
 void import_runtime_library(environment_t env)
 {
     struct pair_s {
@@ -26,23 +136,25 @@ void import_runtime_library(environment_t env)
     };
 
     int i;
-    value_t runtime_table;
+    table_t runtime_table;
 
     environment_push_str(env, "runtime");
 
     environment_push_table(env);
 
-    runtime_table = list_element(list_rbegin(env->stack), value_t, link);
+    runtime_table = environment_stack_top(env)->u.object_value->u.table;
 
     table_push_pair(environment_get_global_table(env), env);
    
     struct pair_s pairs[] = {
         { "gc",         native_runtime_gc },
+        { "gc_param",   native_runtime_gc_param },
+        { "gc_stats",   native_runtime_gc_stats },
     };
 
     for (i = 0; i < sizeof(pairs) / sizeof(struct pair_s); i++) {
         environment_push_str(env, pairs[i].name);
         environment_push_native_function(env, pairs[i].func);
-        table_push_pair(runtime_table->u.object_value->u.table, env);
+        table_push_pair(runtime_table, env);
     }
 }
\ No newline at end of file
@@ -33,12 +33,12 @@ static void native_sdl_quit(environment_t env, unsigned int argc)
 static void native_sdl_create_window(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
     SDL_Window* window = NULL;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t*);
+    values = array_base(value->u.object_value->u.array, value_t);
 
     if (argc < 6) {
         environment_pop_value(env);
@@ -46,12 +46,12 @@ static void native_sdl_create_window(environment_t env, unsigned int argc)
         return;
     }
 
-    window = SDL_CreateWindow(native_check_string_value(values[0]),
-                              native_check_int_value(values[1]),
-                              native_check_int_value(values[2]),
-                              native_check_int_value(values[3]),
-                              native_check_int_value(values[4]),
-                              native_check_int_value(values[5]));
+    window = SDL_CreateWindow(native_check_string_value(&values[0]),
+                              native_check_int_value(&values[1]),
+                              native_check_int_value(&values[2]),
+                              native_check_int_value(&values[3]),
+                              native_check_int_value(&values[4]),
+                              native_check_int_value(&values[5]));
 
     if (window) {
         environment_push_pointer(env, (void*)window);
@@ -67,17 +67,17 @@ static void native_sdl_create_window(environment_t env, unsigned int argc)
 static void native_sdl_destroy_window(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t*);
+    values = array_base(value->u.object_value->u.array, value_t);
 
     if (argc < 1) {
         goto leave;
     }
 
-    SDL_DestroyWindow((SDL_Window*)native_check_pointer_value(values[0]));
+    SDL_DestroyWindow((SDL_Window*)native_check_pointer_value(&values[0]));
 
 leave:
     environment_pop_value(env);
@@ -88,12 +88,12 @@ leave:
 static void native_sdl_create_renderer(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
     SDL_Renderer* renderer = NULL;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t*);
+    values = array_base(value->u.object_value->u.array, value_t);
 
     if (argc < 3) {
         environment_pop_value(env);
@@ -101,9 +101,9 @@ static void native_sdl_create_renderer(environment_t env, unsigned int argc)
         return;
     }
 
-    renderer = SDL_CreateRenderer((SDL_Window*)native_check_pointer_value(values[0]),
-                                   native_check_int_value(values[1]),
-                                   native_check_int_value(values[2]));
+    renderer = SDL_CreateRenderer((SDL_Window*)native_check_pointer_value(&values[0]),
+                                   native_check_int_value(&values[1]),
+                                   native_check_int_value(&values[2]));
 
     if (renderer) {
         environment_push_pointer(env, (void*)renderer);
@@ -119,17 +119,17 @@ static void native_sdl_create_renderer(environment_t env, unsigned int argc)
 static void native_sdl_destroy_renderer(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t*);
+    values = array_base(value->u.object_value->u.array, value_t);
 
     if (argc < 1) {
         goto leave;
     }
 
-    SDL_DestroyRenderer((SDL_Renderer*)native_check_pointer_value(values[0]));
+    SDL_DestroyRenderer((SDL_Renderer*)native_check_pointer_value(&values[0]));
 
 leave:
     environment_pop_value(env);
@@ -140,17 +140,17 @@ leave:
 static void native_sdl_renderer_clear(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t*);
+    values = array_base(value->u.object_value->u.array, value_t);
 
     if (argc < 1) {
         goto leave;
     }
 
-    SDL_RenderClear((SDL_Renderer*)native_check_pointer_value(values[0]));
+    SDL_RenderClear((SDL_Renderer*)native_check_pointer_value(&values[0]));
 
 leave:
     environment_pop_value(env);
@@ -161,17 +161,17 @@ leave:
 static void native_sdl_renderer_present(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t*);
+    values = array_base(value->u.object_value->u.array, value_t);
 
     if (argc < 1) {
         goto leave;
     }
 
-    SDL_RenderPresent((SDL_Renderer*)native_check_pointer_value(values[0]));
+    SDL_RenderPresent((SDL_Renderer*)native_check_pointer_value(&values[0]));
 
 leave:
 
@@ -183,20 +183,20 @@ leave:
 static void native_sdl_renderer_copy(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t*);
+    values = array_base(value->u.object_value->u.array, value_t);
 
     if (argc < 4) {
         goto leave;
     }
 
-    SDL_RenderCopy((SDL_Renderer*)native_check_pointer_value(values[0]),
-                   (SDL_Texture*)native_check_pointer_value(values[1]),
-                   (SDL_Rect*)native_check_pointer_value(values[2]),
-                   (SDL_Rect*)native_check_pointer_value(values[3]));
+    SDL_RenderCopy((SDL_Renderer*)native_check_pointer_value(&values[0]),
+                   (SDL_Texture*)native_check_pointer_value(&values[1]),
+                   (SDL_Rect*)native_check_pointer_value(&values[2]),
+                   (SDL_Rect*)native_check_pointer_value(&values[3]));
 
 leave:
 
@@ -208,12 +208,12 @@ leave:
 static void native_sdl_load_bitmap(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
     SDL_Surface *bmp = NULL;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t*);
+    values = array_base(value->u.object_value->u.array, value_t);
 
     if (argc < 1) {
         environment_pop_value(env);
@@ -221,7 +221,7 @@ static void native_sdl_load_bitmap(environment_t env, unsigned int argc)
         return;
     }
 
-    bmp = SDL_LoadBMP(native_check_string_value(values[0]));
+    bmp = SDL_LoadBMP(native_check_string_value(&values[0]));
 
     if (bmp) {
         environment_push_pointer(env, (void*)bmp);
@@ -237,17 +237,17 @@ static void native_sdl_load_bitmap(environment_t env, unsigned int argc)
 static void native_sdl_free_surface(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t*);
+    values = array_base(value->u.object_value->u.array, value_t);
 
     if (argc < 1) {
         goto leave;
     }
 
-    SDL_FreeSurface((SDL_Surface*)native_check_pointer_value(values[0]));
+    SDL_FreeSurface((SDL_Surface*)native_check_pointer_value(&values[0]));
 
 leave:
     environment_pop_value(env);
@@ -258,12 +258,12 @@ leave:
 static void native_sdl_create_texture_from_surface(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
     SDL_Texture *texture = NULL;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t*);
+    values = array_base(value->u.object_value->u.array, value_t);
    
     if (argc < 2) {
         environment_pop_value(env);
@@ -271,8 +271,8 @@ static void native_sdl_create_texture_from_surface(environment_t env, unsigned i
         return;
     }
 
-    texture = SDL_CreateTextureFromSurface((SDL_Renderer*)native_check_pointer_value(values[0]),
-                                           (SDL_Surface*)native_check_pointer_value(values[1]));
+    texture = SDL_CreateTextureFromSurface((SDL_Renderer*)native_check_pointer_value(&values[0]),
+                                           (SDL_Surface*)native_check_pointer_value(&values[1]));
 
     if (texture) {
         environment_push_pointer(env, (void*)texture);
@@ -288,17 +288,17 @@ static void native_sdl_create_texture_from_surface(environment_t env, unsigned i
 static void native_sdl_destroy_texture(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t*);
+    values = array_base(value->u.object_value->u.array, value_t);
 
     if (argc < 1) {
         goto leave;
     }
 
-    SDL_DestroyTexture((SDL_Texture *)native_check_pointer_value(values[0]));
+    SDL_DestroyTexture((SDL_Texture *)native_check_pointer_value(&values[0]));
 
 leave:
     environment_pop_value(env);
@@ -308,18 +308,18 @@ leave:
 static void native_sdl_delay(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
     SDL_Window* window = NULL;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t*);
+    values = array_base(value->u.object_value->u.array, value_t);
 
     if (argc < 1) {
         goto leave;
     }
 
-    SDL_Delay(native_check_int_value(values[0]));
+    SDL_Delay(native_check_int_value(&values[0]));
 
 leave:
     environment_pop_value(env);
@@ -329,12 +329,12 @@ leave:
 static void native_sdl_create_event(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
     SDL_Event* event = NULL;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t*);
+    values = array_base(value->u.object_value->u.array, value_t);
 
     environment_pop_value(env);
 
@@ -346,11 +346,11 @@ static void native_sdl_create_event(environment_t env, unsigned int argc)
 static void native_sdl_destroy_event(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t*);
+    values = array_base(value->u.object_value->u.array, value_t);
 
     environment_pop_value(env);
 
@@ -358,7 +358,7 @@ static void native_sdl_destroy_event(environment_t env, unsigned int argc)
         goto leave;
     }
 
-    mem_free(native_check_pointer_value(values[0]));
+    mem_free(native_check_pointer_value(&values[0]));
 
 leave:
     environment_push_null(env);
@@ -367,11 +367,11 @@ leave:
 static void native_sdl_poll_event(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t*);
+    values = array_base(value->u.object_value->u.array, value_t);
 
     if (argc < 1) {
         environment_pop_value(env);
@@ -379,9 +379,9 @@ static void native_sdl_poll_event(environment_t env, unsigned int argc)
         return;
     }
 
-    SDL_PollEvent((SDL_Event*)native_check_pointer_value(values[0]));
+    SDL_PollEvent((SDL_Event*)native_check_pointer_value(&values[0]));
 
-    environment_push_int(env, (int)((SDL_Event*)values[0]->u.pointer_value)->type);
+    environment_push_int(env, (int)((SDL_Event*)values[0].u.pointer_value)->type);
 
     environment_xchg_stack(env);
 
@@ -391,11 +391,11 @@ static void native_sdl_poll_event(environment_t env, unsigned int argc)
 static void native_sdl_get_ticks(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t*);
+    values = array_base(value->u.object_value->u.array, value_t);
 
     environment_pop_value(env);
 
@@ -499,17 +499,17 @@ void import_libsdl_library(environment_t env)
     };
 
     int i;
-    value_t sdl_table;
+    table_t sdl_table;
 
     environment_push_str(env, "sdl");
 
     environment_push_table(env);
 
-    sdl_table = list_element(list_rbegin(env->stack), value_t, link);
+    sdl_table = environment_stack_top(env)->u.object_value->u.table;
 
     table_push_pair(environment_get_global_table(env), env);
 
-    import_libsdl_const(env, sdl_table->u.object_value->u.table);
+    import_libsdl_const(env, sdl_table);
 
     struct pair_s pairs[] = {
         { "init",                           native_sdl_init },
@@ -535,7 +535,7 @@ void import_libsdl_library(environment_t env)
     for (i = 0; i < sizeof(pairs) / sizeof(struct pair_s); i++) {
         environment_push_str(env, pairs[i].name);
         environment_push_native_function(env, pairs[i].func);
-        table_push_pair(sdl_table->u.object_value->u.table, env);
+        table_push_pair(sdl_table, env);
     }
 }
 
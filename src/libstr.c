@@ -40,13 +40,13 @@ done:
 static void native_string_replace(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
     cstring_t dst;
     int max;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t*);
+    values = array_base(value->u.object_value->u.array, value_t);
 
     if (argc < 3) {
         environment_pop_value(env);
@@ -57,13 +57,13 @@ static void native_string_replace(environment_t env, unsigned int argc)
     if (argc == 3) {
         max = -1;
     } else {
-        max = native_check_int_value(values[3]);
+        max = native_check_int_value(&values[3]);
     }
 
     dst = do_replace(
-        (cstring_t)native_check_string_value(values[0]),
-        (cstring_t)native_check_string_value(values[1]),
-        (cstring_t)native_check_string_value(values[2]),
+        (cstring_t)native_check_string_value(&values[0]),
+        (cstring_t)native_check_string_value(&values[1]),
+        (cstring_t)native_check_string_value(&values[2]),
         max);
 
     environment_push_string(env, dst);
@@ -78,11 +78,11 @@ static void native_string_replace(environment_t env, unsigned int argc)
 static void native_string_length(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t*);
+    values = array_base(value->u.object_value->u.array, value_t);
 
     if (argc < 1) {
         environment_pop_value(env);
@@ -90,7 +90,7 @@ static void native_string_length(environment_t env, unsigned int argc)
         return;
     }
 
-    environment_push_int(env, cstring_length((cstring_t)native_check_string_value(values[0])));
+    environment_push_int(env, cstring_length((cstring_t)native_check_string_value(&values[0])));
 
     environment_xchg_stack(env);
 
@@ -100,11 +100,11 @@ static void native_string_length(environment_t env, unsigned int argc)
 static void native_string_copy(environment_t env, unsigned int argc)
 {
     value_t  value;
-    value_t* values;
+    value_t  values;
 
-    value = list_element(list_rbegin(env->stack), value_t, link);
+    value = environment_stack_top(env);
 
-    values = array_base(value->u.object_value->u.array, value_t*);
+    values = array_base(value->u.object_value->u.array, value_t);
 
     if (argc < 1) {
         environment_pop_value(env);
@@ -112,7 +112,7 @@ static void native_string_copy(environment_t env, unsigned int argc)
         return;
     }
 
-    environment_push_str(env, native_check_string_value(values[0]));
+    environment_push_str(env, native_check_string_value(&values[0]));
 
     environment_xchg_stack(env);
 
@@ -127,13 +127,13 @@ void import_string_library(environment_t env)
     };
 
     int i;
-    value_t string_table;
+    table_t string_table;
 
     environment_push_str(env, "string");
 
     environment_push_table(env);
 
-    string_table = list_element(list_rbegin(env->stack), value_t, link);
+    string_table = environment_stack_top(env)->u.object_value->u.table;
 
     table_push_pair(environment_get_global_table(env), env);
 
@@ -146,6 +146,6 @@ void import_string_library(environment_t env)
     for (i = 0; i < sizeof(pairs) / sizeof(struct pair_s); i++) {
         environment_push_str(env, pairs[i].name);
         environment_push_native_function(env, pairs[i].func);
-        table_push_pair(string_table->u.object_value->u.table, env);
+        table_push_pair(string_table, env);
     }
 }
\ No newline at end of file
@@ -1,6 +1,8 @@
 
 
 #include "parser.h"
+#include "resolver.h"
+#include "optimizer.h"
 #include "native.h"
 #include "lexer.h"
 #include "list.h"
@@ -12,6 +14,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 int main(int argc, char** args)
@@ -29,17 +32,36 @@ int main(int argc, char** args)
         module_t      module;
         environment_t env;
         executor_t    executor;
+        engine_t      engine   = ENGINE_VM;
+        bool          verbose  = false;
+        bool          gc_stats = false;
+        int           i;
+
+        for (i = 1; i < argc && args[i][0] == '-'; i++) {
+            if (strcmp(args[i], "--vm") == 0) {
+                engine = ENGINE_VM;
+            } else if (strcmp(args[i], "--ast") == 0) {
+                engine = ENGINE_TREE_WALKER;
+            } else if (strcmp(args[i], "--verbose") == 0) {
+                verbose = true;
+            } else if (strcmp(args[i], "--gc-stats") == 0) {
+                gc_stats = true;
+            } else {
+                fprintf(stderr, "ulcer: unknown option %s\n", args[i]);
+                exit(-1);
+            }
+        }
 
-        if (argc < 2) {
-            printf("usage: ulcer souce_code.ul\n");
+        if (i >= argc) {
+            printf("usage: ulcer [--vm | --ast] [--verbose] [--gc-stats] souce_code.ul\n");
             printf("press any key to exit");
             getchar();
             exit(-1);
         }
 
-        sc = source_code_new(args[1], SOURCE_CODE_TYPE_FILE);
+        sc = source_code_new(args[i], SOURCE_CODE_TYPE_FILE);
         if (sc == NULL) {
-            fprintf(stderr, "ulcer: cannot open %s: No such file or directory\n", args[1]);
+            fprintf(stderr, "ulcer: cannot open %s: No such file or directory\n", args[i]);
             exit(-1);
         }
 
@@ -49,15 +71,26 @@ int main(int argc, char** args)
 
         module = parser_generate_module(parse);
 
+        optimizer_optimize_module(module, verbose);
+
+        resolver_resolve_module(module);
+
         env = environment_new();
 
+        env->engine  = engine;
+        env->verbose = verbose;
+
         environment_add_module(env, module);
 
         setup_native_module(env);
 
         executor_run((executor = executor_new(env)));
 
-        assert(list_is_empty(env->stack));
+        assert(environment_stack_size(env) == 0);
+
+        if (gc_stats) {
+            heap_dump_stats(env, stderr);
+        }
 
         executor_free(executor);
 
@@ -3,6 +3,7 @@
 #include "module.h"
 #include "hashfn.h"
 #include "alloc.h"
+#include "compiler.h"
 
 module_t module_new(void)
 {
@@ -14,12 +15,16 @@ module_t module_new(void)
         return NULL;
     }
 
-    statements = (statements_t) mem_alloc(sizeof(struct statement_s));
+    statements = (statements_t) mem_alloc(sizeof(struct statements_s));
     if (!statements) {
         return NULL;
     }
 
+    statements->frame_size = 0;
+    statements->code       = NULL;
+
     module->statements = statements;
+    module->symbols    = symbol_table_new();
 
     list_init(module->functions);
     list_init(module->statements->stmts);
@@ -41,6 +46,12 @@ void module_free(module_t module)
         statement_free(list_element(iter, statement_t, link));
     }
 
+    if (module->statements->code) {
+        code_free(module->statements->code);
+    }
+
+    symbol_table_free(module->symbols);
+
     mem_free(module->statements);
     mem_free(module);
 }
@@ -7,19 +7,23 @@
 #include "stack.h"
 #include "list.h"
 #include "statement.h"
+#include "symbol.h"
 
 typedef struct module_s*         module_t;
 typedef struct statements_s*     statements_t;
 
 struct statements_s {
     list_t       stmts;
+    unsigned int frame_size;
+    struct code_s *code;        /* bytecode, compiled when first run */
     stack_node_t link;
 };
 
 struct module_s {
-    statements_t statements;
-    list_t       functions;
-    list_node_t  link;
+    statements_t   statements;
+    list_t         functions;
+    symbol_table_t symbols;         /* identifiers interned by the parser */
+    list_node_t    link;
 };
 
 module_t module_new(void);
@@ -72,6 +72,20 @@ int native_check_int_value(value_t value)
     return 0;
 }
 
+long native_check_long_value(value_t value)
+{
+    if (value->type == VALUE_TYPE_LONG) {
+        return value->u.long_value;
+    } else if (value->type == VALUE_TYPE_INT) {
+        return (long) value->u.int_value;
+    } else {
+        runtime_error("passing '%s' to parameter of incompatible type 'long'",
+            get_value_type_string(value->type));
+    }
+
+    return 0;
+}
+
 const char* native_check_string_value(value_t value)
 {
     if (value->type == VALUE_TYPE_STRING) {
@@ -0,0 +1,1014 @@
+
+
+#include "optimizer.h"
+#include "statement.h"
+#include "expression.h"
+#include "environment.h"
+#include "evaluator.h"
+#include "alloc.h"
+
+#include <math.h>
+#include <stdio.h>
+
+/*
+ * The optimizer runs between the parser and the resolver. It folds
+ * operators whose operands are literals into a single literal and drops
+ * if/elif/else and switch branches whose conditions are literals, along
+ * with while loops that never run.
+ *
+ * Only pairs of operand types the evaluator handles without an error are
+ * folded, computed the way the evaluator computes them, so a script that
+ * fails at run time still fails at the same place. A statement that loses
+ * branches keeps its own scope: an if that always takes one branch is
+ * left as if (true), so the names its block binds stay local to it.
+ */
+
+typedef struct optimizer_s* optimizer_t;
+
+struct optimizer_s {
+    bool           verbose;     /* report every fold and pruned branch */
+    symbol_table_t symbols;     /* the module's pool, folded strings are interned in it */
+    unsigned long  folded;
+    unsigned long  pruned;
+};
+
+static void __optimizer_block__(optimizer_t optimizer, list_t *block);
+static bool __optimizer_statement__(optimizer_t optimizer, statement_t stmt);
+static bool __optimizer_if_statement__(optimizer_t optimizer, statement_t stmt);
+static void __optimizer_switch_statement__(optimizer_t optimizer, statement_t stmt);
+static void __optimizer_visit__(optimizer_t optimizer, expression_t expr);
+static void __optimizer_expression__(optimizer_t optimizer, expression_t expr);
+static bool __optimizer_fold_unary__(expression_t expr);
+static bool __optimizer_fold_binary__(optimizer_t optimizer, expression_t expr);
+static bool __optimizer_fold_values__(optimizer_t optimizer, expression_type_t type, expression_t left, expression_t right, expression_t result);
+static bool __optimizer_fold_char__(expression_type_t type, char left, char right, expression_t result);
+static bool __optimizer_fold_int__(expression_type_t type, int left, int right, expression_t result);
+static bool __optimizer_fold_long__(expression_type_t type, long left, long right, expression_t result);
+static bool __optimizer_fold_double__(expression_type_t type, double left, double right, expression_t result);
+static bool __optimizer_is_literal__(expression_t expr);
+static bool __optimizer_is_bool__(expression_t expr, bool value);
+static void __optimizer_free_block__(list_t *block);
+static void __optimizer_report_fold__(optimizer_t optimizer, expression_t expr);
+static void __optimizer_report_prune__(optimizer_t optimizer, statement_t stmt, const char *branch);
+
+void optimizer_optimize_module(module_t module, bool verbose)
+{
+    struct optimizer_s optimizer;
+    list_iter_t iter;
+    statement_t stmt;
+
+    optimizer.verbose = verbose;
+    optimizer.symbols = module->symbols;
+    optimizer.folded  = 0;
+    optimizer.pruned  = 0;
+
+    __optimizer_block__(&optimizer, &module->statements->stmts);
+
+    list_for_each(module->functions, iter) {
+        stmt = list_element(iter, statement_t, link);
+        __optimizer_expression__(&optimizer, stmt->u.expr);
+    }
+
+    if (verbose) {
+        fprintf(stderr, "ulcer: folded %lu expressions, pruned %lu branches\n",
+                optimizer.folded, optimizer.pruned);
+    }
+}
+
+static void __optimizer_block__(optimizer_t optimizer, list_t *block)
+{
+    list_iter_t iter, next_iter;
+    statement_t stmt;
+
+    list_safe_for_each((*block), iter, next_iter) {
+        stmt = list_element(iter, statement_t, link);
+
+        if (!__optimizer_statement__(optimizer, stmt)) {
+            list_erase((*block), *iter);
+            statement_free(stmt);
+        }
+    }
+}
+
+/* returns false when the statement can never do anything and is dropped */
+static bool __optimizer_statement__(optimizer_t optimizer, statement_t stmt)
+{
+    switch (stmt->type) {
+    case STATEMENT_TYPE_EXPRESSION:
+        __optimizer_visit__(optimizer, stmt->u.expr);
+        break;
+
+    case STATEMENT_TYPE_RETURN:
+        if (stmt->u.return_expr) {
+            __optimizer_visit__(optimizer, stmt->u.return_expr);
+        }
+        break;
+
+    case STATEMENT_TYPE_IF:
+        return __optimizer_if_statement__(optimizer, stmt);
+
+    case STATEMENT_TYPE_SWITCH:
+        __optimizer_switch_statement__(optimizer, stmt);
+        break;
+
+    case STATEMENT_TYPE_WHILE:
+        __optimizer_visit__(optimizer, stmt->u.while_stmt->condition);
+
+        if (__optimizer_is_bool__(stmt->u.while_stmt->condition, false)) {
+            __optimizer_report_prune__(optimizer, stmt, "while");
+            return false;
+        }
+
+        __optimizer_block__(optimizer, &stmt->u.while_stmt->block);
+        break;
+
+    case STATEMENT_TYPE_FOR:
+        if (stmt->u.for_stmt->init) {
+            __optimizer_visit__(optimizer, stmt->u.for_stmt->init);
+        }
+
+        if (stmt->u.for_stmt->condition) {
+            __optimizer_visit__(optimizer, stmt->u.for_stmt->condition);
+        }
+
+        if (stmt->u.for_stmt->post) {
+            __optimizer_visit__(optimizer, stmt->u.for_stmt->post);
+        }
+
+        __optimizer_block__(optimizer, &stmt->u.for_stmt->block);
+        break;
+
+    case STATEMENT_TYPE_FOREACH:
+        __optimizer_visit__(optimizer, stmt->u.foreach_stmt->key);
+        __optimizer_visit__(optimizer, stmt->u.foreach_stmt->value);
+        __optimizer_visit__(optimizer, stmt->u.foreach_stmt->at);
+        __optimizer_block__(optimizer, &stmt->u.foreach_stmt->block);
+        break;
+
+    default:
+        break;
+    }
+
+    return true;
+}
+
+/*
+ * Branches behind a false condition are dropped, and a true condition
+ * makes its branch the last one. An if left with nothing to run is
+ * dropped as a whole.
+ */
+static bool __optimizer_if_statement__(optimizer_t optimizer, statement_t stmt)
+{
+    statement_if_t stmt_if = stmt->u.if_stmt;
+    statement_elif_t elif;
+    list_iter_t iter, next_iter;
+    bool taken;
+
+    __optimizer_visit__(optimizer, stmt_if->condition);
+
+    list_for_each(stmt_if->elifs, iter) {
+        __optimizer_visit__(optimizer, list_element(iter, statement_elif_t, link)->condition);
+    }
+
+    /* promote the first elif, or the else block, over a false condition */
+    while (__optimizer_is_bool__(stmt_if->condition, false)) {
+        __optimizer_report_prune__(optimizer, stmt, "if");
+        __optimizer_free_block__(&stmt_if->if_block);
+
+        if (!list_is_empty(stmt_if->elifs)) {
+            elif = list_element(list_begin(stmt_if->elifs), statement_elif_t, link);
+            list_erase(stmt_if->elifs, elif->link);
+
+            expression_free(stmt_if->condition);
+
+            stmt_if->condition = elif->condition;
+            stmt_if->if_block  = elif->block;
+
+            mem_free(elif);
+
+        } else if (!list_is_empty(stmt_if->else_block)) {
+            stmt_if->condition->u.bool_expr = true;
+            stmt_if->if_block               = stmt_if->else_block;
+
+            list_init(stmt_if->else_block);
+
+        } else {
+            return false;
+        }
+    }
+
+    taken = __optimizer_is_bool__(stmt_if->condition, true);
+
+    list_safe_for_each(stmt_if->elifs, iter, next_iter) {
+        elif = list_element(iter, statement_elif_t, link);
+
+        if (taken || __optimizer_is_bool__(elif->condition, false)) {
+            __optimizer_report_prune__(optimizer, stmt, "elif");
+            list_erase(stmt_if->elifs, elif->link);
+            statement_free_elif(elif);
+
+        } else if (__optimizer_is_bool__(elif->condition, true)) {
+            /* everything after it is dead, it becomes the else block */
+            if (!list_is_empty(stmt_if->else_block)) {
+                __optimizer_report_prune__(optimizer, stmt, "else");
+                __optimizer_free_block__(&stmt_if->else_block);
+            }
+
+            list_erase(stmt_if->elifs, elif->link);
+
+            stmt_if->else_block = elif->block;
+            list_init(elif->block);
+            statement_free_elif(elif);
+
+            taken = true;
+        }
+    }
+
+    if (__optimizer_is_bool__(stmt_if->condition, true) && !list_is_empty(stmt_if->else_block)) {
+        __optimizer_report_prune__(optimizer, stmt, "else");
+        __optimizer_free_block__(&stmt_if->else_block);
+    }
+
+    __optimizer_block__(optimizer, &stmt_if->if_block);
+
+    list_for_each(stmt_if->elifs, iter) {
+        __optimizer_block__(optimizer, &list_element(iter, statement_elif_t, link)->block);
+    }
+
+    __optimizer_block__(optimizer, &stmt_if->else_block);
+
+    return true;
+}
+
+/*
+ * A literal switch value is compared against the cases in order; as long
+ * as they are literals too, the case it picks, or the default block, is
+ * the only one kept.
+ */
+static void __optimizer_switch_statement__(optimizer_t optimizer, statement_t stmt)
+{
+    statement_switch_t stmt_switch = stmt->u.switch_stmt;
+    statement_switch_case_t switch_case;
+    statement_switch_case_t matched = NULL;
+    struct expression_s result;
+    list_iter_t iter, next_iter;
+    bool decided = false;
+
+    __optimizer_visit__(optimizer, stmt_switch->expr);
+
+    list_for_each(stmt_switch->cases, iter) {
+        __optimizer_visit__(optimizer, list_element(iter, statement_switch_case_t, link)->case_expr);
+    }
+
+    if (__optimizer_is_literal__(stmt_switch->expr)) {
+        decided = true;
+
+        list_for_each(stmt_switch->cases, iter) {
+            switch_case = list_element(iter, statement_switch_case_t, link);
+
+            if (!__optimizer_is_literal__(switch_case->case_expr) ||
+                !__optimizer_fold_values__(optimizer, EXPRESSION_TYPE_EQ, stmt_switch->expr, switch_case->case_expr, &result)) {
+                decided = false;
+                break;
+            }
+
+            if (result.u.bool_expr) {
+                matched = switch_case;
+                break;
+            }
+        }
+    }
+
+    if (decided) {
+        list_safe_for_each(stmt_switch->cases, iter, next_iter) {
+            switch_case = list_element(iter, statement_switch_case_t, link);
+
+            if (switch_case != matched) {
+                __optimizer_report_prune__(optimizer, stmt, "case");
+                list_erase(stmt_switch->cases, switch_case->link);
+                statement_free_switch_case(switch_case);
+            }
+        }
+
+        if (matched && !list_is_empty(stmt_switch->default_block)) {
+            __optimizer_report_prune__(optimizer, stmt, "default");
+            __optimizer_free_block__(&stmt_switch->default_block);
+        }
+    }
+
+    list_for_each(stmt_switch->cases, iter) {
+        __optimizer_block__(optimizer, &list_element(iter, statement_switch_case_t, link)->block);
+    }
+
+    __optimizer_block__(optimizer, &stmt_switch->default_block);
+}
+
+/* optimizes an expression and reports it when it turned into a literal */
+static void __optimizer_visit__(optimizer_t optimizer, expression_t expr)
+{
+    bool literal = __optimizer_is_literal__(expr);
+
+    __optimizer_expression__(optimizer, expr);
+
+    if (!literal && __optimizer_is_literal__(expr)) {
+        __optimizer_report_fold__(optimizer, expr);
+    }
+}
+
+static void __optimizer_expression__(optimizer_t optimizer, expression_t expr)
+{
+    expression_t left;
+    expression_t right;
+    bool left_literal;
+    bool right_literal;
+    list_iter_t iter;
+
+    switch (expr->type) {
+    case EXPRESSION_TYPE_FUNCTION:
+        __optimizer_block__(optimizer, &expr->u.function_expr->block);
+        break;
+
+    case EXPRESSION_TYPE_ASSIGN:
+    case EXPRESSION_TYPE_ADD_ASSIGN:
+    case EXPRESSION_TYPE_SUB_ASSIGN:
+    case EXPRESSION_TYPE_MUL_ASSIGN:
+    case EXPRESSION_TYPE_DIV_ASSIGN:
+    case EXPRESSION_TYPE_MOD_ASSIGN:
+    case EXPRESSION_TYPE_BITAND_ASSIGN:
+    case EXPRESSION_TYPE_BITOR_ASSIGN:
+    case EXPRESSION_TYPE_XOR_ASSIGN:
+    case EXPRESSION_TYPE_LEFT_SHIFT_ASSIGN:
+    case EXPRESSION_TYPE_RIGHT_SHIFT_ASSIGN:
+    case EXPRESSION_TYPE_LOGIC_RIGHT_SHIFT_ASSIGN:
+        __optimizer_visit__(optimizer, expr->u.assign_expr->lvalue_expr);
+        __optimizer_visit__(optimizer, expr->u.assign_expr->rvalue_expr);
+        break;
+
+    case EXPRESSION_TYPE_CALL:
+        __optimizer_visit__(optimizer, expr->u.call_expr->function_expr);
+
+        list_for_each(expr->u.call_expr->args, iter) {
+            __optimizer_visit__(optimizer, list_element(iter, expression_t, link));
+        }
+        break;
+
+    case EXPRESSION_TYPE_CPL:
+    case EXPRESSION_TYPE_NOT:
+    case EXPRESSION_TYPE_PLUS:
+    case EXPRESSION_TYPE_MINUS:
+        left         = expr->u.unary_expr;
+        left_literal = __optimizer_is_literal__(left);
+
+        __optimizer_expression__(optimizer, left);
+
+        if (__optimizer_fold_unary__(expr)) {
+            optimizer->folded++;
+        } else if (!left_literal && __optimizer_is_literal__(left)) {
+            __optimizer_report_fold__(optimizer, left);
+        }
+        break;
+
+    case EXPRESSION_TYPE_INC:
+    case EXPRESSION_TYPE_DEC:
+        __optimizer_visit__(optimizer, expr->u.incdec_expr);
+        break;
+
+    case EXPRESSION_TYPE_BITAND:
+    case EXPRESSION_TYPE_BITOR:
+    case EXPRESSION_TYPE_XOR:
+    case EXPRESSION_TYPE_LEFT_SHIFT:
+    case EXPRESSION_TYPE_RIGHT_SHIFT:
+    case EXPRESSION_TYPE_LOGIC_RIGHT_SHIFT:
+    case EXPRESSION_TYPE_MUL:
+    case EXPRESSION_TYPE_DIV:
+    case EXPRESSION_TYPE_MOD:
+    case EXPRESSION_TYPE_ADD:
+    case EXPRESSION_TYPE_SUB:
+    case EXPRESSION_TYPE_GT:
+    case EXPRESSION_TYPE_GEQ:
+    case EXPRESSION_TYPE_LT:
+    case EXPRESSION_TYPE_LEQ:
+    case EXPRESSION_TYPE_EQ:
+    case EXPRESSION_TYPE_NEQ:
+    case EXPRESSION_TYPE_AND:
+    case EXPRESSION_TYPE_OR:
+        left          = expr->u.binary_expr->left;
+        right         = expr->u.binary_expr->right;
+        left_literal  = __optimizer_is_literal__(left);
+        right_literal = __optimizer_is_literal__(right);
+
+        __optimizer_expression__(optimizer, left);
+        __optimizer_expression__(optimizer, right);
+
+        /* only the outermost fold of a literal subtree is reported */
+        if (__optimizer_fold_binary__(optimizer, expr)) {
+            optimizer->folded++;
+            break;
+        }
+
+        if (!left_literal && __optimizer_is_literal__(left)) {
+            __optimizer_report_fold__(optimizer, left);
+        }
+
+        if (!right_literal && __optimizer_is_literal__(right)) {
+            __optimizer_report_fold__(optimizer, right);
+        }
+        break;
+
+    case EXPRESSION_TYPE_ARRAY_GENERATE:
+        list_for_each(expr->u.array_generate_expr, iter) {
+            __optimizer_visit__(optimizer, list_element(iter, expression_t, link));
+        }
+        break;
+
+    case EXPRESSION_TYPE_TABLE_GENERATE:
+        list_for_each(expr->u.table_generate_expr, iter) {
+            expression_table_pair_t pair = list_element(iter, expression_table_pair_t, link);
+            __optimizer_visit__(optimizer, pair->member_name);
+            __optimizer_visit__(optimizer, pair->member_expr);
+        }
+        break;
+
+    case EXPRESSION_TYPE_ARRAY_PUSH:
+        __optimizer_visit__(optimizer, expr->u.array_push_expr->array_expr);
+        __optimizer_visit__(optimizer, expr->u.array_push_expr->elem_expr);
+        break;
+
+    case EXPRESSION_TYPE_ARRAY_POP:
+        __optimizer_visit__(optimizer, expr->u.array_pop_expr->array_expr);
+        __optimizer_visit__(optimizer, expr->u.array_pop_expr->lvalue_expr);
+        break;
+
+    case EXPRESSION_TYPE_TABLE_DOT_MEMBER:
+        __optimizer_visit__(optimizer, expr->u.table_dot_member_expr->table_expr);
+        break;
+
+    case EXPRESSION_TYPE_INDEX:
+        __optimizer_visit__(optimizer, expr->u.index_expr->dict);
+        __optimizer_visit__(optimizer, expr->u.index_expr->index);
+        break;
+
+    default:
+        break;
+    }
+}
+
+/* the cases evaluator_unary_value handles for the literal's type */
+static bool __optimizer_fold_unary__(expression_t expr)
+{
+    expression_t operand = expr->u.unary_expr;
+
+    switch (operand->type) {
+    case EXPRESSION_TYPE_BOOL:
+        if (expr->type != EXPRESSION_TYPE_NOT) {
+            return false;
+        }
+        operand->u.bool_expr = !operand->u.bool_expr;
+        break;
+
+    case EXPRESSION_TYPE_INT:
+        if (expr->type == EXPRESSION_TYPE_MINUS) {
+            operand->u.int_expr = -operand->u.int_expr;
+        } else if (expr->type == EXPRESSION_TYPE_CPL) {
+            operand->u.int_expr = ~operand->u.int_expr;
+        } else if (expr->type != EXPRESSION_TYPE_PLUS) {
+            return false;
+        }
+        break;
+
+    case EXPRESSION_TYPE_LONG:
+        if (expr->type == EXPRESSION_TYPE_MINUS) {
+            operand->u.long_expr = -operand->u.long_expr;
+        } else if (expr->type == EXPRESSION_TYPE_CPL) {
+            operand->u.long_expr = ~operand->u.long_expr;
+        } else if (expr->type != EXPRESSION_TYPE_PLUS) {
+            return false;
+        }
+        break;
+
+    case EXPRESSION_TYPE_FLOAT:
+        if (expr->type == EXPRESSION_TYPE_MINUS) {
+            operand->u.float_expr = -operand->u.float_expr;
+        } else if (expr->type != EXPRESSION_TYPE_PLUS) {
+            return false;
+        }
+        break;
+
+    case EXPRESSION_TYPE_DOUBLE:
+        if (expr->type == EXPRESSION_TYPE_MINUS) {
+            operand->u.double_expr = -operand->u.double_expr;
+        } else if (expr->type != EXPRESSION_TYPE_PLUS) {
+            return false;
+        }
+        break;
+
+    default:
+        return false;
+    }
+
+    /* the node takes over the folded literal */
+    expr->type = operand->type;
+    expr->u    = operand->u;
+
+    mem_free(operand);
+
+    return true;
+}
+
+static bool __optimizer_fold_binary__(optimizer_t optimizer, expression_t expr)
+{
+    expression_binary_t binary_expr = expr->u.binary_expr;
+    struct expression_s result;
+
+    if (!__optimizer_is_literal__(binary_expr->left) || !__optimizer_is_literal__(binary_expr->right)) {
+        return false;
+    }
+
+    if (!__optimizer_fold_values__(optimizer, expr->type, binary_expr->left, binary_expr->right, &result)) {
+        return false;
+    }
+
+    expression_free(binary_expr->left);
+    expression_free(binary_expr->right);
+    mem_free(binary_expr);
+
+    expr->type = result.type;
+    expr->u    = result.u;
+
+    return true;
+}
+
+/*
+ * Computes left op right into result for the operand pairs the evaluator
+ * accepts without casting through another type's bits. Returns false,
+ * leaving the expression to run time, for anything else.
+ */
+static bool __optimizer_fold_values__(optimizer_t optimizer, expression_type_t type, expression_t left, expression_t right, expression_t result)
+{
+    cstring_t string;
+
+    if (left->type == EXPRESSION_TYPE_CHAR && right->type == EXPRESSION_TYPE_CHAR) {
+        return __optimizer_fold_char__(type, left->u.char_expr, right->u.char_expr, result);
+
+    } else if (left->type == EXPRESSION_TYPE_INT && right->type == EXPRESSION_TYPE_INT) {
+        return __optimizer_fold_int__(type, left->u.int_expr, right->u.int_expr, result);
+
+    } else if (left->type == EXPRESSION_TYPE_LONG && right->type == EXPRESSION_TYPE_LONG) {
+        return __optimizer_fold_long__(type, left->u.long_expr, right->u.long_expr, result);
+
+    } else if (left->type == EXPRESSION_TYPE_DOUBLE && right->type == EXPRESSION_TYPE_DOUBLE) {
+        return __optimizer_fold_double__(type, left->u.double_expr, right->u.double_expr, result);
+
+    } else if (left->type == EXPRESSION_TYPE_DOUBLE && right->type == EXPRESSION_TYPE_INT) {
+        return __optimizer_fold_double__(type, left->u.double_expr, (double) right->u.int_expr, result);
+
+    } else if (left->type == EXPRESSION_TYPE_INT && right->type == EXPRESSION_TYPE_DOUBLE) {
+        return __optimizer_fold_double__(type, (double) left->u.int_expr, right->u.double_expr, result);
+
+    } else if (left->type == EXPRESSION_TYPE_DOUBLE && right->type == EXPRESSION_TYPE_LONG) {
+        return __optimizer_fold_double__(type, left->u.double_expr, (double) right->u.long_expr, result);
+
+    } else if (left->type == EXPRESSION_TYPE_LONG && right->type == EXPRESSION_TYPE_DOUBLE) {
+        return __optimizer_fold_double__(type, (double) left->u.long_expr, right->u.double_expr, result);
+
+    } else if (left->type == EXPRESSION_TYPE_BOOL && right->type == EXPRESSION_TYPE_BOOL) {
+        result->type = EXPRESSION_TYPE_BOOL;
+
+        switch (type) {
+        case EXPRESSION_TYPE_EQ:
+            result->u.bool_expr = left->u.bool_expr == right->u.bool_expr;
+            return true;
+
+        case EXPRESSION_TYPE_NEQ:
+            result->u.bool_expr = left->u.bool_expr != right->u.bool_expr;
+            return true;
+
+        case EXPRESSION_TYPE_AND:
+            result->u.bool_expr = left->u.bool_expr && right->u.bool_expr;
+            return true;
+
+        case EXPRESSION_TYPE_OR:
+            result->u.bool_expr = left->u.bool_expr || right->u.bool_expr;
+            return true;
+
+        default:
+            return false;
+        }
+
+    } else if (left->type == EXPRESSION_TYPE_STRING && right->type == EXPRESSION_TYPE_STRING) {
+        result->type = EXPRESSION_TYPE_BOOL;
+
+        switch (type) {
+        case EXPRESSION_TYPE_ADD:
+            result->type          = EXPRESSION_TYPE_STRING;
+            string = cstring_cat(cstring_dup(left->u.string_expr->name), right->u.string_expr->name);
+            result->u.string_expr = symbol_table_intern(optimizer->symbols, string);
+            cstring_free(string);
+            return true;
+
+        case EXPRESSION_TYPE_GT:
+            result->u.bool_expr = cstring_cmp(left->u.string_expr->name, right->u.string_expr->name) > 0;
+            return true;
+
+        case EXPRESSION_TYPE_GEQ:
+            result->u.bool_expr = cstring_cmp(left->u.string_expr->name, right->u.string_expr->name) >= 0;
+            return true;
+
+        case EXPRESSION_TYPE_LT:
+            result->u.bool_expr = cstring_cmp(left->u.string_expr->name, right->u.string_expr->name) < 0;
+            return true;
+
+        case EXPRESSION_TYPE_LEQ:
+            result->u.bool_expr = cstring_cmp(left->u.string_expr->name, right->u.string_expr->name) <= 0;
+            return true;
+
+        case EXPRESSION_TYPE_EQ:
+            result->u.bool_expr = cstring_cmp(left->u.string_expr->name, right->u.string_expr->name) == 0;
+            return true;
+
+        case EXPRESSION_TYPE_NEQ:
+            result->u.bool_expr = cstring_cmp(left->u.string_expr->name, right->u.string_expr->name) != 0;
+            return true;
+
+        default:
+            return false;
+        }
+    }
+
+    return false;
+}
+
+static bool __optimizer_fold_char__(expression_type_t type, char left, char right, expression_t result)
+{
+    result->type = EXPRESSION_TYPE_CHAR;
+
+    switch (type) {
+    case EXPRESSION_TYPE_BITAND:
+        result->u.char_expr = left & right;
+        break;
+
+    case EXPRESSION_TYPE_BITOR:
+        result->u.char_expr = left | right;
+        break;
+
+    case EXPRESSION_TYPE_XOR:
+        result->u.char_expr = left ^ right;
+        break;
+
+    case EXPRESSION_TYPE_LEFT_SHIFT:
+        result->u.char_expr = left << right;
+        break;
+
+    case EXPRESSION_TYPE_RIGHT_SHIFT:
+        result->u.char_expr = left >> right;
+        break;
+
+    case EXPRESSION_TYPE_LOGIC_RIGHT_SHIFT:
+        result->u.char_expr = (char)((unsigned char) left >> (unsigned char) right);
+        break;
+
+    case EXPRESSION_TYPE_ADD:
+        result->u.char_expr = left + right;
+        break;
+
+    case EXPRESSION_TYPE_SUB:
+        result->u.char_expr = left - right;
+        break;
+
+    case EXPRESSION_TYPE_MUL:
+        result->u.char_expr = left * right;
+        break;
+
+    case EXPRESSION_TYPE_DIV:
+        result->u.char_expr = right == 0 ? 0 : left / right;
+        break;
+
+    case EXPRESSION_TYPE_MOD:
+        result->u.char_expr = right == 0 ? 0 : left % right;
+        break;
+
+    default:
+        return __optimizer_fold_int__(type, left, right, result);
+    }
+
+    return true;
+}
+
+static bool __optimizer_fold_int__(expression_type_t type, int left, int right, expression_t result)
+{
+    result->type = EXPRESSION_TYPE_INT;
+
+    switch (type) {
+    case EXPRESSION_TYPE_BITAND:
+        result->u.int_expr = left & right;
+        break;
+
+    case EXPRESSION_TYPE_BITOR:
+        result->u.int_expr = left | right;
+        break;
+
+    case EXPRESSION_TYPE_XOR:
+        result->u.int_expr = left ^ right;
+        break;
+
+    case EXPRESSION_TYPE_LEFT_SHIFT:
+        result->u.int_expr = left << right;
+        break;
+
+    case EXPRESSION_TYPE_RIGHT_SHIFT:
+        result->u.int_expr = left >> right;
+        break;
+
+    case EXPRESSION_TYPE_LOGIC_RIGHT_SHIFT:
+        result->u.int_expr = (int)((unsigned int) left >> (unsigned int) right);
+        break;
+
+    case EXPRESSION_TYPE_ADD:
+        result->u.int_expr = left + right;
+        break;
+
+    case EXPRESSION_TYPE_SUB:
+        result->u.int_expr = left - right;
+        break;
+
+    case EXPRESSION_TYPE_MUL:
+        result->u.int_expr = left * right;
+        break;
+
+    case EXPRESSION_TYPE_DIV:
+        result->u.int_expr = right == 0 ? 0 : left / right;
+        break;
+
+    case EXPRESSION_TYPE_MOD:
+        result->u.int_expr = right == 0 ? 0 : left % right;
+        break;
+
+    case EXPRESSION_TYPE_GT:
+        result->type        = EXPRESSION_TYPE_BOOL;
+        result->u.bool_expr = left > right;
+        break;
+
+    case EXPRESSION_TYPE_GEQ:
+        result->type        = EXPRESSION_TYPE_BOOL;
+        result->u.bool_expr = left >= right;
+        break;
+
+    case EXPRESSION_TYPE_LT:
+        result->type        = EXPRESSION_TYPE_BOOL;
+        result->u.bool_expr = left < right;
+        break;
+
+    case EXPRESSION_TYPE_LEQ:
+        result->type        = EXPRESSION_TYPE_BOOL;
+        result->u.bool_expr = left <= right;
+        break;
+
+    case EXPRESSION_TYPE_EQ:
+        result->type        = EXPRESSION_TYPE_BOOL;
+        result->u.bool_expr = left == right;
+        break;
+
+    case EXPRESSION_TYPE_NEQ:
+        result->type        = EXPRESSION_TYPE_BOOL;
+        result->u.bool_expr = left != right;
+        break;
+
+    default:
+        return false;
+    }
+
+    return true;
+}
+
+static bool __optimizer_fold_long__(expression_type_t type, long left, long right, expression_t result)
+{
+    result->type = EXPRESSION_TYPE_LONG;
+
+    switch (type) {
+    case EXPRESSION_TYPE_BITAND:
+        result->u.long_expr = left & right;
+        break;
+
+    case EXPRESSION_TYPE_BITOR:
+        result->u.long_expr = left | right;
+        break;
+
+    case EXPRESSION_TYPE_XOR:
+        result->u.long_expr = left ^ right;
+        break;
+
+    case EXPRESSION_TYPE_LEFT_SHIFT:
+        result->u.long_expr = left << right;
+        break;
+
+    case EXPRESSION_TYPE_RIGHT_SHIFT:
+        result->u.long_expr = left >> right;
+        break;
+
+    case EXPRESSION_TYPE_LOGIC_RIGHT_SHIFT:
+        result->u.long_expr = (long)((unsigned long) left >> (unsigned long) right);
+        break;
+
+    case EXPRESSION_TYPE_ADD:
+        result->u.long_expr = left + right;
+        break;
+
+    case EXPRESSION_TYPE_SUB:
+        result->u.long_expr = left - right;
+        break;
+
+    case EXPRESSION_TYPE_MUL:
+        result->u.long_expr = left * right;
+        break;
+
+    case EXPRESSION_TYPE_DIV:
+        result->u.long_expr = right == 0 ? 0 : left / right;
+        break;
+
+    case EXPRESSION_TYPE_MOD:
+        result->u.long_expr = right == 0 ? 0 : left % right;
+        break;
+
+    case EXPRESSION_TYPE_GT:
+        result->type        = EXPRESSION_TYPE_BOOL;
+        result->u.bool_expr = left > right;
+        break;
+
+    case EXPRESSION_TYPE_GEQ:
+        result->type        = EXPRESSION_TYPE_BOOL;
+        result->u.bool_expr = left >= right;
+        break;
+
+    case EXPRESSION_TYPE_LT:
+        result->type        = EXPRESSION_TYPE_BOOL;
+        result->u.bool_expr = left < right;
+        break;
+
+    case EXPRESSION_TYPE_LEQ:
+        result->type        = EXPRESSION_TYPE_BOOL;
+        result->u.bool_expr = left <= right;
+        break;
+
+    case EXPRESSION_TYPE_EQ:
+        result->type        = EXPRESSION_TYPE_BOOL;
+        result->u.bool_expr = left == right;
+        break;
+
+    case EXPRESSION_TYPE_NEQ:
+        result->type        = EXPRESSION_TYPE_BOOL;
+        result->u.bool_expr = left != right;
+        break;
+
+    default:
+        return false;
+    }
+
+    return true;
+}
+
+static bool __optimizer_fold_double__(expression_type_t type, double left, double right, expression_t result)
+{
+    result->type = EXPRESSION_TYPE_DOUBLE;
+
+    switch (type) {
+    case EXPRESSION_TYPE_ADD:
+        result->u.double_expr = left + right;
+        break;
+
+    case EXPRESSION_TYPE_SUB:
+        result->u.double_expr = left - right;
+        break;
+
+    case EXPRESSION_TYPE_MUL:
+        result->u.double_expr = left * right;
+        break;
+
+    case EXPRESSION_TYPE_DIV:
+        result->u.double_expr = left / right;
+        break;
+
+    case EXPRESSION_TYPE_MOD:
+        result->u.double_expr = fmod(left, right);
+        break;
+
+    case EXPRESSION_TYPE_GT:
+        result->type        = EXPRESSION_TYPE_BOOL;
+        result->u.bool_expr = left > right;
+        break;
+
+    case EXPRESSION_TYPE_GEQ:
+        result->type        = EXPRESSION_TYPE_BOOL;
+        result->u.bool_expr = left >= right;
+        break;
+
+    case EXPRESSION_TYPE_LT:
+        result->type        = EXPRESSION_TYPE_BOOL;
+        result->u.bool_expr = left < right;
+        break;
+
+    case EXPRESSION_TYPE_LEQ:
+        result->type        = EXPRESSION_TYPE_BOOL;
+        result->u.bool_expr = left <= right;
+        break;
+
+    case EXPRESSION_TYPE_EQ:
+        result->type        = EXPRESSION_TYPE_BOOL;
+        result->u.bool_expr = left == right;
+        break;
+
+    case EXPRESSION_TYPE_NEQ:
+        result->type        = EXPRESSION_TYPE_BOOL;
+        result->u.bool_expr = left != right;
+        break;
+
+    default:
+        return false;
+    }
+
+    return true;
+}
+
+static bool __optimizer_is_literal__(expression_t expr)
+{
+    switch (expr->type) {
+    case EXPRESSION_TYPE_CHAR:
+    case EXPRESSION_TYPE_BOOL:
+    case EXPRESSION_TYPE_INT:
+    case EXPRESSION_TYPE_LONG:
+    case EXPRESSION_TYPE_FLOAT:
+    case EXPRESSION_TYPE_DOUBLE:
+    case EXPRESSION_TYPE_STRING:
+    case EXPRESSION_TYPE_NULL:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+static bool __optimizer_is_bool__(expression_t expr, bool value)
+{
+    return expr->type == EXPRESSION_TYPE_BOOL && expr->u.bool_expr == value;
+}
+
+static void __optimizer_free_block__(list_t *block)
+{
+    list_iter_t iter, next_iter;
+
+    list_safe_for_each((*block), iter, next_iter) {
+        list_erase((*block), *iter);
+        statement_free(list_element(iter, statement_t, link));
+    }
+}
+
+static void __optimizer_report_fold__(optimizer_t optimizer, expression_t expr)
+{
+    if (!optimizer->verbose) {
+        return;
+    }
+
+    fprintf(stderr, "ulcer:%ld:%ld: folded to ", expr->line, expr->column);
+
+    switch (expr->type) {
+    case EXPRESSION_TYPE_CHAR:
+        fprintf(stderr, "'%c'\n", expr->u.char_expr);
+        break;
+
+    case EXPRESSION_TYPE_BOOL:
+        fprintf(stderr, "%s\n", expr->u.bool_expr ? "true" : "false");
+        break;
+
+    case EXPRESSION_TYPE_INT:
+        fprintf(stderr, "%d\n", expr->u.int_expr);
+        break;
+
+    case EXPRESSION_TYPE_LONG:
+        fprintf(stderr, "%ldL\n", expr->u.long_expr);
+        break;
+
+    case EXPRESSION_TYPE_FLOAT:
+        fprintf(stderr, "%ff\n", expr->u.float_expr);
+        break;
+
+    case EXPRESSION_TYPE_DOUBLE:
+        fprintf(stderr, "%f\n", expr->u.double_expr);
+        break;
+
+    case EXPRESSION_TYPE_STRING:
+        fprintf(stderr, "\"%s\"\n", expr->u.string_expr->name);
+        break;
+
+    default:
+        fprintf(stderr, "%s\n", get_expression_type_string(expr->type));
+        break;
+    }
+}
+
+static void __optimizer_report_prune__(optimizer_t optimizer, statement_t stmt, const char *branch)
+{
+    optimizer->pruned++;
+
+    if (optimizer->verbose) {
+        fprintf(stderr, "ulcer:%ld:%ld: pruned dead %s branch\n", stmt->line, stmt->column, branch);
+    }
+}
@@ -0,0 +1,10 @@
+
+#ifndef _ULCER_OPTIMIZER_H_
+#define _ULCER_OPTIMIZER_H_
+
+#include "config.h"
+#include "module.h"
+
+void optimizer_optimize_module(module_t module, bool verbose);
+
+#endif
@@ -1119,7 +1119,8 @@ static expression_t __parser_postfix_expression__(parser_t parse)
         case TOKEN_VALUE_DOT:
             __parser_expect_next__(parse, TOKEN_VALUE_IDENTIFIER, "expected member name");
 
-            expr = expression_new_table_dot_member(line, column, expr, cstring_dup(tok->token));
+            expr = expression_new_table_dot_member(line, column, expr,
+                symbol_table_intern(parse->module->symbols, tok->token));
 
             lexer_next(parse->lex);
             break;
@@ -1208,12 +1209,14 @@ static expression_t __parser_primary_expression__(parser_t parse)
         break;
 
     case TOKEN_VALUE_LITERAL_STRING:
-        expr = expression_new_literal(EXPRESSION_TYPE_STRING, tok);
+        expr = expression_new_string(line, column,
+            symbol_table_intern(parse->module->symbols, tok->token));
         lexer_next(parse->lex);
         break;
 
     case TOKEN_VALUE_IDENTIFIER:
-        expr = expression_new_identifier(line, column, cstring_dup(tok->token));
+        expr = expression_new_identifier(line, column,
+            symbol_table_intern(parse->module->symbols, tok->token));
         lexer_next(parse->lex);
         break;
 
@@ -1373,7 +1376,7 @@ static list_t __parser_parameter_list__(parser_t parse)
         __parser_need__(parse, TOKEN_VALUE_IDENTIFIER, "expected parameter name");
 
         parameter = (expression_function_parameter_t) mem_alloc(sizeof(struct expression_function_parameter_s));
-        parameter->name = cstring_dup(tok->token);
+        parameter->symbol = symbol_table_intern(parse->module->symbols, tok->token);
         
         list_push_back(parameters, parameter->link);
 
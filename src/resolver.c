@@ -0,0 +1,577 @@
+
+
+#include "resolver.h"
+#include "statement.h"
+#include "expression.h"
+#include "alloc.h"
+
+#include <assert.h>
+
+/*
+ * The resolver gives every name a script binds locally a slot in the frame
+ * of the function that binds it, so the evaluator reaches locals by index
+ * and only looks names up in the global table.
+ *
+ * A parameter binds in the function scope. Assigning to a name that is not
+ * bound yet binds it in the innermost scope around the assignment: the
+ * function body, or the if/switch/while/for/foreach statement that encloses
+ * it. At the top level of a module that innermost scope is the global table.
+ *
+ * Each function is walked twice. The declare pass collects the names bound
+ * by every scope; the frame is then laid out scope by scope, and the resolve
+ * pass records for each identifier the slots that may hold it, innermost
+ * first. Whether a slot is bound is only known at run time, so the evaluator
+ * still tries the candidates in order before falling back to the globals.
+ *
+ * A slot of an enclosing function is reached through an upvalue. Each
+ * function lists the upvalues its body uses, either a slot of the frame it
+ * is created in or an upvalue of the closure it is created by, so a closure
+ * only keeps alive the variables it refers to.
+ *
+ * A scope's slots follow its parent's, and sibling scopes reuse the same
+ * slots since they are never live together; upvalues are closed when a
+ * scope is left. A scope that binds nothing takes no slots and the executor
+ * skips it altogether.
+ */
+
+typedef enum resolver_pass_e        resolver_pass_t;
+typedef struct resolver_scope_s*    resolver_scope_t;
+typedef struct resolver_function_s* resolver_function_t;
+
+enum resolver_pass_e {
+    RESOLVER_PASS_DECLARE,
+    RESOLVER_PASS_RESOLVE,
+};
+
+struct resolver_scope_s {
+    resolver_scope_t    parent;
+    resolver_function_t function;
+    statement_t         stmt;           /* NULL for a function body */
+    bool                global;         /* module top level, binds globals */
+    array_t             names;          /* symbol_t, in slot order */
+    unsigned int        offset;
+};
+
+struct resolver_function_s {
+    resolver_function_t   parent;
+    expression_function_t function_expr;    /* NULL for the module chunk */
+    resolver_pass_t       pass;
+    resolver_scope_t      scope;            /* innermost open scope */
+    array_t               scopes;           /* resolver_scope_t, in source order */
+    unsigned long         next;             /* next scope to reopen when resolving */
+    unsigned int          frame_size;
+};
+
+static void             __resolver_function_init__(resolver_function_t function, resolver_function_t parent, expression_function_t function_expr);
+static void             __resolver_function_free__(resolver_function_t function);
+static void             __resolver_function__(resolver_scope_t parent, expression_function_t function_expr);
+static void             __resolver_layout__(resolver_function_t function);
+static unsigned int     __resolver_layout_scope__(resolver_function_t function, unsigned long *cursor, unsigned int offset);
+static resolver_scope_t __resolver_open_scope__(resolver_function_t function, resolver_scope_t parent, statement_t stmt);
+static void             __resolver_close_scope__(resolver_function_t function);
+static int              __resolver_scope_find__(resolver_scope_t scope, symbol_t name);
+static void             __resolver_scope_declare__(resolver_scope_t scope, symbol_t name);
+static void             __resolver_block__(resolver_function_t function, list_t block);
+static void             __resolver_statement__(resolver_function_t function, statement_t stmt);
+static void             __resolver_expression__(resolver_function_t function, expression_t expr);
+static void             __resolver_lvalue__(resolver_function_t function, expression_t expr);
+static void             __resolver_identifier__(resolver_function_t function, expression_t expr, bool write);
+static unsigned int     __resolver_capture__(resolver_function_t function, unsigned int depth, unsigned int index);
+
+void resolver_resolve_module(module_t module)
+{
+    struct resolver_function_s function;
+    resolver_scope_t scope;
+    list_iter_t iter;
+    statement_t stmt;
+
+    __resolver_function_init__(&function, NULL, NULL);
+
+    scope = __resolver_open_scope__(&function, NULL, NULL);
+    scope->global = true;
+    __resolver_block__(&function, module->statements->stmts);
+    __resolver_close_scope__(&function);
+
+    __resolver_layout__(&function);
+
+    function.pass = RESOLVER_PASS_RESOLVE;
+
+    scope = __resolver_open_scope__(&function, NULL, NULL);
+    __resolver_block__(&function, module->statements->stmts);
+
+    list_for_each(module->functions, iter) {
+        stmt = list_element(iter, statement_t, link);
+        __resolver_function__(scope, stmt->u.expr->u.function_expr);
+    }
+
+    __resolver_close_scope__(&function);
+
+    module->statements->frame_size = function.frame_size;
+
+    __resolver_function_free__(&function);
+}
+
+static void __resolver_function_init__(resolver_function_t function, resolver_function_t parent, expression_function_t function_expr)
+{
+    function->parent        = parent;
+    function->function_expr = function_expr;
+    function->pass          = RESOLVER_PASS_DECLARE;
+    function->scope         = NULL;
+    function->scopes        = array_new(sizeof(resolver_scope_t));
+    function->next          = 0;
+    function->frame_size    = 0;
+}
+
+static void __resolver_function_free__(resolver_function_t function)
+{
+    resolver_scope_t *scopes;
+    int index;
+
+    array_for_each(function->scopes, scopes, index) {
+        array_free(scopes[index]->names);
+        mem_free(scopes[index]);
+    }
+
+    array_free(function->scopes);
+}
+
+static void __resolver_function__(resolver_scope_t parent, expression_function_t function_expr)
+{
+    struct resolver_function_s function;
+    resolver_scope_t scope;
+    list_iter_t iter;
+
+    __resolver_function_init__(&function, parent->function, function_expr);
+
+    array_clear(function_expr->upvalues);
+
+    scope = __resolver_open_scope__(&function, parent, NULL);
+
+    /* parameters take the first slots in order, even when a name repeats */
+    list_for_each(function_expr->parameters, iter) {
+        *(symbol_t*) array_push(scope->names) =
+            list_element(iter, expression_function_parameter_t, link)->symbol;
+    }
+
+    __resolver_block__(&function, function_expr->block);
+    __resolver_close_scope__(&function);
+
+    __resolver_layout__(&function);
+
+    function.pass = RESOLVER_PASS_RESOLVE;
+
+    __resolver_open_scope__(&function, parent, NULL);
+    __resolver_block__(&function, function_expr->block);
+    __resolver_close_scope__(&function);
+
+    function_expr->frame_size = function.frame_size;
+
+    __resolver_function_free__(&function);
+}
+
+static void __resolver_layout__(resolver_function_t function)
+{
+    unsigned long cursor = 0;
+
+    if (array_length(function->scopes) > 0) {
+        function->frame_size = __resolver_layout_scope__(function, &cursor, 0);
+    }
+
+    assert(cursor == array_length(function->scopes));
+}
+
+/*
+ * Lays out the scope at *cursor and, since scopes are kept in pre-order,
+ * the children that follow it. Returns the end of the slots used.
+ */
+static unsigned int __resolver_layout_scope__(resolver_function_t function, unsigned long *cursor, unsigned int offset)
+{
+    resolver_scope_t *scopes;
+    resolver_scope_t scope;
+    unsigned int base;
+    unsigned int end;
+    unsigned int top;
+
+    scopes = array_base(function->scopes, resolver_scope_t*);
+    scope  = scopes[(*cursor)++];
+
+    scope->offset = offset;
+
+    base = offset + (unsigned int) array_length(scope->names);
+    top  = base;
+
+    while (*cursor < array_length(function->scopes) && scopes[*cursor]->parent == scope) {
+        end = __resolver_layout_scope__(function, cursor, base);
+        if (end > top) {
+            top = end;
+        }
+    }
+
+    if (scope->stmt) {
+        scope->stmt->scope_offset = scope->offset;
+        scope->stmt->scope_size   = (unsigned int) array_length(scope->names);
+    }
+
+    return top;
+}
+
+static resolver_scope_t __resolver_open_scope__(resolver_function_t function, resolver_scope_t parent, statement_t stmt)
+{
+    resolver_scope_t scope;
+
+    if (function->pass == RESOLVER_PASS_RESOLVE) {
+        assert(function->next < array_length(function->scopes));
+
+        scope = array_base(function->scopes, resolver_scope_t*)[function->next++];
+
+        assert(scope->stmt == stmt);
+
+        function->scope = scope;
+        return scope;
+    }
+
+    scope = (resolver_scope_t) mem_alloc(sizeof(struct resolver_scope_s));
+
+    scope->parent   = parent;
+    scope->function = function;
+    scope->stmt     = stmt;
+    scope->global   = false;
+    scope->names    = array_new(sizeof(symbol_t));
+    scope->offset   = 0;
+
+    *(resolver_scope_t*) array_push(function->scopes) = scope;
+
+    function->scope = scope;
+    return scope;
+}
+
+static void __resolver_close_scope__(resolver_function_t function)
+{
+    function->scope = function->scope->parent;
+}
+
+static int __resolver_scope_find__(resolver_scope_t scope, symbol_t name)
+{
+    symbol_t *names;
+    int index;
+
+    names = array_base(scope->names, symbol_t*);
+
+    /* the last of repeated parameters wins, as it is bound last */
+    for (index = (int) array_length(scope->names) - 1; index >= 0; index--) {
+        if (names[index] == name) {
+            return index;
+        }
+    }
+
+    return -1;
+}
+
+static void __resolver_scope_declare__(resolver_scope_t scope, symbol_t name)
+{
+    if (__resolver_scope_find__(scope, name) < 0) {
+        *(symbol_t*) array_push(scope->names) = name;
+    }
+}
+
+static void __resolver_block__(resolver_function_t function, list_t block)
+{
+    list_iter_t iter;
+
+    list_for_each(block, iter) {
+        __resolver_statement__(function, list_element(iter, statement_t, link));
+    }
+}
+
+static void __resolver_statement__(resolver_function_t function, statement_t stmt)
+{
+    list_iter_t iter;
+
+    switch (stmt->type) {
+    case STATEMENT_TYPE_EXPRESSION:
+        __resolver_expression__(function, stmt->u.expr);
+        break;
+
+    case STATEMENT_TYPE_RETURN:
+        if (stmt->u.return_expr) {
+            __resolver_expression__(function, stmt->u.return_expr);
+        }
+        break;
+
+    case STATEMENT_TYPE_IF:
+        __resolver_open_scope__(function, function->scope, stmt);
+
+        __resolver_expression__(function, stmt->u.if_stmt->condition);
+        __resolver_block__(function, stmt->u.if_stmt->if_block);
+
+        list_for_each(stmt->u.if_stmt->elifs, iter) {
+            statement_elif_t elif = list_element(iter, statement_elif_t, link);
+            __resolver_expression__(function, elif->condition);
+            __resolver_block__(function, elif->block);
+        }
+
+        __resolver_block__(function, stmt->u.if_stmt->else_block);
+
+        __resolver_close_scope__(function);
+        break;
+
+    case STATEMENT_TYPE_SWITCH:
+        __resolver_open_scope__(function, function->scope, stmt);
+
+        __resolver_expression__(function, stmt->u.switch_stmt->expr);
+
+        list_for_each(stmt->u.switch_stmt->cases, iter) {
+            statement_switch_case_t switch_case = list_element(iter, statement_switch_case_t, link);
+            __resolver_expression__(function, switch_case->case_expr);
+            __resolver_block__(function, switch_case->block);
+        }
+
+        __resolver_block__(function, stmt->u.switch_stmt->default_block);
+
+        __resolver_close_scope__(function);
+        break;
+
+    case STATEMENT_TYPE_WHILE:
+        __resolver_open_scope__(function, function->scope, stmt);
+
+        __resolver_expression__(function, stmt->u.while_stmt->condition);
+        __resolver_block__(function, stmt->u.while_stmt->block);
+
+        __resolver_close_scope__(function);
+        break;
+
+    case STATEMENT_TYPE_FOR:
+        __resolver_open_scope__(function, function->scope, stmt);
+
+        if (stmt->u.for_stmt->init) {
+            __resolver_expression__(function, stmt->u.for_stmt->init);
+        }
+
+        if (stmt->u.for_stmt->condition) {
+            __resolver_expression__(function, stmt->u.for_stmt->condition);
+        }
+
+        if (stmt->u.for_stmt->post) {
+            __resolver_expression__(function, stmt->u.for_stmt->post);
+        }
+
+        __resolver_block__(function, stmt->u.for_stmt->block);
+
+        __resolver_close_scope__(function);
+        break;
+
+    case STATEMENT_TYPE_FOREACH:
+        __resolver_open_scope__(function, function->scope, stmt);
+
+        __resolver_lvalue__(function, stmt->u.foreach_stmt->key);
+        __resolver_lvalue__(function, stmt->u.foreach_stmt->value);
+        __resolver_expression__(function, stmt->u.foreach_stmt->at);
+        __resolver_block__(function, stmt->u.foreach_stmt->block);
+
+        __resolver_close_scope__(function);
+        break;
+
+    default:
+        break;
+    }
+}
+
+static void __resolver_expression__(resolver_function_t function, expression_t expr)
+{
+    list_iter_t iter;
+
+    switch (expr->type) {
+    case EXPRESSION_TYPE_IDENTIFIER:
+        __resolver_identifier__(function, expr, false);
+        break;
+
+    case EXPRESSION_TYPE_FUNCTION:
+        /* the enclosing frame has to be laid out before the body can refer to it */
+        if (function->pass == RESOLVER_PASS_RESOLVE) {
+            __resolver_function__(function->scope, expr->u.function_expr);
+        }
+        break;
+
+    case EXPRESSION_TYPE_ASSIGN:
+    case EXPRESSION_TYPE_ADD_ASSIGN:
+    case EXPRESSION_TYPE_SUB_ASSIGN:
+    case EXPRESSION_TYPE_MUL_ASSIGN:
+    case EXPRESSION_TYPE_DIV_ASSIGN:
+    case EXPRESSION_TYPE_MOD_ASSIGN:
+    case EXPRESSION_TYPE_BITAND_ASSIGN:
+    case EXPRESSION_TYPE_BITOR_ASSIGN:
+    case EXPRESSION_TYPE_XOR_ASSIGN:
+    case EXPRESSION_TYPE_LEFT_SHIFT_ASSIGN:
+    case EXPRESSION_TYPE_RIGHT_SHIFT_ASSIGN:
+    case EXPRESSION_TYPE_LOGIC_RIGHT_SHIFT_ASSIGN:
+        __resolver_expression__(function, expr->u.assign_expr->rvalue_expr);
+        __resolver_lvalue__(function, expr->u.assign_expr->lvalue_expr);
+        break;
+
+    case EXPRESSION_TYPE_CALL:
+        __resolver_expression__(function, expr->u.call_expr->function_expr);
+
+        list_for_each(expr->u.call_expr->args, iter) {
+            __resolver_expression__(function, list_element(iter, expression_t, link));
+        }
+        break;
+
+    case EXPRESSION_TYPE_CPL:
+    case EXPRESSION_TYPE_NOT:
+    case EXPRESSION_TYPE_PLUS:
+    case EXPRESSION_TYPE_MINUS:
+        __resolver_expression__(function, expr->u.unary_expr);
+        break;
+
+    case EXPRESSION_TYPE_INC:
+    case EXPRESSION_TYPE_DEC:
+        __resolver_lvalue__(function, expr->u.incdec_expr);
+        break;
+
+    case EXPRESSION_TYPE_BITAND:
+    case EXPRESSION_TYPE_BITOR:
+    case EXPRESSION_TYPE_XOR:
+    case EXPRESSION_TYPE_LEFT_SHIFT:
+    case EXPRESSION_TYPE_RIGHT_SHIFT:
+    case EXPRESSION_TYPE_LOGIC_RIGHT_SHIFT:
+    case EXPRESSION_TYPE_MUL:
+    case EXPRESSION_TYPE_DIV:
+    case EXPRESSION_TYPE_MOD:
+    case EXPRESSION_TYPE_ADD:
+    case EXPRESSION_TYPE_SUB:
+    case EXPRESSION_TYPE_GT:
+    case EXPRESSION_TYPE_GEQ:
+    case EXPRESSION_TYPE_LT:
+    case EXPRESSION_TYPE_LEQ:
+    case EXPRESSION_TYPE_EQ:
+    case EXPRESSION_TYPE_NEQ:
+    case EXPRESSION_TYPE_AND:
+    case EXPRESSION_TYPE_OR:
+        __resolver_expression__(function, expr->u.binary_expr->left);
+        __resolver_expression__(function, expr->u.binary_expr->right);
+        break;
+
+    case EXPRESSION_TYPE_ARRAY_GENERATE:
+        list_for_each(expr->u.array_generate_expr, iter) {
+            __resolver_expression__(function, list_element(iter, expression_t, link));
+        }
+        break;
+
+    case EXPRESSION_TYPE_TABLE_GENERATE:
+        list_for_each(expr->u.table_generate_expr, iter) {
+            expression_table_pair_t pair = list_element(iter, expression_table_pair_t, link);
+            __resolver_expression__(function, pair->member_name);
+            __resolver_expression__(function, pair->member_expr);
+        }
+        break;
+
+    case EXPRESSION_TYPE_ARRAY_PUSH:
+        __resolver_expression__(function, expr->u.array_push_expr->array_expr);
+        __resolver_expression__(function, expr->u.array_push_expr->elem_expr);
+        break;
+
+    case EXPRESSION_TYPE_ARRAY_POP:
+        __resolver_expression__(function, expr->u.array_pop_expr->array_expr);
+        __resolver_lvalue__(function, expr->u.array_pop_expr->lvalue_expr);
+        break;
+
+    case EXPRESSION_TYPE_TABLE_DOT_MEMBER:
+        __resolver_expression__(function, expr->u.table_dot_member_expr->table_expr);
+        break;
+
+    case EXPRESSION_TYPE_INDEX:
+        __resolver_expression__(function, expr->u.index_expr->dict);
+        __resolver_expression__(function, expr->u.index_expr->index);
+        break;
+
+    default:
+        break;
+    }
+}
+
+static void __resolver_lvalue__(resolver_function_t function, expression_t expr)
+{
+    if (expr->type == EXPRESSION_TYPE_IDENTIFIER) {
+        __resolver_identifier__(function, expr, true);
+    } else {
+        __resolver_expression__(function, expr);
+    }
+}
+
+static void __resolver_identifier__(resolver_function_t function, expression_t expr, bool write)
+{
+    expression_identifier_t identifier;
+    struct expression_slot_s slot;
+    resolver_scope_t scope;
+    unsigned int depth;
+    int index;
+
+    identifier = expr->u.identifier_expr;
+
+    if (function->pass == RESOLVER_PASS_DECLARE) {
+        if (write && !function->scope->global) {
+            __resolver_scope_declare__(function->scope, identifier->symbol);
+        }
+        return;
+    }
+
+    array_clear(identifier->slots);
+
+    depth = 0;
+
+    for (scope = function->scope; scope != NULL; scope = scope->parent) {
+        index = __resolver_scope_find__(scope, identifier->symbol);
+        if (index >= 0) {
+            slot.upvalue = depth > 0;
+            slot.index   = scope->offset + (unsigned int) index;
+
+            if (slot.upvalue) {
+                slot.index = __resolver_capture__(function, depth, slot.index);
+            }
+
+            *(expression_slot_t) array_push(identifier->slots) = slot;
+        }
+
+        if (scope->parent && scope->parent->function != scope->function) {
+            depth++;
+        }
+    }
+
+    identifier->bind_local = write && !function->scope->global;
+
+    assert(!identifier->bind_local ||
+           (array_length(identifier->slots) > 0 &&
+            !array_base(identifier->slots, expression_slot_t)[0].upvalue));
+}
+
+/*
+ * Returns the upvalue of function that reaches slot index of the frame depth
+ * functions out, adding it and the upvalues of the functions in between as
+ * needed.
+ */
+static unsigned int __resolver_capture__(resolver_function_t function, unsigned int depth, unsigned int index)
+{
+    struct expression_upvalue_s upvalue;
+    expression_upvalue_t upvalues;
+    int i;
+
+    assert(depth > 0 && function->function_expr != NULL);
+
+    if (depth == 1) {
+        upvalue.local = true;
+        upvalue.index = index;
+    } else {
+        upvalue.local = false;
+        upvalue.index = __resolver_capture__(function->parent, depth - 1, index);
+    }
+
+    array_for_each(function->function_expr->upvalues, upvalues, i) {
+        if (upvalues[i].local == upvalue.local && upvalues[i].index == upvalue.index) {
+            return (unsigned int) i;
+        }
+    }
+
+    *(expression_upvalue_t) array_push(function->function_expr->upvalues) = upvalue;
+
+    return (unsigned int) array_length(function->function_expr->upvalues) - 1;
+}
@@ -0,0 +1,11 @@
+
+
+#ifndef _ULCER_RESOLVER_H_
+#define _ULCER_RESOLVER_H_
+
+#include "config.h"
+#include "module.h"
+
+void resolver_resolve_module(module_t module);
+
+#endif
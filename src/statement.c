@@ -58,9 +58,11 @@ statement_t __statement_new__(statement_type_t type, long line, long column)
         return NULL;
     }
 
-    stmt->type   = type;
-    stmt->line   = line;
-    stmt->column = column;
+    stmt->type         = type;
+    stmt->line         = line;
+    stmt->column       = column;
+    stmt->scope_offset = 0;
+    stmt->scope_size   = 0;
 
     return stmt;
 }
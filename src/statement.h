@@ -82,6 +82,8 @@ struct statement_s {
     statement_type_t type;
     long             line;
     long             column;
+    unsigned int     scope_offset;  /* frame slots of the scope this statement opens */
+    unsigned int     scope_size;
 
     union {
         cstring_t           package_name;
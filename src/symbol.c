@@ -0,0 +1,81 @@
+
+
+#include "symbol.h"
+#include "alloc.h"
+
+static int __symbol_key_compare__(const hlist_node_t *lhs, const hlist_node_t *rhs)
+{
+    symbol_t l = hlist_element(lhs, symbol_t, link);
+    symbol_t r = hlist_element(rhs, symbol_t, link);
+    return cstring_cmp(l->name, r->name);
+}
+
+static unsigned long __symbol_key_hashfn__(const hlist_node_t *hnode)
+{
+    return hlist_element(hnode, symbol_t, link)->hash;
+}
+
+static void __symbol_node_destructor__(hlist_node_t *node)
+{
+    symbol_t symbol = hlist_element(node, symbol_t, link);
+
+    /* the constant borrows the name and is never on a heap */
+    if (symbol->string) {
+        mem_free(symbol->string);
+    }
+
+    cstring_free(symbol->name);
+
+    mem_free(symbol);
+}
+
+static hlist_node_ops_t __symbol_hash_operators__ = {
+    NULL,
+    &__symbol_node_destructor__,
+    &__symbol_key_hashfn__,
+    &__symbol_key_compare__,
+    NULL,
+};
+
+symbol_table_t symbol_table_new(void)
+{
+    symbol_table_t table = (symbol_table_t) mem_alloc(sizeof(struct symbol_table_s));
+    if (!table) {
+        return NULL;
+    }
+
+    table->table = hash_table_new(&__symbol_hash_operators__);
+
+    return table;
+}
+
+void symbol_table_free(symbol_table_t table)
+{
+    hash_table_free(table->table);
+    mem_free(table);
+}
+
+symbol_t symbol_table_intern(symbol_table_t table, const cstring_t name)
+{
+    struct symbol_s key;
+    hlist_node_t *node;
+    symbol_t symbol;
+
+    key.name = name;
+    key.hash = symbol_hash(name);
+
+    node = hash_table_search(table->table, &key.link);
+    if (node) {
+        return hlist_element(node, symbol_t, link);
+    }
+
+    symbol = (symbol_t) mem_alloc(sizeof(struct symbol_s));
+
+    symbol->name   = cstring_dup(name);
+    symbol->hash   = key.hash;
+    symbol->string = NULL;
+
+    hash_table_insert(table->table, &symbol->link);
+
+    return symbol;
+}
@@ -0,0 +1,41 @@
+
+
+#ifndef _ULCER_SYMBOL_H_
+#define _ULCER_SYMBOL_H_
+
+#include "config.h"
+#include "cstring.h"
+#include "hlist.h"
+#include "hash_table.h"
+#include "hashfn.h"
+
+typedef struct symbol_s*        symbol_t;
+typedef struct symbol_table_s*  symbol_table_t;
+
+/*
+ * A symbol is an interned name. The hash is computed once when the name is
+ * interned and matches the hash tables use for string keys, so a lookup by
+ * symbol needs neither a key object nor rehashing the name.
+ *
+ * A module's symbols are also its pool of string constants: identifiers,
+ * member names and string literals. Each one gets a single immutable
+ * string object, shared by every evaluation that produces the name.
+ */
+struct symbol_s {
+    cstring_t        name;
+    unsigned long    hash;
+    struct object_s *string;        /* constant string object, made on first use */
+    hlist_node_t     link;
+};
+
+struct symbol_table_s {
+    hash_table_t table;
+};
+
+#define symbol_hash(name) cstring_hash(name)
+
+symbol_table_t symbol_table_new(void);
+void           symbol_table_free(symbol_table_t table);
+symbol_t       symbol_table_intern(symbol_table_t table, const cstring_t name);
+
+#endif
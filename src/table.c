@@ -0,0 +1,930 @@
+
+
+#include "table.h"
+#include "symbol.h"
+#include "alloc.h"
+
+#include <assert.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TABLE_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define TABLE_NEON
+#endif
+
+#define TABLE_CONTROL_EMPTY   (0x80)
+#define TABLE_CONTROL_DELETED (0xfe)
+
+#define __table_control_is_full__(c)                                          \
+    ((c) < 0x80)
+
+/* smallest capacity other than 0, a power of two */
+#ifndef TABLE_MIN_CAPACITY
+#define TABLE_MIN_CAPACITY (4)
+#endif
+
+/* the array part never goes past 1 << TABLE_MAX_ARRAY_BITS elements */
+#ifndef TABLE_MAX_ARRAY_BITS
+#define TABLE_MAX_ARRAY_BITS (26)
+#endif
+
+/* keys that may live in the array part, if it is long enough */
+#define __table_is_index__(key)                                               \
+    ((key)->type == VALUE_TYPE_INT && (key)->u.int_value >= 0 &&              \
+     (unsigned long) (key)->u.int_value < (1UL << TABLE_MAX_ARRAY_BITS))
+
+#define __table_in_array__(table, key)                                        \
+    ((key)->type == VALUE_TYPE_INT && (key)->u.int_value >= 0 &&              \
+     (unsigned long) (key)->u.int_value < (table)->array_capacity)
+
+/*
+ * A match is a mask with a bit per slot of a group, or with NEON the top
+ * bit of a nibble per slot.
+ */
+#if defined(TABLE_NEON)
+typedef uint64_t table_mask_t;
+#define TABLE_MASK_SHIFT (2)
+#else
+typedef unsigned int table_mask_t;
+#define TABLE_MASK_SHIFT (0)
+#endif
+
+static unsigned long __table_hash__(value_t key);
+static unsigned long __table_mix__(unsigned long hash);
+static bool         __table_key_equals__(value_t lhs, value_t rhs);
+static table_mask_t __table_match__(const unsigned char *group, unsigned char control);
+static unsigned long __table_lowest_slot__(table_mask_t mask);
+static unsigned long __table_groups__(unsigned long capacity);
+static unsigned long __table_max_load__(unsigned long capacity);
+static table_pair_t __table_find__(table_t table, value_t key, unsigned long hash);
+static table_pair_t __table_find_string__(table_t table, object_t key, unsigned long hash);
+static table_pair_t __table_probe__(unsigned char *control, unsigned int *indexes, table_pair_t entries, unsigned long capacity, value_t key, unsigned long hash);
+static table_pair_t __table_probe_string__(unsigned char *control, unsigned int *indexes, table_pair_t entries, unsigned long capacity, object_t key, unsigned long hash);
+static unsigned long __table_find_empty__(unsigned char *control, unsigned long capacity, unsigned long hash);
+static table_pair_t __table_insert__(table_t table, value_t key, unsigned long hash);
+static bool         __table_grow__(table_t table);
+static bool         __table_grow_entries__(table_t table);
+static void         __table_rehash__(table_t table);
+static table_pair_t __table_take__(table_t table, value_t key);
+static table_pair_t __table_take_element__(table_t table, unsigned long index);
+static unsigned long __table_index_bits__(unsigned long index);
+static bool         __table_resize_array__(table_t table, value_t key);
+static bool         __table_rebuild__(table_t table, unsigned long moving);
+
+table_t table_new(void)
+{
+    table_t table = (table_t) mem_alloc(sizeof(struct table_s));
+    if (!table) {
+        return NULL;
+    }
+
+    table->entries          = NULL;
+    table->count            = 0;
+    table->entries_capacity = 0;
+    table->control          = NULL;
+    table->indexes          = NULL;
+    table->capacity         = 0;
+    table->used             = 0;
+    table->growth           = 0;
+    table->old_control      = NULL;
+    table->old_indexes      = NULL;
+    table->old_capacity     = 0;
+    table->old_used         = 0;
+    table->rehashidx        = 0;
+    table->hash_indexes     = 0;
+    table->array            = NULL;
+    table->array_capacity   = 0;
+    table->array_used       = 0;
+
+    return table;
+}
+
+void table_free(table_t table)
+{
+    table_clear(table);
+    mem_free(table);
+}
+
+/*
+ * Each control array is a single block with its indexes, the control
+ * bytes first.
+ */
+void table_clear(table_t table)
+{
+    if (table->entries) {
+        mem_free(table->entries);
+    }
+
+    if (table->control) {
+        mem_free(table->control);
+    }
+
+    if (table->old_control) {
+        mem_free(table->old_control);
+    }
+
+    if (table->array) {
+        mem_free(table->array);
+    }
+
+    table->entries          = NULL;
+    table->count            = 0;
+    table->entries_capacity = 0;
+    table->control          = NULL;
+    table->indexes          = NULL;
+    table->capacity         = 0;
+    table->used             = 0;
+    table->growth           = 0;
+    table->old_control      = NULL;
+    table->old_indexes      = NULL;
+    table->old_capacity     = 0;
+    table->old_used         = 0;
+    table->rehashidx        = 0;
+    table->hash_indexes     = 0;
+    table->array            = NULL;
+    table->array_capacity   = 0;
+    table->array_used       = 0;
+}
+
+void table_push_pair(table_t table, environment_t env)
+{
+    assert(environment_stack_size(env) >= 2);
+
+    table_add_member(table, environment_stack_top(env) - 1, environment_stack_top(env));
+
+    environment_pop_values(env, 2);
+}
+
+void table_add_member(table_t table, value_t key, value_t value)
+{
+    table_pair_t pair = __table_take__(table, key);
+
+    if (pair) {
+        pair->key   = *key;
+        pair->value = *value;
+    }
+}
+
+value_t table_search(table_t table, environment_t env)
+{
+    return table_search_by_value(table, environment_stack_top(env));
+}
+
+value_t table_search_by_value(table_t table, value_t key)
+{
+    table_pair_t pair;
+
+    if (__table_in_array__(table, key)) {
+        pair = &table->array[key->u.int_value];
+        return pair->key.type == VALUE_TYPE_NULL ? NULL : &pair->value;
+    }
+
+    pair = __table_find__(table, key, __table_hash__(key));
+
+    return pair ? &pair->value : NULL;
+}
+
+/* the name is looked up with the hash the symbol keeps, and never copied */
+value_t table_search_symbol(table_t table, symbol_t symbol)
+{
+    struct object_s key;
+    table_pair_t    pair;
+
+    key.type     = OBJECT_TYPE_STRING;
+    key.u.string = symbol->name;
+
+    pair = __table_find_string__(table, &key, __table_mix__(symbol->hash));
+
+    return pair ? &pair->value : NULL;
+}
+
+value_t table_new_member(table_t table, value_t key)
+{
+    table_pair_t pair = __table_take__(table, key);
+
+    if (!pair) {
+        return NULL;
+    }
+
+    pair->key        = *key;
+    pair->value.type = VALUE_TYPE_NULL;
+
+    return &pair->value;
+}
+
+/*
+ * The cursor runs over the elements of the array part, then the entries,
+ * which are dense and in the order they came in.
+ */
+table_pair_t table_next(table_t table, unsigned long *cursor)
+{
+    unsigned long index = *cursor;
+
+    for (; index < table->array_capacity; index++) {
+        if (table->array[index].key.type != VALUE_TYPE_NULL) {
+            *cursor = index + 1;
+            return &table->array[index];
+        }
+    }
+
+    if (index - table->array_capacity < table->count) {
+        *cursor = index + 1;
+        return &table->entries[index - table->array_capacity];
+    }
+
+    *cursor = index;
+
+    return NULL;
+}
+
+unsigned long table_memory(table_t table)
+{
+    unsigned long size = sizeof(struct table_s);
+
+    if (table->capacity) {
+        size += __table_groups__(table->capacity) * TABLE_GROUP_SIZE;
+        size += table->capacity * sizeof(unsigned int);
+    }
+
+    if (table->old_capacity) {
+        size += __table_groups__(table->old_capacity) * TABLE_GROUP_SIZE;
+        size += table->old_capacity * sizeof(unsigned int);
+    }
+
+    size += table->entries_capacity * sizeof(struct table_pair_s);
+    size += table->array_capacity * sizeof(struct table_pair_s);
+
+    return size;
+}
+
+/*
+ * __table_mix__ spreads whatever comes out of here, so numbers and
+ * addresses hash to themselves. A float hashes its bits, with both
+ * zeros hashing as one since they compare equal.
+ */
+static unsigned long __table_hash__(value_t key)
+{
+    unsigned long hash = 0;
+    uint32_t      float_bits;
+    uint64_t      double_bits;
+
+    switch (key->type) {
+    case VALUE_TYPE_NULL:
+        hash = 2;
+        break;
+    case VALUE_TYPE_CHAR:
+        hash = key->u.char_value;
+        break;
+    case VALUE_TYPE_BOOL:
+        hash = key->u.bool_value;
+        break;
+    case VALUE_TYPE_INT:
+        hash = (unsigned long)(unsigned int)key->u.int_value;
+        break;
+    case VALUE_TYPE_LONG:
+        hash = (unsigned long)key->u.long_value;
+        break;
+    case VALUE_TYPE_FLOAT:
+        if (key->u.float_value != 0) {
+            memcpy(&float_bits, &key->u.float_value, sizeof(float_bits));
+            hash = (unsigned long)float_bits;
+        }
+        break;
+    case VALUE_TYPE_DOUBLE:
+        if (key->u.double_value != 0) {
+            memcpy(&double_bits, &key->u.double_value, sizeof(double_bits));
+            hash = (unsigned long)(double_bits ^ (double_bits >> 32));
+        }
+        break;
+    case VALUE_TYPE_NATIVE_FUNCTION:
+    case VALUE_TYPE_FUNCTION:
+        hash = (unsigned long)(uintptr_t)key->u.object_value->u.function;
+        break;
+    case VALUE_TYPE_STRING:
+        hash = symbol_hash(key->u.object_value->u.string);
+        break;
+    case VALUE_TYPE_ARRAY:
+        hash = (unsigned long)(uintptr_t)key->u.object_value->u.array;
+        break;
+    case VALUE_TYPE_TABLE:
+        hash = (unsigned long)(uintptr_t)key->u.object_value->u.table;
+        break;
+    case VALUE_TYPE_POINTER:
+        hash = (unsigned long)(uintptr_t)key->u.pointer_value;
+        break;
+    default:
+        break;
+    }
+
+    return __table_mix__(hash);
+}
+
+/*
+ * Some keys hash to little more than themselves, and probing takes the
+ * group from the low bits and the control byte from the next ones, so
+ * every hash is mixed first.
+ */
+static unsigned long __table_mix__(unsigned long hash)
+{
+#if ULONG_MAX > 0xffffffffUL
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdUL;
+    hash ^= hash >> 33;
+#else
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bUL;
+    hash ^= hash >> 13;
+#endif
+
+    return hash;
+}
+
+static bool __table_key_equals__(value_t lhs, value_t rhs)
+{
+    if (lhs->type != rhs->type) {
+        return false;
+    }
+
+    switch (lhs->type) {
+    case VALUE_TYPE_NULL:
+        return true;
+    case VALUE_TYPE_CHAR:
+        return lhs->u.char_value == rhs->u.char_value;
+    case VALUE_TYPE_BOOL:
+        return lhs->u.bool_value == rhs->u.bool_value;
+    case VALUE_TYPE_INT:
+        return lhs->u.int_value == rhs->u.int_value;
+    case VALUE_TYPE_LONG:
+        return lhs->u.long_value == rhs->u.long_value;
+    case VALUE_TYPE_FLOAT:
+        return lhs->u.float_value == rhs->u.float_value;
+    case VALUE_TYPE_DOUBLE:
+        return lhs->u.double_value == rhs->u.double_value;
+    case VALUE_TYPE_NATIVE_FUNCTION:
+    case VALUE_TYPE_FUNCTION:
+        return lhs->u.object_value->u.function == rhs->u.object_value->u.function;
+    case VALUE_TYPE_STRING:
+        return cstring_cmp(lhs->u.object_value->u.string, rhs->u.object_value->u.string) == 0;
+    case VALUE_TYPE_ARRAY:
+        return lhs->u.object_value->u.array == rhs->u.object_value->u.array;
+    case VALUE_TYPE_TABLE:
+        return lhs->u.object_value->u.table == rhs->u.object_value->u.table;
+    case VALUE_TYPE_POINTER:
+        return lhs->u.pointer_value == rhs->u.pointer_value;
+    default:
+        return true;
+    }
+}
+
+/* the slots of group whose control byte is control */
+static table_mask_t __table_match__(const unsigned char *group, unsigned char control)
+{
+#if defined(TABLE_SSE2)
+    __m128i bytes = _mm_loadu_si128((const __m128i*) group);
+
+    return (table_mask_t) _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8((char) control)));
+
+#elif defined(TABLE_NEON)
+    uint8x16_t equal = vceqq_u8(vld1q_u8(group), vdupq_n_u8(control));
+    uint8x8_t  nibbles = vshrn_n_u16(vreinterpretq_u16_u8(equal), 4);
+
+    return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0) & 0x8888888888888888ULL;
+
+#else
+    table_mask_t mask = 0;
+    unsigned int slot;
+
+    for (slot = 0; slot < TABLE_GROUP_SIZE; slot++) {
+        if (group[slot] == control) {
+            mask |= 1U << slot;
+        }
+    }
+
+    return mask;
+#endif
+}
+
+static unsigned long __table_lowest_slot__(table_mask_t mask)
+{
+#if defined(__GNUC__) && defined(TABLE_NEON)
+    return (unsigned long) __builtin_ctzll(mask) >> TABLE_MASK_SHIFT;
+#elif defined(__GNUC__)
+    return (unsigned long) __builtin_ctz(mask);
+#else
+    unsigned long bit = 0;
+
+    while (!(mask & 1)) {
+        mask >>= 1;
+        bit++;
+    }
+
+    return bit >> TABLE_MASK_SHIFT;
+#endif
+}
+
+/*
+ * A table of fewer slots than a group still has a whole group of control
+ * bytes, the ones past its slots held deleted so that nothing lands there.
+ */
+static unsigned long __table_groups__(unsigned long capacity)
+{
+    return capacity < TABLE_GROUP_SIZE ? 1 : capacity / TABLE_GROUP_SIZE;
+}
+
+/* at most 7/8 full, and never full, as a probe for a miss stops at an empty slot */
+static unsigned long __table_max_load__(unsigned long capacity)
+{
+    return capacity < 8 ? capacity - 1 : capacity - capacity / 8;
+}
+
+static table_pair_t __table_find__(table_t table, value_t key, unsigned long hash)
+{
+    table_pair_t pair = NULL;
+
+    if (key->type == VALUE_TYPE_STRING) {
+        return __table_find_string__(table, key->u.object_value, hash);
+    }
+
+    if (table->capacity) {
+        pair = __table_probe__(table->control, table->indexes, table->entries, table->capacity, key, hash);
+    }
+
+    if (!pair && table->old_capacity) {
+        pair = __table_probe__(table->old_control, table->old_indexes, table->entries, table->old_capacity, key, hash);
+    }
+
+    return pair;
+}
+
+static table_pair_t __table_find_string__(table_t table, object_t key, unsigned long hash)
+{
+    table_pair_t pair = NULL;
+
+    if (table->capacity) {
+        pair = __table_probe_string__(table->control, table->indexes, table->entries, table->capacity, key, hash);
+    }
+
+    if (!pair && table->old_capacity) {
+        pair = __table_probe_string__(table->old_control, table->old_indexes, table->entries, table->old_capacity, key, hash);
+    }
+
+    return pair;
+}
+
+/*
+ * Groups are probed in triangular steps, which visit each of them once.
+ * The old arrays may have no empty slot left once indexes have moved out
+ * of them, so the probe also stops after the last group.
+ */
+static table_pair_t __table_probe__(unsigned char *control, unsigned int *indexes, table_pair_t entries, unsigned long capacity, value_t key, unsigned long hash)
+{
+    unsigned long groups = __table_groups__(capacity);
+    unsigned long group  = (hash >> 7) & (groups - 1);
+    unsigned long probe;
+    table_pair_t  pair;
+    table_mask_t  mask;
+
+    for (probe = 1; probe <= groups; probe++) {
+        mask = __table_match__(control + group * TABLE_GROUP_SIZE, (unsigned char) (hash & 0x7f));
+
+        while (mask) {
+            pair = &entries[indexes[group * TABLE_GROUP_SIZE + __table_lowest_slot__(mask)]];
+            if (__table_key_equals__(&pair->key, key)) {
+                return pair;
+            }
+            mask &= mask - 1;
+        }
+
+        if (__table_match__(control + group * TABLE_GROUP_SIZE, TABLE_CONTROL_EMPTY)) {
+            return NULL;
+        }
+
+        group = (group + probe) & (groups - 1);
+    }
+
+    return NULL;
+}
+
+/*
+ * The same, comparing string keys without going through the general
+ * comparison: the same object, or the same length, cached hash and bytes.
+ */
+static table_pair_t __table_probe_string__(unsigned char *control, unsigned int *indexes, table_pair_t entries, unsigned long capacity, object_t key, unsigned long hash)
+{
+    unsigned long groups = __table_groups__(capacity);
+    unsigned long group  = (hash >> 7) & (groups - 1);
+    unsigned long length = cstring_length(key->u.string);
+    unsigned long probe;
+    table_pair_t  pair;
+    table_mask_t  mask;
+    value_t       other;
+
+    for (probe = 1; probe <= groups; probe++) {
+        mask = __table_match__(control + group * TABLE_GROUP_SIZE, (unsigned char) (hash & 0x7f));
+
+        while (mask) {
+            pair  = &entries[indexes[group * TABLE_GROUP_SIZE + __table_lowest_slot__(mask)]];
+            other = &pair->key;
+
+            if (other->type == VALUE_TYPE_STRING &&
+                (other->u.object_value == key ||
+                 (cstring_length(other->u.object_value->u.string) == length &&
+                  cstring_hash(other->u.object_value->u.string) == cstring_hash(key->u.string) &&
+                  memcmp(other->u.object_value->u.string, key->u.string, length) == 0))) {
+                return pair;
+            }
+            mask &= mask - 1;
+        }
+
+        if (__table_match__(control + group * TABLE_GROUP_SIZE, TABLE_CONTROL_EMPTY)) {
+            return NULL;
+        }
+
+        group = (group + probe) & (groups - 1);
+    }
+
+    return NULL;
+}
+
+/* the new arrays have no deleted slot, so the first empty one will do */
+static unsigned long __table_find_empty__(unsigned char *control, unsigned long capacity, unsigned long hash)
+{
+    unsigned long groups = __table_groups__(capacity);
+    unsigned long group  = (hash >> 7) & (groups - 1);
+    unsigned long probe;
+    table_mask_t  mask;
+
+    for (probe = 1; ; probe++) {
+        mask = __table_match__(control + group * TABLE_GROUP_SIZE, TABLE_CONTROL_EMPTY);
+        if (mask) {
+            return group * TABLE_GROUP_SIZE + __table_lowest_slot__(mask);
+        }
+
+        group = (group + probe) & (groups - 1);
+    }
+}
+
+/*
+ * Takes a slot and the next entry for key, which must not be in table,
+ * and gives the entry with the key set and the value left to the caller.
+ */
+static table_pair_t __table_insert__(table_t table, value_t key, unsigned long hash)
+{
+    unsigned long slot;
+
+    if (!table->growth && !__table_grow__(table)) {
+        return NULL;
+    }
+
+    if (table->count == table->entries_capacity && !__table_grow_entries__(table)) {
+        return NULL;
+    }
+
+    if (table->old_capacity) {
+        __table_rehash__(table);
+    }
+
+    slot = __table_find_empty__(table->control, table->capacity, hash);
+
+    table->control[slot] = (unsigned char) (hash & 0x7f);
+    table->indexes[slot] = (unsigned int) table->count;
+    table->entries[table->count].key = *key;
+    table->used++;
+    table->growth--;
+
+    if (__table_is_index__(key)) {
+        table->hash_indexes++;
+    }
+
+    return &table->entries[table->count++];
+}
+
+/*
+ * Keeps the full arrays as the old ones and starts over with arrays twice
+ * their size, with room for the old entries and as many new ones again. A
+ * table that grows again before its last growth is over first finishes
+ * moving the indexes, which the size of the new arrays makes rare.
+ */
+static bool __table_grow__(table_t table)
+{
+    unsigned long  capacity;
+    unsigned long  groups;
+    unsigned char *block;
+
+    while (table->old_capacity) {
+        __table_rehash__(table);
+    }
+
+    capacity = table->capacity ? table->capacity * 2 : TABLE_MIN_CAPACITY;
+    groups   = __table_groups__(capacity);
+
+    block = (unsigned char*) mem_alloc(groups * TABLE_GROUP_SIZE + capacity * sizeof(unsigned int));
+    if (!block) {
+        return false;
+    }
+
+    memset(block, TABLE_CONTROL_EMPTY, capacity);
+    memset(block + capacity, TABLE_CONTROL_DELETED, groups * TABLE_GROUP_SIZE - capacity);
+
+    if (table->used) {
+        table->old_control  = table->control;
+        table->old_indexes  = table->indexes;
+        table->old_capacity = table->capacity;
+        table->old_used     = table->used;
+        table->rehashidx    = 0;
+
+    } else if (table->control) {
+        mem_free(table->control);
+    }
+
+    table->control  = block;
+    table->indexes  = (unsigned int*) (block + groups * TABLE_GROUP_SIZE);
+    table->capacity = capacity;
+    table->used     = 0;
+    table->growth   = __table_max_load__(capacity) - table->old_used;
+
+    return true;
+}
+
+/*
+ * The entries double at once, by realloc, which may move them but leaves
+ * their order and so the indexes alone.
+ */
+static bool __table_grow_entries__(table_t table)
+{
+    unsigned long capacity;
+    table_pair_t  entries;
+
+    capacity = table->entries_capacity ? table->entries_capacity * 2 : TABLE_MIN_CAPACITY;
+
+    entries = (table_pair_t) mem_realloc(table->entries, capacity * sizeof(struct table_pair_s));
+    if (!entries) {
+        return false;
+    }
+
+    table->entries          = entries;
+    table->entries_capacity = capacity;
+
+    return true;
+}
+
+/*
+ * Moves the indexes of the next group of old slots, and lets the old
+ * arrays go once they are empty. The moved slots are left deleted, not empty,
+ * as searches still probe past them.
+ */
+static void __table_rehash__(table_t table)
+{
+    unsigned long end = table->rehashidx + TABLE_GROUP_SIZE;
+    unsigned long hash;
+    unsigned long slot;
+    unsigned long index;
+
+    if (end > table->old_capacity) {
+        end = table->old_capacity;
+    }
+
+    for (index = table->rehashidx; index < end && table->old_used; index++) {
+        if (!__table_control_is_full__(table->old_control[index])) {
+            continue;
+        }
+
+        hash = __table_hash__(&table->entries[table->old_indexes[index]].key);
+        slot = __table_find_empty__(table->control, table->capacity, hash);
+
+        table->control[slot] = (unsigned char) (hash & 0x7f);
+        table->indexes[slot] = table->old_indexes[index];
+
+        table->old_control[index] = TABLE_CONTROL_DELETED;
+        table->old_used--;
+        table->used++;
+    }
+
+    table->rehashidx = index;
+
+    if (!table->old_used) {
+        mem_free(table->old_control);
+
+        table->old_control  = NULL;
+        table->old_indexes  = NULL;
+        table->old_capacity = 0;
+        table->rehashidx    = 0;
+    }
+}
+
+/*
+ * Finds the pair of key, or takes one for it, with the key set and the
+ * value left to the caller. When the hashed slots are full and int keys
+ * are about, the array part may first grow, and have room for key.
+ */
+static table_pair_t __table_take__(table_t table, value_t key)
+{
+    unsigned long hash;
+    table_pair_t  pair;
+
+    if (__table_in_array__(table, key)) {
+        return __table_take_element__(table, (unsigned long) key->u.int_value);
+    }
+
+    hash = __table_hash__(key);
+
+    pair = __table_find__(table, key, hash);
+    if (pair) {
+        return pair;
+    }
+
+    if (!table->growth && (table->hash_indexes || __table_is_index__(key))) {
+        if (!__table_resize_array__(table, key)) {
+            return NULL;
+        }
+
+        if (__table_in_array__(table, key)) {
+            return __table_take_element__(table, (unsigned long) key->u.int_value);
+        }
+    }
+
+    return __table_insert__(table, key, hash);
+}
+
+static table_pair_t __table_take_element__(table_t table, unsigned long index)
+{
+    table_pair_t pair = &table->array[index];
+
+    if (pair->key.type == VALUE_TYPE_NULL) {
+        pair->key.type        = VALUE_TYPE_INT;
+        pair->key.u.int_value = (int) index;
+        table->array_used++;
+    }
+
+    return pair;
+}
+
+/* the smallest bits such that index < 1 << bits */
+static unsigned long __table_index_bits__(unsigned long index)
+{
+    unsigned long bits = 0;
+
+    while (index) {
+        index >>= 1;
+        bits++;
+    }
+
+    return bits;
+}
+
+/*
+ * Counts the int keys, key among them, by the smallest power of two above
+ * each, and makes the array part the largest power of two that they would
+ * fill more than half of. Nothing ever leaves a table, so the array part
+ * only grows.
+ */
+static bool __table_resize_array__(table_t table, value_t key)
+{
+    unsigned long counts[TABLE_MAX_ARRAY_BITS + 1];
+    unsigned long hashed[TABLE_MAX_ARRAY_BITS + 1];
+    unsigned long capacity;
+    unsigned long moving;
+    unsigned long total;
+    unsigned long bits;
+    unsigned long index;
+    table_pair_t  pair;
+    table_pair_t  array;
+
+    memset(counts, 0, sizeof(counts));
+    memset(hashed, 0, sizeof(hashed));
+
+    for (index = 0; index < table->array_capacity; index++) {
+        if (table->array[index].key.type != VALUE_TYPE_NULL) {
+            counts[__table_index_bits__(index)]++;
+        }
+    }
+
+    if (table->hash_indexes) {
+        for (index = 0; index < table->count; index++) {
+            pair = &table->entries[index];
+
+            if (__table_is_index__(&pair->key)) {
+                hashed[__table_index_bits__((unsigned long) pair->key.u.int_value)]++;
+            }
+        }
+    }
+
+    if (__table_is_index__(key)) {
+        counts[__table_index_bits__((unsigned long) key->u.int_value)]++;
+    }
+
+    capacity = table->array_capacity;
+    total    = 0;
+
+    for (bits = 0; bits <= TABLE_MAX_ARRAY_BITS; bits++) {
+        total += counts[bits] + hashed[bits];
+
+        if (total > (1UL << bits) / 2 && (1UL << bits) > capacity) {
+            capacity = 1UL << bits;
+        }
+    }
+
+    if (capacity == table->array_capacity) {
+        return true;
+    }
+
+    array = (table_pair_t) mem_realloc(table->array, capacity * sizeof(struct table_pair_s));
+    if (!array) {
+        return false;
+    }
+
+    for (index = table->array_capacity; index < capacity; index++) {
+        array[index].key.type = VALUE_TYPE_NULL;
+    }
+
+    table->array          = array;
+    table->array_capacity = capacity;
+
+    moving = 0;
+    for (bits = 0; bits <= TABLE_MAX_ARRAY_BITS && (1UL << bits) <= capacity; bits++) {
+        moving += hashed[bits];
+    }
+
+    return moving ? __table_rebuild__(table, moving) : true;
+}
+
+/*
+ * Takes the moving entries whose keys now fall in the array part out of
+ * the others, which close up in the same order, and indexes these all at
+ * once in new slots with room for them and as many again. Unlike growing,
+ * this is not spread over later insertions, but it only comes when the
+ * array part grows over keys that were hashed.
+ */
+static bool __table_rebuild__(table_t table, unsigned long moving)
+{
+    unsigned long  remaining = table->count - moving;
+    unsigned long  capacity  = TABLE_MIN_CAPACITY;
+    unsigned long  groups;
+    unsigned long  index;
+    unsigned long  count;
+    unsigned long  hash;
+    unsigned long  slot;
+    unsigned char *block;
+    unsigned int  *indexes;
+    table_pair_t   pair;
+
+    while (__table_max_load__(capacity) <= remaining * 2) {
+        capacity *= 2;
+    }
+
+    groups = __table_groups__(capacity);
+
+    block = (unsigned char*) mem_alloc(groups * TABLE_GROUP_SIZE + capacity * sizeof(unsigned int));
+    if (!block) {
+        return false;
+    }
+
+    indexes = (unsigned int*) (block + groups * TABLE_GROUP_SIZE);
+
+    memset(block, TABLE_CONTROL_EMPTY, capacity);
+    memset(block + capacity, TABLE_CONTROL_DELETED, groups * TABLE_GROUP_SIZE - capacity);
+
+    for (index = 0, count = 0; index < table->count; index++) {
+        pair = &table->entries[index];
+
+        if (__table_in_array__(table, &pair->key)) {
+            table->array[pair->key.u.int_value] = *pair;
+            table->array_used++;
+            table->hash_indexes--;
+            continue;
+        }
+
+        hash = __table_hash__(&pair->key);
+        slot = __table_find_empty__(block, capacity, hash);
+
+        block[slot]   = (unsigned char) (hash & 0x7f);
+        indexes[slot] = (unsigned int) count;
+
+        table->entries[count++] = *pair;
+    }
+
+    if (table->control) {
+        mem_free(table->control);
+    }
+
+    if (table->old_control) {
+        mem_free(table->old_control);
+    }
+
+    table->count        = count;
+    table->control      = block;
+    table->indexes      = indexes;
+    table->capacity     = capacity;
+    table->used         = count;
+    table->growth       = __table_max_load__(capacity) - count;
+    table->old_control  = NULL;
+    table->old_indexes  = NULL;
+    table->old_capacity = 0;
+    table->old_used     = 0;
+    table->rehashidx    = 0;
+
+    return true;
+}
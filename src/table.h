@@ -0,0 +1,73 @@
+
+
+#ifndef _ULCER_TABLE_H_
+#define _ULCER_TABLE_H_
+
+#include "config.h"
+#include "environment.h"
+
+/*
+ * Script tables keep their pairs as entries in a dense array, in the
+ * order they came in, as Python's dicts do, and find them by hashing with
+ * open addressing, in the manner of Swiss tables. Each slot holds the
+ * index of an entry, and beside the slots an array of control bytes, one
+ * per slot, says whether the slot is empty, deleted or full, and for a
+ * full slot holds seven bits of its key's hash. Slots go in groups of
+ * TABLE_GROUP_SIZE, and a probe compares a whole group of control bytes
+ * at once, with SSE2 or NEON where there is one, so only entries whose
+ * seven bits match have their keys compared.
+ *
+ * Growing the slots is incremental. The full arrays are kept as the old
+ * ones, and every insertion moves a group of their indexes into arrays
+ * twice the size, until none is left; searches look in both meanwhile.
+ * The entries stay where they are then, but double by realloc when full.
+ * An insertion may thus move any pair, and a value found in a table must
+ * be used before anything is added to it, as with the elements of an
+ * array.
+ *
+ * Beside the hashed slots a table has an array part, as in Lua, for the
+ * keys 0, 1, 2 and on when they are ints: the pair of key n is the n-th
+ * element, found without hashing, and an element whose key is null is
+ * not in the table. An int key below the array's capacity is never in
+ * the hashed slots. When the hashed slots are full, the int keys are
+ * counted, and the array becomes the largest power of two that they
+ * would fill more than half of, taking over the entries whose keys fall
+ * in it.
+ */
+
+#define TABLE_GROUP_SIZE (16)
+
+struct table_s {
+    table_pair_t   entries;         /* the hashed pairs, oldest first */
+    unsigned long  count;
+    unsigned long  entries_capacity;
+    unsigned char *control;         /* a byte per slot, then padding up to a group */
+    unsigned int  *indexes;         /* the entry of each full slot */
+    unsigned long  capacity;        /* slots, 0 or a power of two */
+    unsigned long  used;            /* full slots */
+    unsigned long  growth;          /* insertions left before growing */
+    unsigned char *old_control;     /* the arrays being emptied into those above */
+    unsigned int  *old_indexes;
+    unsigned long  old_capacity;
+    unsigned long  old_used;
+    unsigned long  rehashidx;       /* next old slot to move */
+    unsigned long  hash_indexes;    /* int keys among the entries that could go to the array */
+    table_pair_t   array;
+    unsigned long  array_capacity;  /* 0 or a power of two */
+    unsigned long  array_used;
+};
+
+#define table_size(table)                                                     \
+    ((table)->count + (table)->array_used)
+
+/*
+ * visits the pairs of table, those of the array part first and by key,
+ * then the others in the order they came in
+ */
+#define table_for_each(table, cursor, pair)                                   \
+    for ((cursor) = 0; ((pair) = table_next((table), &(cursor))) != NULL;)
+
+table_pair_t  table_next(table_t table, unsigned long *cursor);
+unsigned long table_memory(table_t table);
+
+#endif
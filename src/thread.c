@@ -0,0 +1,227 @@
+
+
+#if !defined(_WIN32) && !defined(WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "thread.h"
+#include "alloc.h"
+
+#if defined(_WIN32) || defined(WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#endif
+
+struct thread_s {
+#if defined(_WIN32) || defined(WIN32)
+    HANDLE             handle;
+#else
+    pthread_t          handle;
+#endif
+    thread_function_pt function;
+    void              *arg;
+};
+
+struct mutex_s {
+#if defined(_WIN32) || defined(WIN32)
+    CRITICAL_SECTION   handle;
+#else
+    pthread_mutex_t    handle;
+#endif
+};
+
+struct cond_s {
+#if defined(_WIN32) || defined(WIN32)
+    CONDITION_VARIABLE handle;
+#else
+    pthread_cond_t     handle;
+#endif
+};
+
+#if defined(_WIN32) || defined(WIN32)
+static DWORD WINAPI __thread_start__(LPVOID arg)
+{
+    thread_t thread = (thread_t) arg;
+
+    thread->function(thread->arg);
+
+    return 0;
+}
+#else
+static void *__thread_start__(void *arg)
+{
+    thread_t thread = (thread_t) arg;
+
+    thread->function(thread->arg);
+
+    return NULL;
+}
+#endif
+
+/*
+ * Starts function(arg) on a thread of its own. Returns NULL when the
+ * system would not start one.
+ */
+thread_t thread_new(thread_function_pt function, void *arg)
+{
+    thread_t thread = (thread_t) mem_alloc(sizeof(struct thread_s));
+    if (!thread) {
+        return NULL;
+    }
+
+    thread->function = function;
+    thread->arg      = arg;
+
+#if defined(_WIN32) || defined(WIN32)
+    thread->handle = CreateThread(NULL, 0, __thread_start__, thread, 0, NULL);
+    if (!thread->handle) {
+        mem_free(thread);
+        return NULL;
+    }
+#else
+    if (pthread_create(&thread->handle, NULL, __thread_start__, thread) != 0) {
+        mem_free(thread);
+        return NULL;
+    }
+#endif
+
+    return thread;
+}
+
+/*
+ * Waits for the thread to return, then frees it.
+ */
+void thread_join(thread_t thread)
+{
+#if defined(_WIN32) || defined(WIN32)
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+#else
+    pthread_join(thread->handle, NULL);
+#endif
+
+    mem_free(thread);
+}
+
+mutex_t mutex_new(void)
+{
+    mutex_t mutex = (mutex_t) mem_alloc(sizeof(struct mutex_s));
+    if (!mutex) {
+        return NULL;
+    }
+
+#if defined(_WIN32) || defined(WIN32)
+    InitializeCriticalSection(&mutex->handle);
+#else
+    pthread_mutex_init(&mutex->handle, NULL);
+#endif
+
+    return mutex;
+}
+
+void mutex_free(mutex_t mutex)
+{
+#if defined(_WIN32) || defined(WIN32)
+    DeleteCriticalSection(&mutex->handle);
+#else
+    pthread_mutex_destroy(&mutex->handle);
+#endif
+
+    mem_free(mutex);
+}
+
+void mutex_lock(mutex_t mutex)
+{
+#if defined(_WIN32) || defined(WIN32)
+    EnterCriticalSection(&mutex->handle);
+#else
+    pthread_mutex_lock(&mutex->handle);
+#endif
+}
+
+void mutex_unlock(mutex_t mutex)
+{
+#if defined(_WIN32) || defined(WIN32)
+    LeaveCriticalSection(&mutex->handle);
+#else
+    pthread_mutex_unlock(&mutex->handle);
+#endif
+}
+
+cond_t cond_new(void)
+{
+    cond_t cond = (cond_t) mem_alloc(sizeof(struct cond_s));
+    if (!cond) {
+        return NULL;
+    }
+
+#if defined(_WIN32) || defined(WIN32)
+    InitializeConditionVariable(&cond->handle);
+#else
+    pthread_cond_init(&cond->handle, NULL);
+#endif
+
+    return cond;
+}
+
+void cond_free(cond_t cond)
+{
+#if !defined(_WIN32) && !defined(WIN32)
+    pthread_cond_destroy(&cond->handle);
+#endif
+
+    mem_free(cond);
+}
+
+/*
+ * Releases mutex, which must be held, until the cond is signalled, and
+ * takes it again. It may also return without a signal.
+ */
+void cond_wait(cond_t cond, mutex_t mutex)
+{
+#if defined(_WIN32) || defined(WIN32)
+    SleepConditionVariableCS(&cond->handle, &mutex->handle, INFINITE);
+#else
+    pthread_cond_wait(&cond->handle, &mutex->handle);
+#endif
+}
+
+void cond_signal(cond_t cond)
+{
+#if defined(_WIN32) || defined(WIN32)
+    WakeConditionVariable(&cond->handle);
+#else
+    pthread_cond_signal(&cond->handle);
+#endif
+}
+
+void cond_broadcast(cond_t cond)
+{
+#if defined(_WIN32) || defined(WIN32)
+    WakeAllConditionVariable(&cond->handle);
+#else
+    pthread_cond_broadcast(&cond->handle);
+#endif
+}
+
+unsigned long thread_clock(void)
+{
+#if defined(_WIN32) || defined(WIN32)
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+
+    return (unsigned long) (counter.QuadPart / frequency.QuadPart * 1000000 +
+        counter.QuadPart % frequency.QuadPart * 1000000 / frequency.QuadPart);
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (unsigned long) now.tv_sec * 1000000UL + (unsigned long) (now.tv_nsec / 1000);
+#endif
+}
@@ -0,0 +1,60 @@
+
+
+#ifndef _ULCER_THREAD_H_
+#define _ULCER_THREAD_H_
+
+#include "config.h"
+
+typedef struct thread_s*    thread_t;
+typedef struct mutex_s*     mutex_t;
+typedef struct cond_s*      cond_t;
+
+typedef void (*thread_function_pt)(void *arg);
+
+thread_t thread_new(thread_function_pt function, void *arg);
+void     thread_join(thread_t thread);
+
+mutex_t  mutex_new(void);
+void     mutex_free(mutex_t mutex);
+void     mutex_lock(mutex_t mutex);
+void     mutex_unlock(mutex_t mutex);
+
+cond_t   cond_new(void);
+void     cond_free(cond_t cond);
+void     cond_wait(cond_t cond, mutex_t mutex);
+void     cond_signal(cond_t cond);
+void     cond_broadcast(cond_t cond);
+
+/*
+ * microseconds of wall time on a clock that only goes forward, whatever
+ * the other threads do; it wraps, so only differences mean anything
+ */
+unsigned long thread_clock(void);
+
+/*
+ * Atomic access to an unsigned long that other threads use at the same
+ * time. The read-modify-writes give what *word held before; all of them
+ * are sequentially consistent.
+ */
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define thread_load(word)                                                     \
+    ((unsigned long) _InterlockedOr((volatile long*) (word), 0))
+#define thread_store(word, value)                                             \
+    ((void) _InterlockedExchange((volatile long*) (word), (long) (value)))
+#define thread_fetch_add(word, n)                                             \
+    ((unsigned long) _InterlockedExchangeAdd((volatile long*) (word), (long) (n)))
+#define thread_fetch_or(word, bits)                                           \
+    ((unsigned long) _InterlockedOr((volatile long*) (word), (long) (bits)))
+#else
+#define thread_load(word)                                                     \
+    __atomic_load_n((word), __ATOMIC_SEQ_CST)
+#define thread_store(word, value)                                             \
+    __atomic_store_n((word), (value), __ATOMIC_SEQ_CST)
+#define thread_fetch_add(word, n)                                             \
+    __sync_fetch_and_add((word), (n))
+#define thread_fetch_or(word, bits)                                           \
+    __sync_fetch_and_or((word), (bits))
+#endif
+
+#endif
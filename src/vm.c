@@ -0,0 +1,575 @@
+
+
+#include "vm.h"
+#include "compiler.h"
+#include "executor.h"
+#include "evaluator.h"
+#include "environment.h"
+#include "table.h"
+#include "heap.h"
+#include "error.h"
+#include "alloc.h"
+
+#include <assert.h>
+
+/*
+ * The vm runs the compiler's bytecode in a single loop. A call to a
+ * script function pushes a frame and carries on in the callee's code
+ * instead of recursing, so deep recursion costs no C stack; natives are
+ * called directly, as they never call back into scripts.
+ *
+ * Registers are the running frame's slots. The slot stack moves when a
+ * frame is pushed, so the base pointer is reloaded after every call.
+ */
+
+typedef struct vm_call_s*       vm_call_t;
+typedef struct vm_iterator_s*   vm_iterator_t;
+
+struct vm_call_s {
+    code_t        code;             /* caller's code, resumed at pc */
+    unsigned long pc;
+    unsigned int  result;           /* caller register for the return value */
+    unsigned long iterators;        /* iterations the caller had open */
+};
+
+struct vm_iterator_s {
+    object_t          collection;   /* also held by a register of the loop */
+    unsigned long     index;        /* an array's next index or a table's cursor */
+};
+
+static void __vm_execute__(environment_t env, code_t code);
+static void __vm_binary__(environment_t env, code_position_t position, expression_type_t type, value_t dst, value_t left, value_t right);
+static void __vm_end_iterations__(array_t iterators, unsigned long depth);
+
+void vm_run(environment_t env, statements_t stmts)
+{
+    if (!stmts->code) {
+        stmts->code = compiler_compile_statements(stmts);
+    }
+
+    environment_push_frame(env, NULL, stmts->code->frame_size);
+
+    __vm_execute__(env, stmts->code);
+
+    environment_close_upvalues(env, 0);
+
+    environment_pop_frame(env);
+}
+
+#define __vm_load_code__()                                                    \
+    do {                                                                      \
+        instructions = array_base(code->instructions, instruction_t);         \
+        positions    = array_base(code->positions, code_position_t);          \
+        constants    = array_base(code->constants, value_t);                  \
+        operands     = array_base(code->operands, void**);                    \
+    } while (false)
+
+#define __vm_load_base__()                                                    \
+    (base = environment_frame_slot(env, environment_get_frame(env), 0))
+
+#define __vm_int_arith__(oper)                                                \
+    if (base[ins->b].type == VALUE_TYPE_INT && base[ins->c].type == VALUE_TYPE_INT) { \
+        base[ins->a].u.int_value = base[ins->b].u.int_value oper base[ins->c].u.int_value; \
+        base[ins->a].type        = VALUE_TYPE_INT;                           \
+        break;                                                                \
+    }
+
+#define __vm_int_divide__(oper)                                               \
+    if (base[ins->b].type == VALUE_TYPE_INT && base[ins->c].type == VALUE_TYPE_INT \
+        && base[ins->c].u.int_value != 0) {                                   \
+        base[ins->a].u.int_value = base[ins->b].u.int_value oper base[ins->c].u.int_value; \
+        base[ins->a].type        = VALUE_TYPE_INT;                           \
+        break;                                                                \
+    }
+
+#define __vm_int_compare__(oper)                                              \
+    if (base[ins->b].type == VALUE_TYPE_INT && base[ins->c].type == VALUE_TYPE_INT) { \
+        base[ins->a].u.bool_value = base[ins->b].u.int_value oper base[ins->c].u.int_value; \
+        base[ins->a].type         = VALUE_TYPE_BOOL;                         \
+        break;                                                                \
+    }
+
+static void __vm_execute__(environment_t env, code_t code)
+{
+    instruction_t   instructions;
+    instruction_t   ins;
+    code_position_t positions;
+    value_t         constants;
+    void**          operands;
+    value_t         base;
+    value_t         value;
+    object_t        object;
+    vm_call_t       call;
+    vm_iterator_t   iterator;
+    array_t         calls;
+    array_t         iterators;
+    unsigned long   pc = 0;
+
+    calls     = array_new(sizeof(struct vm_call_s));
+    iterators = array_new(sizeof(struct vm_iterator_s));
+
+    __vm_load_code__();
+    __vm_load_base__();
+
+    for (;;) {
+        ins = &instructions[pc++];
+
+        switch (ins->op) {
+        case OPCODE_LOADNULL:
+            base[ins->a].type = VALUE_TYPE_NULL;
+            break;
+
+        case OPCODE_LOADK:
+            base[ins->a] = constants[ins->x];
+            break;
+
+        case OPCODE_LOADSTRING:
+            base[ins->a].type           = VALUE_TYPE_STRING;
+            base[ins->a].u.object_value = heap_symbol_string((symbol_t) operands[ins->x]);
+            break;
+
+        case OPCODE_CLOSURE:
+            environment_push_function(env, (expression_function_t) operands[ins->x]);
+            base[ins->a] = *environment_stack_top(env);
+            environment_pop_value(env);
+            break;
+
+        case OPCODE_MOVE:
+            base[ins->a] = base[ins->b];
+            break;
+
+        case OPCODE_GETLOCAL:
+            if (base[ins->b].type != VALUE_TYPE_UNBOUND) {
+                base[ins->a] = base[ins->b];
+                break;
+            }
+
+            value = table_search_symbol(environment_get_global_table(env),
+                                        ((expression_identifier_t) operands[ins->x])->symbol);
+            if (value) {
+                base[ins->a] = *value;
+            } else {
+                base[ins->a].type = VALUE_TYPE_NULL;
+            }
+            break;
+
+        case OPCODE_SETLOCAL:
+            if (base[ins->b].type != VALUE_TYPE_UNBOUND) {
+                base[ins->b] = base[ins->a];
+                break;
+            }
+
+            value  = evaluator_identifier_lvalue(env, (expression_identifier_t) operands[ins->x]);
+            heap_barrier(env, value);
+            *value = base[ins->a];
+            break;
+
+        case OPCODE_GETVAR:
+            value = evaluator_search_identifier(env, (expression_identifier_t) operands[ins->x]);
+            if (value) {
+                base[ins->a] = *value;
+            } else {
+                base[ins->a].type = VALUE_TYPE_NULL;
+            }
+            break;
+
+        case OPCODE_SETVAR:
+            value  = evaluator_identifier_lvalue(env, (expression_identifier_t) operands[ins->x]);
+            heap_barrier(env, value);
+            *value = base[ins->a];
+            break;
+
+        case OPCODE_GETINDEX:
+            value = evaluator_index_value(env, positions[pc - 1].line, positions[pc - 1].column, &base[ins->b], &base[ins->c]);
+            base[ins->a] = *value;
+            break;
+
+        case OPCODE_SETINDEX:
+            value  = evaluator_index_value(env, positions[pc - 1].line, positions[pc - 1].column, &base[ins->b], &base[ins->c]);
+            heap_barrier(env, value);
+            heap_barrier_object(env, base[ins->b].u.object_value);
+            *value = base[ins->a];
+            break;
+
+        case OPCODE_GETMEMBER:
+            value = evaluator_member_value(env, positions[pc - 1].line, positions[pc - 1].column, &base[ins->b], (symbol_t) operands[ins->x]);
+            base[ins->a] = *value;
+            break;
+
+        case OPCODE_SETMEMBER:
+            value  = evaluator_member_value(env, positions[pc - 1].line, positions[pc - 1].column, &base[ins->b], (symbol_t) operands[ins->x]);
+            heap_barrier(env, value);
+            heap_barrier_object(env, base[ins->b].u.object_value);
+            *value = base[ins->a];
+            break;
+
+        case OPCODE_NEWARRAY:
+            object = heap_alloc_array(env);
+            base[ins->a].type           = VALUE_TYPE_ARRAY;
+            base[ins->a].u.object_value = object;
+            break;
+
+        case OPCODE_APPEND:
+            heap_barrier_object(env, base[ins->a].u.object_value);
+            *(value_t) array_push(base[ins->a].u.object_value->u.array) = base[ins->b];
+            break;
+
+        case OPCODE_NEWTABLE:
+            object = heap_alloc_table(env);
+            base[ins->a].type           = VALUE_TYPE_TABLE;
+            base[ins->a].u.object_value = object;
+            break;
+
+        case OPCODE_TABLEKEY:
+            if (base[ins->a].type == VALUE_TYPE_NULL) {
+                base[ins->a].type           = VALUE_TYPE_STRING;
+                base[ins->a].u.object_value = heap_symbol_string((symbol_t) operands[ins->x]);
+            }
+            break;
+
+        case OPCODE_TABLESET:
+            heap_barrier_object(env, base[ins->a].u.object_value);
+            table_add_member(base[ins->a].u.object_value->u.table, &base[ins->b], &base[ins->c]);
+            break;
+
+        case OPCODE_ARRAYPUSH:
+            if (base[ins->a].type != VALUE_TYPE_ARRAY) {
+                runtime_error("(%d, %d): '%s' is not array",
+                              positions[pc - 1].line,
+                              positions[pc - 1].column,
+                              get_value_type_string(base[ins->a].type));
+            }
+
+            heap_barrier_object(env, base[ins->a].u.object_value);
+            *(value_t) array_push(base[ins->a].u.object_value->u.array) = base[ins->b];
+            break;
+
+        case OPCODE_ARRAYPOP:
+            if (base[ins->b].type != VALUE_TYPE_ARRAY) {
+                runtime_error("(%d, %d): '%s' is not array",
+                              positions[pc - 1].line,
+                              positions[pc - 1].column,
+                              get_value_type_string(base[ins->b].type));
+            }
+
+            object = base[ins->b].u.object_value;
+
+            if (array_length(object->u.array) == 0) {
+                base[ins->a].type = VALUE_TYPE_NULL;
+                pc = ins->x;
+                break;
+            }
+
+            base[ins->a] = array_base(object->u.array, value_t)[array_length(object->u.array) - 1];
+            heap_barrier(env, &base[ins->a]);
+            array_pop(object->u.array);
+            break;
+
+        case OPCODE_UNARY:
+            evaluator_unary_value(env, positions[pc - 1].line, positions[pc - 1].column, (expression_type_t) ins->c, &base[ins->a]);
+            break;
+
+        case OPCODE_INCDEC:
+            evaluator_incdec_value(env, positions[pc - 1].line, positions[pc - 1].column, (expression_type_t) ins->c, &base[ins->a]);
+            break;
+
+        case OPCODE_ADD:
+            __vm_int_arith__(+);
+            __vm_binary__(env, &positions[pc - 1], EXPRESSION_TYPE_ADD, &base[ins->a], &base[ins->b], &base[ins->c]);
+            break;
+
+        case OPCODE_SUB:
+            __vm_int_arith__(-);
+            __vm_binary__(env, &positions[pc - 1], EXPRESSION_TYPE_SUB, &base[ins->a], &base[ins->b], &base[ins->c]);
+            break;
+
+        case OPCODE_MUL:
+            __vm_int_arith__(*);
+            __vm_binary__(env, &positions[pc - 1], EXPRESSION_TYPE_MUL, &base[ins->a], &base[ins->b], &base[ins->c]);
+            break;
+
+        case OPCODE_DIV:
+            __vm_int_divide__(/);
+            __vm_binary__(env, &positions[pc - 1], EXPRESSION_TYPE_DIV, &base[ins->a], &base[ins->b], &base[ins->c]);
+            break;
+
+        case OPCODE_MOD:
+            __vm_int_divide__(%);
+            __vm_binary__(env, &positions[pc - 1], EXPRESSION_TYPE_MOD, &base[ins->a], &base[ins->b], &base[ins->c]);
+            break;
+
+        case OPCODE_LT:
+            __vm_int_compare__(<);
+            __vm_binary__(env, &positions[pc - 1], EXPRESSION_TYPE_LT, &base[ins->a], &base[ins->b], &base[ins->c]);
+            break;
+
+        case OPCODE_LEQ:
+            __vm_int_compare__(<=);
+            __vm_binary__(env, &positions[pc - 1], EXPRESSION_TYPE_LEQ, &base[ins->a], &base[ins->b], &base[ins->c]);
+            break;
+
+        case OPCODE_GT:
+            __vm_int_compare__(>);
+            __vm_binary__(env, &positions[pc - 1], EXPRESSION_TYPE_GT, &base[ins->a], &base[ins->b], &base[ins->c]);
+            break;
+
+        case OPCODE_GEQ:
+            __vm_int_compare__(>=);
+            __vm_binary__(env, &positions[pc - 1], EXPRESSION_TYPE_GEQ, &base[ins->a], &base[ins->b], &base[ins->c]);
+            break;
+
+        case OPCODE_EQ:
+            __vm_int_compare__(==);
+            __vm_binary__(env, &positions[pc - 1], EXPRESSION_TYPE_EQ, &base[ins->a], &base[ins->b], &base[ins->c]);
+            break;
+
+        case OPCODE_NEQ:
+            __vm_int_compare__(!=);
+            __vm_binary__(env, &positions[pc - 1], EXPRESSION_TYPE_NEQ, &base[ins->a], &base[ins->b], &base[ins->c]);
+            break;
+
+        case OPCODE_BINARY:
+            __vm_binary__(env, &positions[pc - 1], (expression_type_t) ins->x, &base[ins->a], &base[ins->b], &base[ins->c]);
+            break;
+
+        case OPCODE_TESTLEFT:
+            if (base[ins->a].type != VALUE_TYPE_BOOL) {
+                runtime_error("(%d, %d): unsupported operand for : type(%s) %s",
+                              positions[pc - 1].line,
+                              positions[pc - 1].column,
+                              get_value_type_string(base[ins->a].type),
+                              get_expression_type_string((expression_type_t) ins->c));
+            }
+            break;
+
+        case OPCODE_TESTRIGHT:
+            if (base[ins->a].type != VALUE_TYPE_BOOL) {
+                runtime_error("(%d, %d): unsupported operand for : type(%s) %s type(%s)",
+                              positions[pc - 1].line,
+                              positions[pc - 1].column,
+                              get_value_type_string(VALUE_TYPE_BOOL),
+                              get_expression_type_string((expression_type_t) ins->c),
+                              get_value_type_string(base[ins->a].type));
+            }
+            break;
+
+        case OPCODE_JUMP:
+            pc = ins->x;
+            break;
+
+        case OPCODE_JUMPIF:
+        case OPCODE_JUMPIFNOT:
+            if (base[ins->a].type != VALUE_TYPE_BOOL) {
+                runtime_error("(%d, %d): %s cannot be converted to bool",
+                              positions[pc - 1].line,
+                              positions[pc - 1].column,
+                              get_value_type_string(base[ins->a].type));
+            }
+
+            if (base[ins->a].u.bool_value == (ins->op == OPCODE_JUMPIF)) {
+                pc = ins->x;
+            }
+            break;
+
+        case OPCODE_CALL:
+            value = &base[ins->b];
+
+            if (value->type == VALUE_TYPE_FUNCTION) {
+                expression_function_t function_expr;
+                frame_t frame;
+                value_t argv;
+                unsigned long args;
+                unsigned int index;
+
+                object        = value->u.object_value;
+                function_expr = object->u.function->f.function_expr;
+
+                if (!function_expr->code) {
+                    function_expr->code = compiler_compile_function(function_expr);
+                }
+
+                call = (vm_call_t) array_push(calls);
+
+                call->code      = code;
+                call->pc        = pc;
+                call->result    = ins->a;
+                call->iterators = array_length(iterators);
+
+                /* arguments were evaluated in the caller's frame */
+                args = environment_get_frame(env)->base + ins->b + 1;
+
+                code  = function_expr->code;
+                frame = environment_push_frame(env, object, code->frame_size);
+                base  = environment_frame_slot(env, frame, 0);
+                argv  = environment_slot_at(env, args);
+
+                for (index = 0; index < code->parameters; index++) {
+                    if (index < ins->c) {
+                        base[index] = argv[index];
+                    } else {
+                        base[index].type = VALUE_TYPE_NULL;
+                    }
+                }
+
+                __vm_load_code__();
+                pc = 0;
+
+            } else if (value->type == VALUE_TYPE_NATIVE_FUNCTION) {
+                unsigned int index;
+
+                environment_push_array(env);
+
+                object = environment_stack_top(env)->u.object_value;
+
+                for (index = 0; index < ins->c; index++) {
+                    *(value_t) array_push(object->u.array) = base[ins->b + 1 + index];
+                }
+
+                value->u.object_value->u.function->f.native_function(env, ins->c);
+
+                base[ins->a] = *environment_stack_top(env);
+                environment_pop_value(env);
+
+            } else {
+                runtime_error("(%d, %d): called object type '%s' is not a function",
+                              positions[pc - 1].line,
+                              positions[pc - 1].column,
+                              get_value_type_string(value->type));
+            }
+            break;
+
+        case OPCODE_RETURN:
+            {
+                struct value_s result = base[ins->a];
+
+                environment_close_upvalues(env, 0);
+
+                environment_pop_frame(env);
+
+                assert(array_length(calls) > 0);
+
+                call = array_base(calls, vm_call_t) + array_length(calls) - 1;
+
+                __vm_end_iterations__(iterators, call->iterators);
+
+                code = call->code;
+                pc   = call->pc;
+
+                __vm_load_code__();
+                __vm_load_base__();
+
+                base[call->result] = result;
+
+                array_pop(calls);
+            }
+            break;
+
+        case OPCODE_END:
+            assert(array_is_empty(calls));
+            assert(array_is_empty(iterators));
+
+            array_free(calls);
+            array_free(iterators);
+            return;
+
+        case OPCODE_CLEAR:
+            {
+                unsigned int index;
+
+                for (index = 0; index < ins->b; index++) {
+                    base[ins->a + index].type = VALUE_TYPE_UNBOUND;
+                }
+            }
+            break;
+
+        case OPCODE_CLOSE:
+            environment_close_upvalues(env, ins->a);
+            break;
+
+        case OPCODE_FOREACH:
+            value = &base[ins->a];
+
+            if (value->type != VALUE_TYPE_ARRAY && value->type != VALUE_TYPE_TABLE) {
+                runtime_error("(%d, %d): '%s' is not array/table",
+                              positions[pc - 1].line,
+                              positions[pc - 1].column,
+                              get_value_type_string(value->type));
+            }
+
+            iterator = (vm_iterator_t) array_push(iterators);
+
+            iterator->collection = value->u.object_value;
+            iterator->index      = 0;
+            break;
+
+        case OPCODE_NEXT:
+            iterator = array_base(iterators, vm_iterator_t) + array_length(iterators) - 1;
+            object   = iterator->collection;
+
+            if (object->type == OBJECT_TYPE_ARRAY) {
+                /* the body may grow the array, so its length is read on each pass */
+                if (iterator->index >= array_length(object->u.array)) {
+                    pc = ins->x;
+                    break;
+                }
+
+                base[ins->a].type        = VALUE_TYPE_INT;
+                base[ins->a].u.int_value = (int) iterator->index;
+                base[ins->a + 1]         = *(value_t) array_index(object->u.array, iterator->index);
+
+                iterator->index++;
+
+            } else {
+                table_pair_t pair = table_next(object->u.table, &iterator->index);
+
+                if (!pair) {
+                    pc = ins->x;
+                    break;
+                }
+
+                base[ins->a]     = pair->key;
+                base[ins->a + 1] = pair->value;
+            }
+            break;
+
+        case OPCODE_ENDFOREACH:
+            __vm_end_iterations__(iterators, array_length(iterators) - 1);
+            break;
+
+        case OPCODE_REQUIRE:
+            executor_require(env, (cstring_t) operands[ins->x]);
+
+            /* the required module's frames may have moved the slots */
+            __vm_load_base__();
+            break;
+
+        case OPCODE_RAISE:
+            runtime_error("(%d, %d): %s",
+                          positions[pc - 1].line,
+                          positions[pc - 1].column,
+                          (const char*) operands[ins->x]);
+            break;
+
+        default:
+            assert(false);
+            break;
+        }
+    }
+}
+
+static void __vm_binary__(environment_t env, code_position_t position, expression_type_t type, value_t dst, value_t left, value_t right)
+{
+    /* the operands are temporaries, the implicit cast may convert them in place */
+    evaluator_binary_value(env, position->line, position->column, type, left, right);
+
+    *dst = *environment_stack_top(env);
+
+    environment_pop_value(env);
+}
+
+static void __vm_end_iterations__(array_t iterators, unsigned long depth)
+{
+    while (array_length(iterators) > depth) {
+        array_pop(iterators);
+    }
+}
@@ -0,0 +1,12 @@
+
+
+#ifndef _ULCER_VM_H_
+#define _ULCER_VM_H_
+
+#include "config.h"
+#include "environment.h"
+#include "module.h"
+
+void vm_run(environment_t env, statements_t stmts);
+
+#endif